@@ -19,6 +19,7 @@
 
 #include "util.h"
 #include "application.h"
+#include "trace.h"
 #include "windows/basewindow.h"
 
 using namespace std::literals;
@@ -57,6 +58,11 @@ Application::~Application()
 {
 }
 
+void Application::RunHeadless()
+{
+    main_window = CreateMainWindow();
+}
+
 int Application::Run()
 {
     int err;
@@ -67,14 +73,21 @@ int Application::Run()
 
     auto previousTime = std::chrono::steady_clock::now();
 
+    TRACE_THREAD_NAME("Main");
+
     GLFWwindow* glfw_window = (GLFWwindow*)_glfw_window;
     while (!glfwWindowShouldClose(glfw_window)) {
+        TRACE_SCOPE("Frame");
+
         // Poll and handle events (inputs, window resize, etc.)
         // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants to use your inputs.
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-        glfwPollEvents();
+        {
+            TRACE_SCOPE("PollEvents");
+            glfwPollEvents();
+        }
 
         // Determine deltaTime
         auto currentTime = std::chrono::steady_clock::now();
@@ -85,13 +98,19 @@ int Application::Run()
         if(!Update(deltaTime)) break;
 
         // Update the main window
-        if(main_window) main_window->InternalUpdate(deltaTime);
+        {
+            TRACE_SCOPE("Update");
+            if(main_window) main_window->InternalUpdate(deltaTime);
+        }
 
         // Render the GUI layer
-        ImGui_ImplOpenGL3_NewFrame();     // Start the Dear ImGui frame
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-        if(main_window) main_window->InternalRender();
+        {
+            TRACE_SCOPE("Render");
+            ImGui_ImplOpenGL3_NewFrame();     // Start the Dear ImGui frame
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            if(main_window) main_window->InternalRender();
+        }
 
         // Clear screen and allow the implementation to render opengl if it wants to
         int display_w, display_h;
@@ -99,11 +118,17 @@ int Application::Run()
         glViewport(0, 0, display_w, display_h);
         glClearColor(clear_color[0] * clear_color[3], clear_color[1] * clear_color[3], clear_color[2] * clear_color[3], clear_color[3]);
         glClear(GL_COLOR_BUFFER_BIT);
-        RenderGL();
+        {
+            TRACE_SCOPE("RenderGL");
+            RenderGL();
+        }
 
         // Push the GUI state to opengl
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            TRACE_SCOPE("RenderDrawData");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
         // Update and Render additional platform windows
         // (Platform functions may change the current OpenGL context, so we save/restore it to make it easier to paste this code elsewhere.
@@ -117,7 +142,10 @@ int Application::Run()
         }
 
         // flip
-        glfwSwapBuffers(glfw_window);
+        {
+            TRACE_SCOPE("SwapBuffers");
+            glfwSwapBuffers(glfw_window);
+        }
     }
 
     DestroyPlatformWindow();
@@ -29,6 +29,10 @@ public:
 
     int Run();
 
+    // Create the main window without a platform window or ImGui context, for command line
+    // tools that use projects but never render anything
+    void RunHeadless();
+
     virtual bool Update(double deltaTime);
     virtual void RenderGL();
 
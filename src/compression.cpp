@@ -0,0 +1,161 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <cstring>
+#include <vector>
+
+#include "compression.h"
+
+using namespace std;
+
+#define MIN_MATCH   4
+#define MAX_OFFSET  0xFFFF
+#define HASH_BITS   14
+
+static inline u32 Read32(u8 const* p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u32 Hash(u32 v)
+{
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static inline void WriteLength(string& out, u32 length)
+{
+    while(length >= 255) {
+        out.push_back((char)255);
+        length -= 255;
+    }
+    out.push_back((char)length);
+}
+
+static inline bool ReadLength(u8 const*& ip, u8 const* end, u32& length)
+{
+    u8 b;
+    do {
+        if(ip >= end) return false;
+        b = *ip++;
+        length += b;
+    } while(b == 255);
+    return true;
+}
+
+static void WriteSequence(string& out, u8 const* literals, u32 literal_length, u32 offset, u32 match_length)
+{
+    u32 match_code = (match_length >= MIN_MATCH) ? (match_length - MIN_MATCH) : 0;
+
+    u8 token = (u8)((min(literal_length, 15U) << 4) | min(match_code, 15U));
+    out.push_back((char)token);
+
+    if(literal_length >= 15) WriteLength(out, literal_length - 15);
+    out.append((char const*)literals, literal_length);
+
+    // the last sequence in a block has no match
+    if(match_length == 0) return;
+
+    out.push_back((char)(offset & 0xFF));
+    out.push_back((char)(offset >> 8));
+
+    if(match_code >= 15) WriteLength(out, match_code - 15);
+}
+
+bool CompressBlock(u8 const* src, u32 size, string& out)
+{
+    if(size < MIN_MATCH) return false;
+
+    size_t start = out.size();
+    out.reserve(start + size);
+
+    // positions of the last time each hashed 4-byte sequence was seen, offset by 1 so zero is empty
+    vector<u32> table(1 << HASH_BITS, 0);
+
+    u32 ip = 0;
+    u32 anchor = 0;
+
+    while(ip + MIN_MATCH <= size) {
+        u32 seq = Read32(&src[ip]);
+        u32 h = Hash(seq);
+        u32 candidate = table[h];
+        table[h] = ip + 1;
+
+        if(candidate == 0 || (ip - (candidate - 1)) > MAX_OFFSET || Read32(&src[candidate - 1]) != seq) {
+            // skip ahead faster the longer we go without finding a match, so incompressible data stays cheap
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        // extend the match as far as it goes
+        u32 match = candidate - 1;
+        u32 match_length = MIN_MATCH;
+        while(ip + match_length < size && src[match + match_length] == src[ip + match_length]) match_length++;
+
+        WriteSequence(out, &src[anchor], ip - anchor, ip - match, match_length);
+
+        ip += match_length;
+        anchor = ip;
+
+        // give up early when the output is already larger than the input
+        if(out.size() - start >= size) break;
+    }
+
+    // remaining literals
+    if(out.size() - start < size) WriteSequence(out, &src[anchor], size - anchor, 0, 0);
+
+    if(out.size() - start >= size) {
+        out.resize(start);
+        return false;
+    }
+
+    return true;
+}
+
+bool DecompressBlock(u8 const* src, u32 size, u8* dest, u32 dest_size)
+{
+    u8 const* ip  = src;
+    u8 const* end = src + size;
+    u32 op = 0;
+
+    while(ip < end) {
+        u8 token = *ip++;
+
+        // literals
+        u32 literal_length = token >> 4;
+        if(literal_length == 15 && !ReadLength(ip, end, literal_length)) return false;
+        if(literal_length > (u32)(end - ip) || literal_length > dest_size - op) return false;
+
+        memcpy(&dest[op], ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the last sequence ends with the output full
+        if(op == dest_size) return ip == end;
+
+        // match
+        if(end - ip < 2) return false;
+        u32 offset = (u32)ip[0] | ((u32)ip[1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > op) return false;
+
+        u32 match_length = token & 0x0F;
+        if(match_length == 15 && !ReadLength(ip, end, match_length)) return false;
+        match_length += MIN_MATCH;
+        if(match_length > dest_size - op) return false;
+
+        // matches can overlap the bytes they produce, so copy forward one byte at a time unless they don't
+        u32 match = op - offset;
+        if(offset >= match_length) {
+            memcpy(&dest[op], &dest[match], match_length);
+        } else {
+            for(u32 i = 0; i < match_length; i++) dest[op + i] = dest[match + i];
+        }
+        op += match_length;
+    }
+
+    return op == dest_size;
+}
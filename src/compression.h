@@ -0,0 +1,31 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <string>
+
+#include "util.h"
+
+// A small LZ77 block codec in the style of LZ4. It trades compression ratio for speed, and
+// decompresses much faster than data can be read from disk. Used for project file chunks and
+// save states.
+//
+// A block is a series of sequences, each made of a token byte (high nibble is the literal count,
+// low nibble is the match length - 4, with 15 meaning more length bytes follow), the literal bytes,
+// a 16-bit little-endian match offset and any extra match length bytes. The final sequence only
+// has literals.
+
+// Compress size bytes from src and append them to out. Returns false if the data doesn't get
+// smaller, in which case it should be stored as-is
+bool CompressBlock(u8 const* src, u32 size, std::string& out);
+
+// The most a block of size bytes can decompress to. Every input byte adds at most 255 to a length, and
+// a sequence with no extra length bytes is 3 bytes of token and offset for 19 bytes of match
+inline u64 MaxDecompressedSize(u32 size) { return (u64)size * 255; }
+
+// Decompress a block created by CompressBlock. dest_size must be the exact size of the original
+// data. Returns false if the block is malformed
+bool DecompressBlock(u8 const* src, u32 size, u8* dest, u32 dest_size);
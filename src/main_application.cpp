@@ -235,7 +235,9 @@ bool MainApplication::Update(double deltaTime)
     return !request_exit;
 }
 
+#if !defined(RDS_BENCH) // rds-bench has its own main()
 int main(int argc, char* argv[])
 {
     return MainApplication::Instance(argc, argv)->Run();
 }
+#endif
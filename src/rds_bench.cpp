@@ -0,0 +1,667 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+//
+// rds-bench: measures the emulator cores and the analysis code without any UI, and prints the results
+// as JSON to stdout. All logging from the rest of the program is sent to stderr.
+//
+//     rds-bench [--scale <multiplier>] [--trace <trace.json>] [rom.nes]
+//
+// Without a ROM, a generated NROM image is used so that results are comparable between machines
+// and runs. The CPU-only benchmark maps the first and last PRG banks flat into $8000-$FFFF, which is
+// only accurate for NROM.
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "main_application.h"
+#include "trace.h"
+
+#include "systems/nes/batch.h"
+#include "systems/nes/cartridge.h"
+#include "systems/nes/cpu.h"
+#include "systems/nes/machine.h"
+#include "systems/nes/memory.h"
+#include "systems/nes/ppu.h"
+#include "systems/nes/system.h"
+
+#include "windows/baseproject.h"
+#include "windows/main.h"
+#include "windows/nes/project.h"
+
+#include "util.h"
+
+using namespace std;
+using namespace Systems::NES;
+
+// default workload sizes, multiplied by --scale
+#define BENCH_CPU_CYCLES   10000000
+#define BENCH_PPU_DOTS     30000000
+#define BENCH_FRAMES       300
+#define BENCH_WALK_PASSES  20
+#define BENCH_MARK_PASSES  4
+#define BENCH_SAVE_LOADS   4
+#define BENCH_BATCH_FRAMES 120
+
+namespace {
+
+using bench_clock = chrono::steady_clock;
+
+double SecondsSince(bench_clock::time_point start)
+{
+    return chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// One object of the JSON output. Values are stored already formatted
+struct BenchResult {
+    string name;
+    vector<pair<string, string>> fields {};
+
+    void Add(string const& key, double value) {
+        stringstream ss;
+        ss << setprecision(6) << value;
+        fields.push_back(make_pair(key, ss.str()));
+    }
+
+    void Add(string const& key, u64 value) {
+        fields.push_back(make_pair(key, to_string(value)));
+    }
+
+    void Add(string const& key, string const& value) {
+        string quoted = "\"";
+        for(auto c : value) {
+            if(c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+        fields.push_back(make_pair(key, quoted + "\""));
+    }
+
+    // the common "count, seconds, count per second" triple
+    void AddRate(string const& key, u64 count, double seconds) {
+        Add(key, count);
+        Add("seconds", seconds);
+        Add(key + "_per_second", seconds > 0 ? (double)count / seconds : 0.0);
+    }
+};
+
+void WriteJSON(ostream& os, vector<BenchResult> const& results)
+{
+    os << "{" << endl;
+    for(size_t i = 0; i < results.size(); i++) {
+        auto& result = results[i];
+        os << "  \"" << result.name << "\": {";
+        for(size_t j = 0; j < result.fields.size(); j++) {
+            os << (j ? ", " : " ") << "\"" << result.fields[j].first << "\": " << result.fields[j].second;
+        }
+        os << " }" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    os << "}" << endl;
+}
+
+// Builds a 32KiB NROM image. $8000-$BFFF is a chain of small routines joined by JMPs that the
+// main loop calls every iteration, giving the disassembler a whole bank of code to follow and the
+// CPU a steady mix of loads, stores, arithmetic and branches. $C000 holds the reset and NMI code,
+// which turns on NMI and rendering and does an OAM DMA every frame.
+vector<u8> CreateBenchROM()
+{
+    vector<u8> rom(16 + 2 * 0x4000 + 0x2000, 0);
+
+    // iNES header: 2 PRG banks, 1 CHR bank, mapper 0, vertical mirroring
+    u8 header[] = { 'N', 'E', 'S', 0x1A, 2, 1, 0x01, 0x00 };
+    memcpy(&rom[0], header, sizeof(header));
+
+    u8* prg0 = &rom[16];
+    u8* prg1 = &rom[16 + 0x4000];
+    u8* chr  = &rom[16 + 0x8000];
+
+    // each routine is 18 bytes and ends by jumping to the next one. the last jumps to an RTS
+    int const routine_size = 18;
+    int const num_routines = (0x4000 - 1) / routine_size;
+    for(int i = 0; i < num_routines; i++) {
+        u8  zp   = 0x20 + (i & 0x3F);
+        u16 next = 0x8000 + (i + 1) * routine_size;
+        u8 routine[] = {
+            0xA5, zp,                       // LDA zp
+            0x18,                           // CLC
+            0x69, (u8)(i * 7),              // ADC #imm
+            0x85, zp,                       // STA zp
+            0xA6, 0x12,                     // LDX $12
+            0xE8,                           // INX
+            0x86, 0x12,                     // STX $12
+            0xD0, 0x01,                     // BNE +1
+            0xEA,                           // NOP
+            0x4C, (u8)(next & 0xFF), (u8)(next >> 8) // JMP next
+        };
+        static_assert(sizeof(routine) == 18);
+        memcpy(&prg0[i * routine_size], routine, routine_size);
+    }
+    prg0[num_routines * routine_size] = 0x60; // RTS
+
+    u8 const code[] = {
+        // reset ($C000)
+        0x78,                   // SEI
+        0xD8,                   // CLD
+        0xA2, 0xFF,             // LDX #$FF
+        0x9A,                   // TXS
+        0xA9, 0x00,             // LDA #$00
+        0x8D, 0x01, 0x20,       // STA $2001
+        0x2C, 0x02, 0x20,       // BIT $2002 - wait for two vblanks
+        0x10, 0xFB,             // BPL -5
+        0x2C, 0x02, 0x20,       // BIT $2002
+        0x10, 0xFB,             // BPL -5
+        0xA9, 0x80,             // LDA #$80
+        0x8D, 0x00, 0x20,       // STA $2000 - NMI on
+        0xA9, 0x1E,             // LDA #$1E
+        0x8D, 0x01, 0x20,       // STA $2001 - background and sprites on
+        // main loop ($C01E)
+        0x20, 0x00, 0x80,       // JSR $8000
+        0xE6, 0x11,             // INC $11
+        0x4C, 0x1E, 0xC0,       // JMP $C01E
+        // nmi ($C026)
+        0x48,                   // PHA
+        0xA9, 0x02,             // LDA #$02
+        0x8D, 0x14, 0x40,       // STA $4014 - OAM DMA from $0200
+        0xA5, 0x11,             // LDA $11
+        0x8D, 0x05, 0x20,       // STA $2005
+        0x8D, 0x05, 0x20,       // STA $2005
+        0x68,                   // PLA
+        0x40,                   // RTI
+    };
+    memcpy(prg1, code, sizeof(code));
+
+    // vectors: NMI $C026, RESET $C000, IRQ $C000
+    u8 const vectors[] = { 0x26, 0xC0, 0x00, 0xC0, 0x00, 0xC0 };
+    memcpy(&prg1[0x3FFA], vectors, sizeof(vectors));
+
+    // some pattern so the PPU has non-zero tiles to shift out
+    for(int i = 0; i < 0x2000; i++) chr[i] = (u8)((i * 7) ^ (i >> 3));
+
+    return rom;
+}
+
+bool ReadROM(string const& path, vector<u8>& rom, string& errmsg)
+{
+    ifstream is(path, ios::binary);
+    if(!is) {
+        errmsg = "Could not open " + path;
+        return false;
+    }
+
+    rom.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+    if(rom.size() < 16 || !(rom[0] == 'N' && rom[1] == 'E' && rom[2] == 'S' && rom[3] == 0x1A)) {
+        errmsg = "Not an NES ROM file: " + path;
+        return false;
+    }
+
+    size_t trainer = (rom[6] & 0x04) ? 512 : 0;
+    if(rom[4] == 0 || rom.size() < 16 + trainer + rom[4] * 0x4000) {
+        errmsg = "File too short when reading PRG-ROM: " + path;
+        return false;
+    }
+
+    return true;
+}
+
+// CPU::Step on a flat 64KiB memory with the first and last PRG banks mapped in. $2002 always reads
+// with vblank set so startup loops waiting on the PPU fall through
+BenchResult BenchCPU(vector<u8> const& rom, u64 cycles)
+{
+    auto memory = make_unique<u8[]>(0x10000);
+    memset(memory.get(), 0, 0x10000);
+
+    int num_prg_banks = max(1, (int)rom[4]);
+    int trainer = (rom[6] & 0x04) ? 512 : 0;
+    memcpy(&memory[0x8000], &rom[16 + trainer], 0x4000);
+    memcpy(&memory[0xC000], &rom[16 + trainer + (num_prg_banks - 1) * 0x4000], 0x4000);
+    memory[0x2002] = 0x80;
+
+    u8* mem = memory.get();
+    CPU cpu(
+        [mem](u16 address, bool)->u8 {
+            return mem[address];
+        },
+        [mem](u16 address, u8 value)->void {
+            if(address < 0x2000) mem[address] = value;
+        }
+    );
+    cpu.Reset();
+
+    u64 crashes = 0;
+    auto start = bench_clock::now();
+    while(cpu.GetCycleCount() < cycles) {
+        cpu.Step();
+        [[unlikely]] if(cpu.GetNextUC() < 0) {
+            crashes++;
+            cpu.Reset();
+        }
+    }
+    double seconds = SecondsSince(start);
+
+    BenchResult result { "cpu" };
+    result.AddRate("cycles", cpu.GetCycleCount(), seconds);
+    result.Add("resets_after_crash", crashes);
+    return result;
+}
+
+// PPU::Step rendering the background and sprites out of the ROM's first CHR bank (or zeros)
+BenchResult BenchPPU(vector<u8> const& rom, u64 dots)
+{
+    auto vram = make_unique<u8[]>(0x4000);
+    memset(vram.get(), 0, 0x4000);
+
+    int trainer = (rom[6] & 0x04) ? 512 : 0;
+    size_t chr_offset = 16 + trainer + rom[4] * 0x4000;
+    if(rom[5] && chr_offset + 0x2000 <= rom.size()) memcpy(vram.get(), &rom[chr_offset], 0x2000);
+    for(int i = 0x2000; i < 0x3000; i++) vram[i] = (u8)i;
+
+    u8* mem = vram.get();
+    auto ppu = make_shared<PPU>(
+        [](int) {},
+        [mem](u16 address)->u8 { return mem[address & 0x3FFF]; },
+        [mem](u16 address)->u8 { return mem[address & 0x3FFF]; },
+        [mem](u16 address, u8 value)->void { mem[address & 0x3FFF] = value; }
+    );
+    ppu->Reset();
+
+    auto ppu_view = ppu->CreateMemoryView();
+    ppu_view->Write(0x2000, 0x80);
+    ppu_view->Write(0x2001, 0x1E);
+
+    bool hblank, vblank;
+    u64 colors = 0;
+    auto start = bench_clock::now();
+    for(u64 i = 0; i < dots; i++) {
+        colors += ppu->Step(hblank, vblank);
+    }
+    double seconds = SecondsSince(start);
+
+    BenchResult result { "ppu" };
+    result.AddRate("dots", dots, seconds);
+    result.Add("frames", (u64)ppu->GetFrame());
+    result.Add("color_sum", colors); // keeps the loop from being optimized away
+    return result;
+}
+
+// Machine::SingleCycle through RunFrame, i.e., everything the emulator window does per frame
+BenchResult BenchSystem(shared_ptr<System> const& system, u64 frames)
+{
+    auto machine = make_shared<Machine>(system);
+
+    u64 completed = 0;
+    u64 crashes = 0;
+    auto start = bench_clock::now();
+    while(completed < frames) {
+        if(!machine->RunFrame()) {
+            crashes++;
+            machine->Reset();
+        }
+        completed++;
+    }
+    double seconds = SecondsSince(start);
+
+    BenchResult result { "system" };
+    result.AddRate("frames", completed, seconds);
+    result.Add("cycles_per_second", seconds > 0 ? (double)machine->GetCPU()->GetCycleCount() / seconds : 0.0);
+    result.Add("percent_realtime", seconds > 0 ? 100.0 * machine->GetCPU()->GetCycleCount() / seconds / NES_CPU_CLOCK_HZ : 0.0);
+    result.Add("resets_after_crash", crashes);
+
+    // run the same number of frames again with timing on, for the breakdown
+    machine->EnableTiming(true);
+    for(u64 i = 0; i < frames; i++) {
+        if(!machine->RunFrame()) machine->Reset();
+    }
+
+    auto timing = machine->GetTiming();
+    if(u64 total = timing.SampledTotal()) {
+        result.Add("cpu_percent", 100.0 * timing.cpu / total);
+        result.Add("memory_percent", 100.0 * timing.memory / total);
+        result.Add("breakpoints_percent", 100.0 * timing.breakpoints / total);
+        result.Add("ppu_percent", 100.0 * timing.ppu / total);
+        result.Add("oam_dma_percent", 100.0 * timing.oam_dma / total);
+    }
+
+    return result;
+}
+
+BenchResult BenchDisassembly(shared_ptr<System> const& system)
+{
+    GlobalMemoryLocation entry;
+    system->GetEntryPoint(&entry);
+
+    auto start = bench_clock::now();
+    system->InitDisassembly(entry);
+    system->DisassemblyThread();
+    double seconds = SecondsSince(start);
+
+    BenchResult result { "disassembly" };
+    result.Add("seconds", seconds);
+    result.Add("listing_items", (u64)system->GetMemoryRegion(entry)->GetTotalListingItems());
+    return result;
+}
+
+// Walk every listing item of every PRG bank, as the listing window would when scrolled through
+BenchResult BenchListingWalk(shared_ptr<System> const& system, int passes)
+{
+    auto& cartridge = system->GetCartridge();
+
+    u64 items = 0;
+    u64 address_sum = 0;
+    auto start = bench_clock::now();
+    for(int pass = 0; pass < passes; pass++) {
+        for(u32 bank = 0; bank < cartridge->header.num_prg_rom_banks; bank++) {
+            shared_ptr<MemoryRegion> memory_region = cartridge->GetProgramRomBank(bank);
+            u32 total = memory_region->GetTotalListingItems();
+
+            auto it = memory_region->GetListingItemIterator(0);
+            for(u32 i = 0; i < total && it; i++, ++*it) {
+                if(it->GetListingItem()) items++;
+                address_sum += it->GetCurrentAddress();
+            }
+        }
+    }
+    double seconds = SecondsSince(start);
+
+    BenchResult result { "listing_walk" };
+    result.AddRate("items", items, seconds);
+    result.Add("address_sum", address_sum);
+    return result;
+}
+
+// Re-type the first PRG bank in 16 byte pieces, cycling through words, bytes and undefined
+BenchResult BenchMarkMemory(shared_ptr<System> const& system, int passes)
+{
+    GlobalMemoryLocation where;
+    where.address = 0x8000;
+    where.prg_rom_bank = 0;
+
+    u64 operations = 0;
+    auto start = bench_clock::now();
+    for(int pass = 0; pass < passes; pass++) {
+        for(u32 offset = 0; offset < 0x4000; offset += 16) {
+            GlobalMemoryLocation loc = where + offset;
+            switch((offset / 16 + pass) % 3) {
+            case 0: system->MarkMemoryAsWords(loc, 16); break;
+            case 1: system->MarkMemoryAsBytes(loc, 16); break;
+            case 2: system->MarkMemoryAsUndefined(loc, 16); break;
+            }
+            operations++;
+        }
+    }
+    double seconds = SecondsSince(start);
+
+    BenchResult result { "mark_memory" };
+    result.AddRate("operations", operations, seconds);
+    return result;
+}
+
+// BatchRunner with two jobs per worker. Jobs come in pairs with the same inputs, which have to end up in
+// the same state. The first job is paused and resumed along the way. Returns false if any job didn't
+// finish or a pair doesn't match
+bool BenchBatch(shared_ptr<System> const& system, u64 frames, vector<BenchResult>& results, string& errmsg)
+{
+    BatchRunner runner(system);
+    int num_variants = runner.GetNumWorkers();
+
+    auto start = bench_clock::now();
+
+    vector<BatchRunner::job_id_t> ids;
+    for(int i = 0; i < 2 * num_variants; i++) {
+        BatchRunner::Job job;
+        job.max_frames = frames;
+        job.timing = true;
+
+        // a different button every few frames, repeatable for each variant
+        u32 seed = 0x9E3779B9u * (u32)(i % num_variants + 1);
+        for(u64 frame = 0; frame < frames; frame++) {
+            seed = seed * 1664525u + 1013904223u;
+            job.inputs.push_back((u16)(1 << ((seed >> 24) & 0x0F)));
+        }
+
+        ids.push_back(runner.Launch(job));
+    }
+
+    runner.Pause(ids[0]);
+    runner.WaitAll();
+
+    auto paused = runner.GetResult(ids[0]);
+    if(paused.status != BatchRunner::STATUS::PAUSED && paused.status != BatchRunner::STATUS::FINISHED) {
+        errmsg = "batch job didn't pause";
+        return false;
+    }
+    runner.Resume(ids[0]);
+    runner.Wait(ids[0]);
+
+    double seconds = SecondsSince(start);
+
+    // the end state of every job, to compare the pairs
+    auto state_hash = [&runner](BatchRunner::job_id_t id)->u64 {
+        stringstream ss;
+        string state_errmsg;
+        runner.GetMachine(id)->SaveState(ss, state_errmsg);
+        u64 hash = 0xcbf29ce484222325ULL;
+        for(auto c : ss.str()) hash = (hash ^ (u8)c) * 0x100000001b3ULL;
+        return hash;
+    };
+
+    u64 total_frames = 0;
+    u64 total_cycles = 0;
+    Machine::Timing timing;
+    for(int i = 0; i < (int)ids.size(); i++) {
+        auto result = runner.GetResult(ids[i]);
+        if(result.status != BatchRunner::STATUS::FINISHED || result.frames != frames) {
+            errmsg = "batch job " + to_string(i) + " didn't finish: " + result.errmsg;
+            return false;
+        }
+
+        total_frames += result.frames;
+        total_cycles += result.cycles;
+        timing.cpu         += result.timing.cpu;
+        timing.memory      += result.timing.memory;
+        timing.breakpoints += result.timing.breakpoints;
+        timing.ppu         += result.timing.ppu;
+        timing.oam_dma     += result.timing.oam_dma;
+    }
+
+    for(int i = 0; i < num_variants; i++) {
+        auto first = runner.GetResult(ids[i]);
+        auto second = runner.GetResult(ids[i + num_variants]);
+        if(first.cycles != second.cycles || state_hash(ids[i]) != state_hash(ids[i + num_variants])) {
+            errmsg = "batch jobs " + to_string(i) + " and " + to_string(i + num_variants) + " ran the same inputs differently";
+            return false;
+        }
+    }
+
+    BenchResult result;
+    result.name = "batch";
+    result.Add("workers", (u64)runner.GetNumWorkers());
+    result.Add("jobs", (u64)ids.size());
+    result.AddRate("frames", total_frames, seconds);
+    result.Add("percent_realtime", seconds > 0 ? 100.0 * total_cycles / seconds / NES_CPU_CLOCK_HZ : 0.0);
+    if(u64 total = timing.SampledTotal()) {
+        result.Add("cpu_percent", 100.0 * timing.cpu / total);
+        result.Add("memory_percent", 100.0 * timing.memory / total);
+        result.Add("breakpoints_percent", 100.0 * timing.breakpoints / total);
+        result.Add("ppu_percent", 100.0 * timing.ppu / total);
+        result.Add("oam_dma_percent", 100.0 * timing.oam_dma / total);
+    }
+    results.push_back(result);
+    return true;
+}
+
+// Project::Save to memory, then load it back the same way the main window does, including decoding
+// the banks that are normally loaded lazily
+void BenchSaveLoad(shared_ptr<Windows::NES::Project> const& project, int iterations, vector<BenchResult>& results)
+{
+    string errmsg;
+    string saved;
+
+    double save_seconds = 0.0;
+    for(int i = 0; i < iterations; i++) {
+        stringstream ss;
+        auto start = bench_clock::now();
+        if(!project->Save(ss, errmsg)) {
+            cerr << "[rds-bench] error saving project: " << errmsg << endl;
+            return;
+        }
+        save_seconds += SecondsSince(start);
+        saved = ss.str();
+    }
+
+    BenchResult save_result { "project_save" };
+    save_result.Add("bytes", (u64)saved.size());
+    save_result.Add("iterations", (u64)iterations);
+    save_result.Add("seconds", save_seconds);
+    results.push_back(save_result);
+
+    auto main_window = GetMainWindow();
+    double open_seconds = 0.0;
+    double load_seconds = 0.0;
+    for(int i = 0; i < iterations; i++) {
+        MemoryInputStream is((u8 const*)saved.data(), saved.size());
+        util_readvarint_version = UTIL_READVARINT_VERSION2;
+
+        auto start = bench_clock::now();
+        auto loaded = Windows::BaseProject::StartLoadProject(is, errmsg, PROJECT_FILE_VERSION, PROJECT_FILE_DEFAULT_FLAGS);
+        main_window->SetCurrentProject(loaded);
+        if(!loaded || !loaded->Load(is, errmsg)) {
+            cerr << "[rds-bench] error loading project: " << errmsg << endl;
+            main_window->SetCurrentProject(project);
+            return;
+        }
+        open_seconds += SecondsSince(start);
+
+        auto& cartridge = loaded->GetSystem<System>()->GetCartridge();
+        while(cartridge->HasDeferredBanks()) {
+            cartridge->LoadNextDeferredBanks(max(1u, thread::hardware_concurrency()));
+        }
+        load_seconds += SecondsSince(start);
+    }
+    main_window->SetCurrentProject(project);
+
+    BenchResult load_result { "project_load" };
+    load_result.Add("iterations", (u64)iterations);
+    load_result.Add("seconds_to_open", open_seconds);
+    load_result.Add("seconds", load_seconds);
+    results.push_back(load_result);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    // everything but the results goes to stderr
+    streambuf* stdout_buf = cout.rdbuf(cerr.rdbuf());
+    ostream json(stdout_buf);
+
+    double scale = 1.0;
+    string rom_path;
+    string trace_path;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--scale" && i + 1 < argc) {
+            scale = max(0.001, atof(argv[++i]));
+        } else if(arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if(arg.size() && arg[0] != '-') {
+            rom_path = arg;
+        } else {
+            cerr << "usage: rds-bench [--scale <multiplier>] [--trace <trace.json>] [rom.nes]" << endl;
+            return 1;
+        }
+    }
+
+    auto scaled = [scale](double count)->u64 { return max((u64)1, (u64)(count * scale)); };
+
+    string errmsg;
+    vector<u8> rom;
+    if(rom_path.size()) {
+        if(!ReadROM(rom_path, rom, errmsg)) {
+            cerr << "[rds-bench] " << errmsg << endl;
+            return 1;
+        }
+    } else {
+        // projects are created from a file, so the generated ROM is written out first
+        rom = CreateBenchROM();
+        rom_path = (filesystem::temp_directory_path() / "rds-bench.nes").string();
+        ofstream os(rom_path, ios::binary);
+        os.write((char const*)rom.data(), rom.size());
+        if(!os) {
+            cerr << "[rds-bench] could not write " << rom_path << endl;
+            return 1;
+        }
+    }
+
+    vector<BenchResult> results;
+
+    BenchResult info { "info" };
+    info.Add("rom", rom_path);
+    info.Add("scale", scale);
+    info.Add("hardware_threads", (u64)thread::hardware_concurrency());
+    results.push_back(info);
+
+    cerr << "[rds-bench] CPU" << endl;
+    results.push_back(BenchCPU(rom, scaled(BENCH_CPU_CYCLES)));
+
+    cerr << "[rds-bench] PPU" << endl;
+    results.push_back(BenchPPU(rom, scaled(BENCH_PPU_DOTS)));
+
+    // the systems code finds the current project through the main window, so it has to exist
+    auto app = MainApplication::Instance(argc, argv);
+    app->RunHeadless();
+
+    auto project = dynamic_pointer_cast<Windows::NES::Project>(
+            Windows::NES::Project::CreateProject(PROJECT_FILE_VERSION, PROJECT_FILE_DEFAULT_FLAGS));
+    GetMainWindow()->SetCurrentProject(project);
+
+    cerr << "[rds-bench] creating project" << endl;
+    if(!project->CreateNewProjectFromFile(rom_path)) {
+        cerr << "[rds-bench] could not create a project from " << rom_path << endl;
+        return 1;
+    }
+    auto system = project->GetSystem<System>();
+
+    cerr << "[rds-bench] full system" << endl;
+    results.push_back(BenchSystem(system, scaled(BENCH_FRAMES)));
+
+    cerr << "[rds-bench] batch" << endl;
+    if(!BenchBatch(system, scaled(BENCH_BATCH_FRAMES), results, errmsg)) {
+        cerr << "[rds-bench] " << errmsg << endl;
+        return 1;
+    }
+
+    cerr << "[rds-bench] analysis" << endl;
+    results.push_back(BenchDisassembly(system));
+    results.push_back(BenchListingWalk(system, (int)scaled(BENCH_WALK_PASSES)));
+
+    // save and load after disassembly, so there's code, labels and references to write out
+    BenchSaveLoad(project, (int)scaled(BENCH_SAVE_LOADS), results);
+
+    results.push_back(BenchMarkMemory(system, (int)scaled(BENCH_MARK_PASSES)));
+
+    WriteJSON(json, results);
+
+    if(trace_path.size()) {
+#if defined(ENABLE_TRACING)
+        ofstream os(trace_path);
+        if(!Trace::Export(os, errmsg)) cerr << "[rds-bench] " << errmsg << endl;
+#else
+        cerr << "[rds-bench] --trace needs a build with ENABLE_TRACING" << endl;
+#endif
+    }
+    json.flush();
+
+    cout.rdbuf(stdout_buf);
+    return 0;
+}
@@ -34,12 +34,27 @@
 //
 // my_signal->emit(1, 'a');
 //
+// Usage (batching):
+//
+// {
+//     signal_defer_scope defer; // emissions on this thread are queued until the outermost scope ends
+//     ...                       // bulk operation emitting lots of signals
+// }                             // queued emissions are delivered here
+//
+// Repeated emissions of the same signal with the same arguments are coalesced into one, so signals
+// like "something changed" only fire once per batch. Signals whose arguments are only valid at the time
+// of the emit (i.e., an index into something that keeps changing) use emit_now() to skip the queue.
+//
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <concepts>
 #include <functional>
-#include <map>
 #include <memory>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "util.h"
 
@@ -79,21 +94,69 @@ private:
 
 using signal_connection = std::shared_ptr<signal_connection_base>;
 
+// Signals with queued emissions register themselves with the current thread's batch
+struct signal_deferred_base {
+    virtual void flush_deferred() = 0;
+};
+
+struct _signal_batch_state {
+    int depth = 0;
+    std::vector<std::shared_ptr<signal_deferred_base>> pending;
+};
+
+inline _signal_batch_state& _get_signal_batch_state()
+{
+    static thread_local _signal_batch_state state;
+    return state;
+}
+
+struct signal_defer_scope {
+    signal_defer_scope() { 
+        _get_signal_batch_state().depth++; 
+    }
+
+    ~signal_defer_scope() {
+        auto& state = _get_signal_batch_state();
+        if(--state.depth != 0) return;
+
+        // deliver in the order the signals were first emitted. handlers run with depth 0, so anything
+        // they emit is delivered immediately
+        auto pending = std::move(state.pending);
+        state.pending.clear();
+        for(auto& s : pending) s->flush_deferred();
+    }
+
+    signal_defer_scope(signal_defer_scope const&) = delete;
+    signal_defer_scope& operator=(signal_defer_scope const&) = delete;
+};
+
+template <typename Func>
+struct _signal_traits;
+
+template <typename R, typename ...Args>
+struct _signal_traits<std::function<R(Args...)>> {
+    typedef std::tuple<std::decay_t<Args>...> args_tuple;
+};
+
 // observer pattern started from
 // https://stackoverflow.com/questions/13592847/c11-observer-pattern-signals-slots-events-change-broadcaster-listener-or
+//
+// Connections are kept in a flat vector ordered by id (ids only ever increase). Disconnecting leaves
+// an empty slot behind which is compacted away later, so disconnect never shuffles memory during emit.
 template <typename Func>
-struct signal : public std::enable_shared_from_this<signal<Func>> {
+struct signal : public signal_deferred_base, public std::enable_shared_from_this<signal<Func>> {
     typedef std::shared_ptr<signal_connection_int<signal<Func>>> signal_connection_t;
+    typedef typename _signal_traits<Func>::args_tuple args_tuple;
 
-    _signal_id_t next_id;
-
-    std::map<_signal_id_t, Func> connections;
+    struct slot {
+        _signal_id_t id;
+        Func         func;
+    };
 
     template <typename FuncLike>
     signal_connection_t connect(FuncLike f) 
     {
-        _signal_id_t id = next_id++;
-        connections[id] = f;
+        _signal_id_t id = AddSlot(f);
         signal_connection_t conn = std::make_shared<signal_connection_int<signal<Func>>>(this->shared_from_this(), id);
         return conn;
     }
@@ -101,22 +164,129 @@ struct signal : public std::enable_shared_from_this<signal<Func>> {
     template <typename FuncLike>
     std::shared_ptr<signal<Func>> operator+=(FuncLike f) 
     {
-        _signal_id_t id = next_id++;
-        connections[id] = f;
+        AddSlot(f);
         return this->shared_from_this();
     }
 
     void disconnect(_signal_id_t id)
     {
-        connections.erase(id);
+        auto remove = [&](std::vector<slot>& list)->bool {
+            auto it = std::lower_bound(list.begin(), list.end(), id, [](slot const& a, _signal_id_t b) { return a.id < b; });
+            if(it == list.end() || it->id != id || !it->func) return false;
+            it->func = nullptr;
+            return true;
+        };
+
+        if(!remove(connections) && !remove(added_while_emitting)) return;
+
+        live_count--;
+        dead_count++;
+        if(!emitting) Compact();
     }
 
+    // number of connected handlers
+    int size() const { return live_count; }
+    bool empty() const { return live_count == 0; }
+
     template <typename ...Args>
-    typename Func::result_type emit(Args... args)
+    void emit(Args... args)
     {
-        for(auto& conn : connections) {
-            conn.second(args...);
+        if(live_count == 0) return;
+
+        [[unlikely]] if(_get_signal_batch_state().depth) {
+            if(Defer(args_tuple(args...))) return;
         }
+
+        Call(args...);
+    }
+
+    // deliver immediately, even inside a signal_defer_scope
+    template <typename ...Args>
+    void emit_now(Args... args)
+    {
+        if(live_count == 0) return;
+        Call(args...);
+    }
+
+    void flush_deferred() override
+    {
+        auto queued = std::move(deferred);
+        deferred.clear();
+        for(auto& args : queued) {
+            std::apply([this](auto&... a) { Call(a...); }, args);
+        }
+    }
+
+private:
+    std::vector<slot> connections;
+    std::vector<slot> added_while_emitting;
+    std::vector<args_tuple> deferred;
+
+    _signal_id_t next_id    = 0;
+    int          live_count = 0;
+    int          dead_count = 0;
+    int          emitting   = 0;
+
+    template <typename FuncLike>
+    _signal_id_t AddSlot(FuncLike& f)
+    {
+        _signal_id_t id = next_id++;
+
+        // a handler connecting during emit() can't be allowed to move the slot that is running
+        if(emitting) added_while_emitting.push_back(slot { id, f });
+        else         connections.push_back(slot { id, f });
+
+        live_count++;
+        return id;
+    }
+
+    // Returns false when the emission can't be deferred and must be delivered now
+    bool Defer(args_tuple&& args)
+    {
+        // queued signals are held by the batch, which needs a shared_ptr
+        auto self = this->weak_from_this().lock();
+        if(!self) return false;
+
+        if(deferred.size() == 0) {
+            _get_signal_batch_state().pending.push_back(self);
+        } else if constexpr (std::equality_comparable<args_tuple>) {
+            // coalesce back to back emissions with the same arguments
+            if(deferred.back() == args) return true;
+        }
+
+        deferred.push_back(std::move(args));
+        return true;
+    }
+
+    template <typename ...Args>
+    void Call(Args&... args)
+    {
+        // a handler may drop the last reference to this signal
+        auto self = this->weak_from_this().lock();
+
+        emitting++;
+        for(size_t i = 0; i < connections.size(); i++) {
+            if(connections[i].func) connections[i].func(args...);
+        }
+        emitting--;
+
+        if(!emitting) {
+            if(added_while_emitting.size()) {
+                connections.insert(connections.end(), std::make_move_iterator(added_while_emitting.begin()), 
+                                   std::make_move_iterator(added_while_emitting.end()));
+                added_while_emitting.clear();
+            }
+            Compact();
+        }
+    }
+
+    void Compact()
+    {
+        // only bother when at least half of the slots are empty
+        if(dead_count == 0 || dead_count < live_count) return;
+        std::erase_if(connections, [](slot const& s) { return !s.func; });
+        std::erase_if(added_while_emitting, [](slot const& s) { return !s.func; });
+        dead_count = 0;
     }
 };
 
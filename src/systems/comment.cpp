@@ -11,6 +11,7 @@
 
 #include "systems/comment.h"
 #include "systems/expressions.h"
+#include "systems/system.h"
 
 using namespace std;
 
@@ -30,6 +31,7 @@ void BaseComment::Set(string const& s)
 
     // clear the old comment
     comment_lines.clear();
+    formatted_generation = 0;
 
     // break up `s` into lines and parse individual lines
     int start = 0;
@@ -133,9 +135,24 @@ BaseComment::LINE_ITEM_TYPE BaseComment::FormatLineItem(int i, int j, string& ou
             return LINE_ITEM_TYPE::EXPRESSION;
         }
 
-        stringstream ss;
-        ss << *expr;
-        out = ss.str();
+        // printing expressions happens every frame in the listing, so keep the text around
+        // until something changes how names are printed
+        auto generation = BaseSystem::GetFormatGeneration();
+        if(formatted_generation != generation) {
+            formatted_line_items.clear();
+            formatted_line_items.resize(comment_lines.size());
+            for(int k = 0; k < comment_lines.size(); k++) formatted_line_items[k].resize(comment_lines[k].size());
+            formatted_generation = generation;
+        }
+
+        auto& cached = formatted_line_items[i][j];
+        if(cached.empty()) {
+            stringstream ss;
+            ss << *expr;
+            cached = ss.str();
+        }
+
+        out = cached;
         return LINE_ITEM_TYPE::EXPRESSION;
     } else if(auto perror = get_if<ExpressionError>(&line_item)) {
         out = (*perror).text;
@@ -154,16 +171,17 @@ void BaseComment::GetFullCommentText(string& out) const
         return;
     }
 
+    // expressions are printed directly rather than through FormatLineItem, so that the text
+    // can be retrieved from other threads without touching the formatted item cache
     stringstream ss;
     for(int i = 0; i < comment_lines.size(); i++) {
-        for(int j = 0; j < comment_lines[i].size(); j++) {
-            string s;
-            auto t = FormatLineItem(i, j, s, false);
-           
-            if(t == LINE_ITEM_TYPE::EXPRESSION) {
-                ss << '{' << s << '}';
-            } else {
-                ss << s;
+        for(auto const& line_item : comment_lines[i]) {
+            if(auto pstr = get_if<string>(&line_item)) {
+                ss << *pstr;
+            } else if(auto pexpr = get_if<shared_ptr<BaseExpression>>(&line_item)) {
+                ss << '{' << *(*pexpr) << '}';
+            } else if(auto perror = get_if<ExpressionError>(&line_item)) {
+                ss << perror->text;
             }
         }
 
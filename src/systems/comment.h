@@ -61,6 +61,10 @@ private:
     void ParseLine(std::string const&);
     std::string full_comment_text;
     bool errored = false;
+
+    // printed expressions, valid while formatted_generation matches BaseSystem::GetFormatGeneration()
+    mutable std::vector<std::vector<std::string>> formatted_line_items;
+    mutable u64 formatted_generation = 0;
 };
 
 }
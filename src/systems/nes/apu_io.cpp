@@ -71,6 +71,14 @@ bool APU_IO::Load(istream& is, string& errmsg)
     return is.good();
 }
 
+void APU_IO::CopyState(APU_IO const& other)
+{
+    joy1_state = other.joy1_state;
+    joy1_state_latched = other.joy1_state_latched;
+    joy2_state = other.joy2_state;
+    joy2_state_latched = other.joy2_state_latched;
+}
+
 
 APU_IO_View::APU_IO_View(std::shared_ptr<APU_IO> const& _apu_io)
     : apu_io(_apu_io)
@@ -137,6 +145,7 @@ void APU_IO_View::Write(u16 address, u8 value)
         if(value & 1) joy1_probe = 1;
         else if(!(value & 1) && joy1_probe) {
             joy1_probe = 0;
+            if(apu_io->latch_func) apu_io->latch_func(apu_io->joy1_state, apu_io->joy2_state);
             apu_io->joy1_state_latched = apu_io->joy1_state;
         }
         break;
@@ -145,6 +154,7 @@ void APU_IO_View::Write(u16 address, u8 value)
         if(value & 1) joy2_probe = 1;
         else if(!(value & 1) && joy2_probe) {
             joy2_probe = 0;
+            if(apu_io->latch_func) apu_io->latch_func(apu_io->joy1_state, apu_io->joy2_state);
             apu_io->joy2_state_latched = apu_io->joy2_state;
         }
         break;
@@ -174,6 +184,13 @@ bool APU_IO_View::Load(istream& is, string& errmsg)
     return is.good();
 }
 
+void APU_IO_View::CopyState(MemoryView const& _other)
+{
+    auto& other = dynamic_cast<APU_IO_View const&>(_other);
+    joy1_probe = other.joy1_probe;
+    joy2_probe = other.joy2_probe;
+}
+
 }
 
 
@@ -34,6 +34,11 @@ public:
     void SetJoy1Pressed(int button, bool pressed);
     void SetJoy2Pressed(int button, bool pressed);
 
+    // Called on the emulation thread every time the game strobes a joypad, just before the buttons are
+    // latched. It can change the button states, which is how movies replay input
+    typedef std::function<void(u8& joy1, u8& joy2)> latch_func_t;
+    void SetLatchFunction(latch_func_t const& func) { latch_func = func; }
+
     std::shared_ptr<MemoryView> CreateMemoryView();
 
     make_signal(oam_dma_callback, void(u8));
@@ -41,6 +46,8 @@ public:
     bool Save(std::ostream&, std::string&) const;
     bool Load(std::istream&, std::string&);
 
+    void CopyState(APU_IO const&);
+
     friend class APU_IO_View;
 
 private:
@@ -48,6 +55,8 @@ private:
     u8 joy1_state_latched;
     u8 joy2_state = 0;
     u8 joy2_state_latched;
+
+    latch_func_t latch_func;
 };
 
 class APU_IO_View : public MemoryView {
@@ -65,6 +74,8 @@ public:
     bool Save(std::ostream& os, std::string& errmsg) const override;
     bool Load(std::istream& is, std::string& errmsg) override;
 
+    void CopyState(MemoryView const&) override;
+
 private:
     std::shared_ptr<APU_IO> apu_io;
 
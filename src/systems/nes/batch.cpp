@@ -0,0 +1,278 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <cassert>
+#include <iostream>
+
+#include "systems/nes/apu_io.h"
+#include "systems/nes/batch.h"
+#include "systems/nes/cartridge.h"
+#include "systems/nes/cpu.h"
+#include "systems/nes/machine.h"
+#include "systems/nes/system.h"
+
+using namespace std;
+
+namespace Systems::NES {
+
+BatchRunner::BatchRunner(shared_ptr<System> const& _system, int num_workers, int _frames_per_quantum)
+    : system(_system), frames_per_quantum(max(1, _frames_per_quantum))
+{
+    // Launch can be called from any thread, which can't load banks itself
+    if(auto& cartridge = system->GetCartridge()) cartridge->LoadAllDeferredBanks();
+
+    if(num_workers <= 0) num_workers = (int)max(1u, thread::hardware_concurrency());
+
+    for(int i = 0; i < num_workers; i++) {
+        workers.emplace_back(std::bind(&BatchRunner::WorkerThread, this));
+    }
+
+    cout << "[BatchRunner::BatchRunner] started " << num_workers << " worker thread(s)" << endl;
+}
+
+BatchRunner::~BatchRunner()
+{
+    {
+        lock_guard<mutex> lock(jobs_mutex);
+        exit_workers = true;
+        for(auto& pair : instances) pair.second->stop_requested = true;
+    }
+
+    ready_cv.notify_all();
+    for(auto& worker : workers) worker.join();
+}
+
+BatchRunner::job_id_t BatchRunner::Launch(Job const& job)
+{
+    auto instance = make_shared<Instance>();
+    instance->job = job;
+
+    // creating the machine builds memory views from the System, so do it here rather than on a worker
+    // and nothing displays the machine, so it's headless
+    if(job.fork_from) {
+        instance->machine = job.fork_from->Fork(true);
+        instance->job.fork_from = nullptr;
+    } else {
+        instance->machine = make_shared<Machine>(system, true);
+    }
+
+    lock_guard<mutex> lock(jobs_mutex);
+    instance->id = next_job_id++;
+    instances[instance->id] = instance;
+    ready.push_back(instance);
+    ready_cv.notify_one();
+
+    return instance->id;
+}
+
+void BatchRunner::Pause(job_id_t id)
+{
+    lock_guard<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return;
+
+    auto& instance = instances[id];
+    switch(instance->status) {
+    case STATUS::QUEUED: {
+        // not on a worker, so it can be pulled out of the queue right away
+        auto it = find(ready.begin(), ready.end(), instance);
+        if(it != ready.end()) ready.erase(it);
+        instance->status = STATUS::PAUSED;
+        done_cv.notify_all();
+        break;
+    }
+
+    case STATUS::RUNNING:
+        // the worker parks it at the end of the current quantum
+        instance->pause_requested = true;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void BatchRunner::Resume(job_id_t id)
+{
+    lock_guard<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return;
+
+    auto& instance = instances[id];
+    instance->pause_requested = false;
+    if(instance->status != STATUS::PAUSED) return;
+
+    instance->status = STATUS::QUEUED;
+    ready.push_back(instance);
+    ready_cv.notify_one();
+}
+
+void BatchRunner::Stop(job_id_t id)
+{
+    lock_guard<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return;
+
+    auto& instance = instances[id];
+    switch(instance->status) {
+    case STATUS::QUEUED:
+    case STATUS::PAUSED: {
+        auto it = find(ready.begin(), ready.end(), instance);
+        if(it != ready.end()) ready.erase(it);
+        instance->status = STATUS::STOPPED;
+        done_cv.notify_all();
+        break;
+    }
+
+    case STATUS::RUNNING:
+        // checked by the worker after every frame
+        instance->stop_requested = true;
+        break;
+
+    default:
+        break;
+    }
+}
+
+BatchRunner::Result BatchRunner::Wait(job_id_t id)
+{
+    unique_lock<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return Result();
+
+    auto instance = instances[id];
+    done_cv.wait(lock, [&instance]() { return IsDone(instance->status) || instance->status == STATUS::PAUSED; });
+    return MakeResult(*instance);
+}
+
+void BatchRunner::WaitAll()
+{
+    unique_lock<mutex> lock(jobs_mutex);
+    done_cv.wait(lock, [this]() {
+        for(auto& pair : instances) {
+            // paused jobs would never finish
+            if(!IsDone(pair.second->status) && pair.second->status != STATUS::PAUSED) return false;
+        }
+        return true;
+    });
+}
+
+BatchRunner::Result BatchRunner::GetResult(job_id_t id)
+{
+    lock_guard<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return Result();
+    return MakeResult(*instances[id]);
+}
+
+shared_ptr<Machine> BatchRunner::GetMachine(job_id_t id)
+{
+    lock_guard<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return nullptr;
+    return instances[id]->machine;
+}
+
+bool BatchRunner::Remove(job_id_t id)
+{
+    lock_guard<mutex> lock(jobs_mutex);
+    if(!instances.contains(id)) return true;
+
+    auto& instance = instances[id];
+    if(!IsDone(instance->status) && instance->status != STATUS::PAUSED) return false;
+
+    instances.erase(id);
+    return true;
+}
+
+// jobs_mutex must be held by the caller
+BatchRunner::Result BatchRunner::MakeResult(Instance const& instance) const
+{
+    Result result;
+    result.status = instance.status;
+    result.frames = instance.frames;
+    result.errmsg = instance.errmsg;
+
+    // only read the CPU when no worker is touching it
+    if(instance.status != STATUS::RUNNING && instance.started) {
+        result.cycles = instance.machine->GetCPU()->GetCycleCount() - instance.start_cycles;
+        result.timing = instance.machine->GetTiming();
+    }
+
+    return result;
+}
+
+void BatchRunner::WorkerThread()
+{
+    unique_lock<mutex> lock(jobs_mutex);
+
+    while(true) {
+        ready_cv.wait(lock, [this]() { return exit_workers || ready.size() > 0; });
+        if(exit_workers) break;
+
+        auto instance = ready.front();
+        ready.pop_front();
+        instance->status = STATUS::RUNNING;
+
+        lock.unlock();
+        auto status = RunQuantum(*instance);
+        lock.lock();
+
+        if(status == STATUS::RUNNING && instance->pause_requested) {
+            instance->pause_requested = false;
+            status = STATUS::PAUSED;
+        }
+
+        instance->status = status;
+        if(status == STATUS::RUNNING) {
+            // back of the line
+            instance->status = STATUS::QUEUED;
+            ready.push_back(instance);
+        } else {
+            done_cv.notify_all();
+        }
+    }
+}
+
+// Runs without jobs_mutex held. Returns RUNNING if the job should be queued again
+BatchRunner::STATUS BatchRunner::RunQuantum(Instance& instance)
+{
+    auto& machine = *instance.machine;
+    auto& job = instance.job;
+
+    if(!instance.started) {
+        instance.started = true;
+
+        if(job.save_state.size()) {
+            MemoryInputStream is((u8 const*)job.save_state.data(), job.save_state.size());
+            if(!machine.LoadState(is, instance.errmsg)) return STATUS::ERROR;
+        }
+
+        instance.start_cycles = machine.GetCPU()->GetCycleCount();
+        machine.EnableTiming(job.timing);
+    }
+
+    auto& apu_io = machine.GetAPUIO();
+
+    for(int i = 0; i < frames_per_quantum; i++) {
+        if(instance.stop_requested) return STATUS::STOPPED;
+        if(job.max_frames && instance.frames >= job.max_frames) return STATUS::FINISHED;
+
+        if(job.inputs.size()) {
+            u16 buttons = job.inputs[min(instance.frames, (u64)job.inputs.size() - 1)];
+            for(int button = 0; button < 8; button++) {
+                apu_io->SetJoy1Pressed(button, (bool)(buttons & (1 << button)));
+                apu_io->SetJoy2Pressed(button, (bool)(buttons & (1 << (button + 8))));
+            }
+        }
+
+        if(!machine.RunFrame()) {
+            instance.errmsg = "Invalid opcode";
+            return STATUS::CRASHED;
+        }
+
+        instance.frames++;
+        if(job.frame_callback && !job.frame_callback(machine, instance.frames)) return STATUS::FINISHED;
+    }
+
+    if(job.max_frames && instance.frames >= job.max_frames) return STATUS::FINISHED;
+    return STATUS::RUNNING;
+}
+
+}
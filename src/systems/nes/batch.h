@@ -0,0 +1,138 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+
+#include "systems/nes/machine.h"
+
+namespace Systems::NES {
+
+class System;
+
+// BatchRunner runs many headless Machines of the same System (i.e., the same ROM with different inputs or
+// starting states) on a fixed pool of worker threads, one per core by default. Each job runs for a quantum
+// of frames and then goes to the back of the queue, so any number of jobs share the cores fairly.
+//
+// Machines need every cartridge bank, and deferred banks are only loaded on the load or UI thread, so
+// the constructor loads them and has to be called from there. Everything else is safe to call from
+// any thread.
+class BatchRunner {
+public:
+    typedef int job_id_t;
+
+    enum class STATUS {
+        QUEUED,
+        RUNNING,
+        PAUSED,
+        FINISHED,   // reached max_frames or frame_callback returned false
+        STOPPED,    // Stop() was called
+        CRASHED,    // the CPU hit an invalid opcode
+        ERROR       // save_state couldn't be loaded
+    };
+
+    struct Job {
+        // the starting state as written by Machine::SaveState. empty starts from reset
+        std::string save_state;
+
+        // or start as a copy of another machine, which must not be running during Launch()
+        std::shared_ptr<Machine> fork_from;
+
+        // joypad buttons for each frame, joy1 in the low byte and joy2 in the high byte (bit n = NES_BUTTON_n).
+        // the last entry is held after the inputs run out
+        std::vector<u16> inputs;
+
+        // 0 runs until frame_callback returns false or the job is stopped
+        u64 max_frames = 0;
+
+        // called on the worker thread after every frame with the number of frames completed. return false to finish
+        std::function<bool(Machine&, u64)> frame_callback;
+
+        // keep Machine::Timing counters, returned in the Result
+        bool timing = false;
+    };
+
+    struct Result {
+        STATUS      status = STATUS::QUEUED;
+        u64         frames = 0;
+        u64         cycles = 0;
+        std::string errmsg;
+
+        // where the time went, when Job::timing is set. not filled in while RUNNING
+        Machine::Timing timing;
+    };
+
+    // num_workers of 0 uses one per core
+    BatchRunner(std::shared_ptr<System> const&, int num_workers = 0, int frames_per_quantum = 8);
+    ~BatchRunner();
+
+    int      GetNumWorkers() const { return (int)workers.size(); }
+
+    job_id_t Launch(Job const&);
+    void     Pause(job_id_t);
+    void     Resume(job_id_t);
+    void     Stop(job_id_t);
+
+    // Block until the job is FINISHED, STOPPED, CRASHED, ERROR or PAUSED and return its result. A paused
+    // job would never finish, so it's returned as PAUSED like WaitAll skips it
+    Result   Wait(job_id_t);
+    void     WaitAll();
+
+    Result   GetResult(job_id_t);
+
+    // The machine is only safe to inspect while its job is paused or done
+    std::shared_ptr<Machine> GetMachine(job_id_t);
+
+    // Forget a job that is done. Returns false if the job is still running
+    bool     Remove(job_id_t);
+
+private:
+    struct Instance {
+        job_id_t                 id;
+        Job                      job;
+        std::shared_ptr<Machine> machine;
+        STATUS                   status = STATUS::QUEUED;
+        bool                     started = false;
+        bool                     pause_requested = false;
+        std::atomic<bool>        stop_requested = false;
+        u64                      frames = 0;
+        u64                      start_cycles = 0;
+        std::string              errmsg;
+    };
+
+    static bool IsDone(STATUS status) { return status >= STATUS::FINISHED; }
+
+    void   WorkerThread();
+    STATUS RunQuantum(Instance&);
+    Result MakeResult(Instance const&) const;
+
+    std::shared_ptr<System> system;
+    int                     frames_per_quantum;
+
+    std::vector<std::thread> workers;
+    bool                     exit_workers = false;
+
+    std::mutex               jobs_mutex;
+    std::condition_variable  ready_cv;  // signaled when ready has work or the workers should exit
+    std::condition_variable  done_cv;   // signaled when a job finishes or pauses
+
+    std::deque<std::shared_ptr<Instance>>                  ready;
+    std::unordered_map<job_id_t, std::shared_ptr<Instance>> instances;
+    job_id_t                                               next_job_id = 1;
+};
+
+}
@@ -10,7 +10,14 @@
 #include <memory>
 #include <sstream>
 
+#include "compression.h"
+#include "trace.h"
+#include "worker_pool.h"
+
 #include "systems/nes/cartridge.h"
+#include "systems/nes/tile_cache.h"
+
+#include "windows/nes/project.h"
 
 using namespace std;
 
@@ -188,7 +195,8 @@ int Cartridge::GetNumMemoryRegions() const
 std::shared_ptr<MemoryRegion> Cartridge::GetMemoryRegionByIndex(int i)
 {
     if(i >= (program_rom_banks.size() + character_rom_banks.size())) return sram;
-    else if(i >= program_rom_banks.size()) return character_rom_banks.at(i - program_rom_banks.size());
+    EnsureBankLoaded(i);
+    if(i >= program_rom_banks.size()) return character_rom_banks.at(i - program_rom_banks.size());
     else return program_rom_banks.at(i);
 }
 
@@ -202,20 +210,20 @@ std::shared_ptr<MemoryRegion> Cartridge::GetMemoryRegion(GlobalMemoryLocation co
         } else {
             switch(header.mapper) {
             case 0: // easy
-                if(header.num_prg_rom_banks == 1) return program_rom_banks[0];
-                return program_rom_banks[(int)(where.address >= 0xC000)];
+                if(header.num_prg_rom_banks == 1) return GetProgramRomBank(0);
+                return GetProgramRomBank((int)(where.address >= 0xC000));
 
             case 1: 
                 if(header.num_prg_rom_banks <= 16 && where.address >= 0xC000) {
-                    return program_rom_banks[header.num_prg_rom_banks - 1];
+                    return GetProgramRomBank(header.num_prg_rom_banks - 1);
                 } else {
                     assert(where.prg_rom_bank < header.num_prg_rom_banks);
-                    return program_rom_banks[where.prg_rom_bank];
+                    return GetProgramRomBank(where.prg_rom_bank);
                 }
 
             case 2:
-                if(where.address < 0xC000) return program_rom_banks[where.prg_rom_bank];
-                else return program_rom_banks[header.num_prg_rom_banks - 1];
+                if(where.address < 0xC000) return GetProgramRomBank(where.prg_rom_bank);
+                else return GetProgramRomBank(header.num_prg_rom_banks - 1);
 
             default:
                 assert(false);
@@ -227,6 +235,8 @@ std::shared_ptr<MemoryRegion> Cartridge::GetMemoryRegion(GlobalMemoryLocation co
 
 bool Cartridge::Save(std::ostream& os, std::string& errmsg)
 {
+    TRACE_SCOPE("Cartridge::Save");
+
     os.write((char*)&header, sizeof(header));
     if(!os.good()) {
         errmsg = "Error writing cartridge header";
@@ -234,9 +244,140 @@ bool Cartridge::Save(std::ostream& os, std::string& errmsg)
     }
 
     if(header.has_sram && !sram->Save(os, errmsg)) return false;
-    for(auto& memory_region : program_rom_banks) if(!memory_region->Save(os, errmsg)) return false;
-    for(auto& memory_region : character_rom_banks) if(!memory_region->Save(os, errmsg)) return false;
 
+    // each bank is saved into its own chunk so that they can be loaded independently
+    struct ChunkInfo {
+        BANK_CHUNK_TYPE          type;
+        int                      bank;
+        shared_ptr<MemoryRegion> region;     // null when the previous chunk is written out as-is
+        u64                      generation;
+        shared_ptr<string>       data;
+        u32                      offset;
+        u32                      size;
+        u32                      flags;
+        string                   errmsg;
+        bool                     success = true;
+    };
+
+    int num_banks = program_rom_banks.size() + character_rom_banks.size();
+    vector<ChunkInfo> chunks(num_banks);
+
+    // decide which banks need to be serialized again. banks that were never loaded and banks that
+    // haven't been edited since they were loaded or last saved are copied over from their previous chunk
+    {
+        lock_guard<recursive_mutex> lock(deferred_banks_mutex);
+
+        // new projects and projects from older file versions have nothing to reuse
+        if(bank_chunks.size() != num_banks) bank_chunks.resize(num_banks, BankChunk { nullptr, 0, 0, 0, 0, nullptr, false });
+
+        // deferred chunks in an older format can't be copied and have to be loaded first
+        vector<int> bank_indexes;
+        for(int i = 0; i < num_banks; i++) {
+            if(bank_chunks[i].deferred && !reuse_chunks) bank_indexes.push_back(i);
+        }
+        if(bank_indexes.size()) LoadBanks(bank_indexes);
+
+        for(int i = 0; i < num_banks; i++) {
+            auto& bank_chunk = bank_chunks[i];
+            auto& chunk = chunks[i];
+
+            if(i < program_rom_banks.size()) {
+                chunk.type = BANK_CHUNK_PRG;
+                chunk.bank = i;
+            } else {
+                chunk.type = BANK_CHUNK_CHR;
+                chunk.bank = i - program_rom_banks.size();
+            }
+
+            if(!bank_chunk.deferred) {
+                if(chunk.type == BANK_CHUNK_PRG) chunk.region = program_rom_banks[chunk.bank];
+                else                             chunk.region = character_rom_banks[chunk.bank];
+
+                chunk.generation = chunk.region->GetEditGeneration();
+                if(bank_chunk.data && chunk.generation == bank_chunk.saved_generation) chunk.region = nullptr;
+            }
+
+            if(!chunk.region) {
+                assert(bank_chunk.data);
+                chunk.data   = bank_chunk.data;
+                chunk.offset = bank_chunk.offset;
+                chunk.size   = bank_chunk.size;
+                chunk.flags  = bank_chunk.flags;
+            }
+        }
+    }
+
+    // banks don't share any state while saving, so the changed ones can be encoded (and compressed) in parallel
+    ParallelFor(num_banks, [&chunks](int i) {
+        auto& chunk = chunks[i];
+        if(!chunk.region) return;
+
+        TRACE_SCOPE("Cartridge::Save bank");
+
+        stringstream ss;
+        chunk.success = chunk.region->Save(ss, chunk.errmsg);
+        string raw = ss.str();
+
+        // long runs of undefined bytes and repeated object records compress well, but keep 
+        // the chunk uncompressed if it doesn't get any smaller
+        string compressed;
+        if(CompressBlock((u8 const*)raw.data(), raw.size(), compressed)) {
+            stringstream cs;
+            WriteVarInt(cs, (u32)raw.size());
+            cs.write(compressed.data(), compressed.size());
+            chunk.data  = make_shared<string>(cs.str());
+            chunk.flags = BANK_CHUNK_FLAG_COMPRESSED;
+        } else {
+            chunk.data  = make_shared<string>(move(raw));
+            chunk.flags = 0;
+        }
+
+        chunk.offset = 0;
+        chunk.size   = chunk.data->size();
+    });
+
+    int num_reused = 0;
+    for(auto& chunk : chunks) {
+        if(!chunk.success) {
+            errmsg = chunk.errmsg;
+            return false;
+        }
+        if(!chunk.region) num_reused++;
+    }
+
+    // write the table of contents. offsets are relative to the end of the table
+    WriteVarInt(os, (int)chunks.size());
+
+    u32 offset = 0;
+    for(auto& chunk : chunks) {
+        WriteVarInt(os, (int)chunk.type);
+        WriteVarInt(os, chunk.bank);
+        WriteVarInt(os, chunk.flags);
+        WriteVarInt(os, offset);
+        WriteVarInt(os, chunk.size);
+        offset += chunk.size;
+    }
+
+    // and then the chunk data
+    for(auto& chunk : chunks) os.write(chunk.data->data() + chunk.offset, chunk.size);
+
+    if(!os.good()) {
+        errmsg = "Error writing cartridge banks";
+        return false;
+    }
+
+    // the chunks just written become the baseline for the next save. a bank edited while it was being 
+    // written is already past the generation its chunk was made at
+    {
+        lock_guard<recursive_mutex> lock(deferred_banks_mutex);
+        for(int i = 0; i < num_banks; i++) {
+            auto& chunk = chunks[i];
+            if(chunk.region) bank_chunks[i] = BankChunk { chunk.data, 0, chunk.size, chunk.flags, chunk.generation, nullptr, false };
+        }
+        reuse_chunks = true;
+    }
+
+    cout << "[Cartridge::Save] wrote " << (num_banks - num_reused) << " changed bank(s), reused " << num_reused << endl;
     return true;
 }
 
@@ -253,6 +394,8 @@ bool Cartridge::Load(std::istream& is, std::string& errmsg, shared_ptr<System>&
         if(!sram->Load(is, errmsg)) return false;
     }
 
+    if(GetCurrentProject()->GetSaveFileVersion() >= FILE_VERSION_CHUNKED) return LoadChunks(is, errmsg, system);
+
     for(u32 i = 0; i < header.num_prg_rom_banks; i++) {
         auto memory_region = ProgramRomBank::Load(is, errmsg, system);
         if(!memory_region) return false;
@@ -268,34 +411,298 @@ bool Cartridge::Load(std::istream& is, std::string& errmsg, shared_ptr<System>&
     return true;
 }
 
+bool Cartridge::LoadChunks(std::istream& is, std::string& errmsg, shared_ptr<System>& system)
+{
+    TRACE_SCOPE("Cartridge::LoadChunks");
+
+    struct TocEntry {
+        BANK_CHUNK_TYPE type;
+        int             bank;
+        u32             flags;
+        u32             offset;
+        u32             size;
+    };
+
+    // read the table of contents
+    int num_chunks = ReadVarInt<int>(is);
+    if(!is.good() || num_chunks < 0) {
+        errmsg = "Error reading cartridge chunk table";
+        return false;
+    }
+
+    // the header decides how many banks there are, and every one of them needs exactly one chunk
+    int num_prg_banks = header.num_prg_rom_banks;
+    int num_chr_banks = header.num_chr_rom_banks;
+    if(num_chunks != num_prg_banks + num_chr_banks) {
+        errmsg = "Cartridge chunk table doesn't match the number of banks";
+        return false;
+    }
+
+    vector<TocEntry> toc;
+    vector<bool> seen(num_chunks, false);
+    u32 total_size = 0;
+
+    for(int i = 0; i < num_chunks; i++) {
+        TocEntry entry;
+        entry.type   = (BANK_CHUNK_TYPE)ReadVarInt<int>(is);
+        entry.bank   = ReadVarInt<int>(is);
+        entry.flags  = ReadVarInt<u32>(is);
+        entry.offset = ReadVarInt<u32>(is);
+        entry.size   = ReadVarInt<u32>(is);
+        if(!is.good()) {
+            errmsg = "Error reading cartridge chunk table";
+            return false;
+        }
+
+        int bank_index;
+        switch(entry.type) {
+        case BANK_CHUNK_PRG:
+            bank_index = (entry.bank >= 0 && entry.bank < num_prg_banks) ? entry.bank : -1;
+            break;
+        case BANK_CHUNK_CHR:
+            bank_index = (entry.bank >= 0 && entry.bank < num_chr_banks) ? (num_prg_banks + entry.bank) : -1;
+            break;
+        default:
+            errmsg = "Invalid cartridge chunk type";
+            return false;
+        }
+
+        if(bank_index < 0 || seen[bank_index]) {
+            errmsg = "Invalid cartridge chunk bank";
+            return false;
+        }
+        seen[bank_index] = true;
+
+        if((u64)entry.offset + entry.size > 0xFFFFFFFFULL) {
+            errmsg = "Invalid cartridge chunk offset";
+            return false;
+        }
+
+        total_size = max(total_size, entry.offset + entry.size);
+        toc.push_back(entry);
+    }
+
+    // pull the chunk data in with as few reads as possible. it's read a piece at a time so that a table
+    // claiming more data than the file has fails at the end of the file instead of allocating it all
+    auto chunk_data = make_shared<string>();
+    while(chunk_data->size() < total_size) {
+        size_t start = chunk_data->size();
+        size_t piece = min((size_t)(total_size - start), (size_t)CARTRIDGE_CHUNK_READ_SIZE);
+        chunk_data->resize(start + piece);
+        is.read(chunk_data->data() + start, piece);
+        if(!is.good()) {
+            errmsg = "Error reading cartridge chunk data";
+            return false;
+        }
+    }
+
+    // the bank slots are left empty until the bank is first accessed
+    program_rom_banks.resize(num_prg_banks);
+    character_rom_banks.resize(num_chr_banks);
+    bank_chunks.resize(num_prg_banks + num_chr_banks, BankChunk { nullptr, 0, 0, 0, 0, nullptr, false });
+
+    for(auto& entry : toc) {
+        int bank_index = (entry.type == BANK_CHUNK_PRG) ? entry.bank : (num_prg_banks + entry.bank);
+        bank_chunks[bank_index] = BankChunk { chunk_data, entry.offset, entry.size, entry.flags, 0, nullptr, true };
+    }
+
+    // every chunk is decoded now so that a bad one fails the load. parsing a bank only reads from the
+    // label, define and enum tables, which were loaded before the cartridge
+    vector<string> errmsgs(bank_chunks.size());
+    ParallelFor(bank_chunks.size(), [this, &errmsgs, &system, num_prg_banks](int i) {
+        DecodeChunk(bank_chunks[i], i < num_prg_banks, errmsgs[i], system);
+    });
+
+    for(int i = 0; i < bank_chunks.size(); i++) {
+        if(!bank_chunks[i].decoded) {
+            errmsg = errmsgs[i];
+            return false;
+        }
+    }
+
+    // chunks can only be written back out unchanged if they're in a format the current version still
+    // writes. compressed chunks only added a flag, which is kept with the chunk
+    reuse_chunks = (GetCurrentProject()->GetSaveFileVersion() >= FILE_VERSION_CHUNKED);
+
+    deferred_banks = (int)bank_chunks.size();
+
+    cout << "[Cartridge::LoadChunks] deferred loading of " << num_prg_banks << " PRG and " << num_chr_banks << " CHR banks" << endl;
+    return true;
+}
+
+// called from worker threads. sets chunk.decoded on success
+bool Cartridge::DecodeChunk(BankChunk& chunk, bool is_prg, std::string& errmsg, shared_ptr<System>& system)
+{
+    TRACE_SCOPE("Cartridge::DecodeChunk");
+
+    u8 const* data = (u8 const*)chunk.data->data() + chunk.offset;
+    u32 size = chunk.size;
+
+    vector<u8> decompressed;
+    if(chunk.flags & BANK_CHUNK_FLAG_COMPRESSED) {
+        MemoryInputStream hs(data, size);
+        u32 raw_size = ReadVarInt<u32>(hs);
+        if(!hs.good() || raw_size > MaxDecompressedSize(size)) {
+            errmsg = "Invalid bank chunk size";
+            return false;
+        }
+        u32 header_size = (u32)hs.tellg();
+
+        decompressed.resize(raw_size);
+        if(!DecompressBlock(data + header_size, size - header_size, decompressed.data(), raw_size)) {
+            errmsg = "Error decompressing bank chunk";
+            return false;
+        }
+
+        data = decompressed.data();
+        size = raw_size;
+    }
+
+    MemoryInputStream is(data, size);
+
+    if(is_prg) chunk.decoded = ProgramRomBank::Load(is, errmsg, system);
+    else       chunk.decoded = CharacterRomBank::Load(is, errmsg, system);
+    return (bool)chunk.decoded;
+}
+
+void Cartridge::LoadDeferredBank(int bank_index)
+{
+    lock_guard<recursive_mutex> lock(deferred_banks_mutex);
+    if(bank_chunks[bank_index].deferred) LoadBanks({ bank_index });
+}
+
+void Cartridge::LoadNextDeferredBanks(int count)
+{
+    // if another thread is busy with the banks (i.e., saving), try again later
+    unique_lock<recursive_mutex> lock(deferred_banks_mutex, try_to_lock);
+    if(!lock.owns_lock()) return;
+
+    vector<int> bank_indexes;
+    for(int i = 0; i < bank_chunks.size() && bank_indexes.size() < count; i++) {
+        if(bank_chunks[i].deferred) bank_indexes.push_back(i);
+    }
+
+    if(bank_indexes.size()) LoadBanks(bank_indexes);
+}
+
+void Cartridge::LoadAllDeferredBanks()
+{
+    lock_guard<recursive_mutex> lock(deferred_banks_mutex);
+
+    vector<int> bank_indexes;
+    for(int i = 0; i < bank_chunks.size(); i++) {
+        if(bank_chunks[i].deferred) bank_indexes.push_back(i);
+    }
+
+    if(bank_indexes.size()) LoadBanks(bank_indexes);
+}
+
+// deferred_banks_mutex must be held by the caller
+void Cartridge::LoadBanks(vector<int> const& bank_indexes)
+{
+    TRACE_SCOPE("Cartridge::LoadBanks");
+
+    // every bank is put in place before any references are noted, since noting references looks up
+    // labels in other banks, including the ones loaded in this batch
+    for(auto bank_index : bank_indexes) {
+        auto& chunk = bank_chunks[bank_index];
+        assert(chunk.deferred && chunk.decoded);
+
+        if(bank_index < program_rom_banks.size()) {
+            program_rom_banks[bank_index] = dynamic_pointer_cast<ProgramRomBank>(chunk.decoded);
+        } else {
+            character_rom_banks[bank_index - program_rom_banks.size()] = dynamic_pointer_cast<CharacterRomBank>(chunk.decoded);
+        }
+        chunk.deferred = false;
+    }
+
+    // references are noted here instead of in System::Load, since every label was already loaded
+    {
+        TRACE_SCOPE("Cartridge::LoadBanks NoteReferences");
+        signal_defer_scope defer_signals;
+        for(auto bank_index : bank_indexes) {
+            if(bank_index < program_rom_banks.size()) program_rom_banks[bank_index]->NoteReferences();
+        }
+    }
+
+    // a freshly loaded bank is unchanged from its chunk. the file data is released along with 
+    // the last chunk that refers to it
+    for(auto bank_index : bank_indexes) {
+        auto& chunk = bank_chunks[bank_index];
+        if(reuse_chunks) chunk.saved_generation = chunk.decoded->GetEditGeneration();
+        else             chunk.data = nullptr;
+        chunk.decoded = nullptr;
+    }
+
+    deferred_banks.fetch_sub((int)bank_indexes.size(), memory_order_acq_rel);
+}
+
 void Cartridge::NoteReferences()
 {
+    // deferred banks note their own references when they're loaded
     for(auto& prg_rom : program_rom_banks) {
-        prg_rom->NoteReferences();
+        if(prg_rom) prg_rom->NoteReferences();
     }
 }
 
 // relative_address is 0-0x3FFF
 u8 Cartridge::ReadProgramRomRelative(int bank, u16 relative_address)
 {
-    auto memory_region = program_rom_banks[bank];
+    auto memory_region = GetProgramRomBank(bank);
     return memory_region->ReadByte(relative_address + memory_region->GetBaseAddress());
 }
 
 u8 Cartridge::ReadCharacterRomRelative(int bank, u16 relative_address)
 {
-    auto memory_region = character_rom_banks[bank];
+    auto memory_region = GetCharacterRomBank(bank);
     return memory_region->ReadByte(relative_address + memory_region->GetBaseAddress());
 }
 
+void Cartridge::CopyProgramRomRelative(int bank, u8* dest, u16 relative_address, u16 size)
+{
+    auto memory_region = GetProgramRomBank(bank);
+    memory_region->Copy(dest, relative_address + memory_region->GetBaseAddress(), size);
+}
+
 void Cartridge::CopyCharacterRomRelative(int bank, u8* dest, u16 relative_address, u16 size)
 {
-    auto memory_region = character_rom_banks[bank];
+    auto memory_region = GetCharacterRomBank(bank);
     memory_region->Copy(dest, relative_address + memory_region->GetBaseAddress(), size);
 }
 
+// null if the bank doesn't exist or doesn't have size bytes at relative_address
+u8 const* Cartridge::GetCharacterRomRelativePointer(int bank, u16 relative_address, u16 size)
+{
+    if(bank < 0 || bank >= (int)character_rom_banks.size()) return nullptr;
+
+    auto memory_region = GetCharacterRomBank(bank);
+    if(relative_address + size > memory_region->GetRegionSize()) return nullptr;
+    return memory_region->GetDataPointer(relative_address + memory_region->GetBaseAddress());
+}
+
+TileCache const& Cartridge::GetCharacterRomTiles(int bank)
+{
+    if(character_rom_tiles.size() < character_rom_banks.size()) character_rom_tiles.resize(character_rom_banks.size());
+
+    auto& tiles = character_rom_tiles[bank];
+    if(!tiles) {
+        // banks are 4K or 8K, but the Memory view always shows 8K per bank
+        u8 patterns[0x2000] = { 0 };
+        u32 size = min(GetCharacterRomBank(bank)->GetRegionSize(), (u32)sizeof(patterns));
+        CopyCharacterRomRelative(bank, patterns, 0, (u16)size);
+
+        tiles = make_unique<TileCache>(sizeof(patterns) / TILE_PATTERN_BYTES);
+        tiles->Update(patterns, 0);
+    }
+
+    return *tiles;
+}
+
 shared_ptr<MemoryView> Cartridge::CreateMemoryView()
 {
+    // views are used from the emulation thread and batch workers, which can't load banks themselves
+    LoadAllDeferredBanks();
+
     return make_shared<CartridgeView>(shared_from_this());
 }
 
@@ -321,12 +728,26 @@ CartridgeView::CartridgeView(std::shared_ptr<Cartridge> const& _cartridge)
         mmc2.prg_rom_bank = 0;
         break;
     }
+
+    if(cartridge->header.has_sram) sram = make_shared<cartridge_ram_t>();
+    if(cartridge->header.num_chr_rom_banks == 0) chr_ram = make_shared<cartridge_ram_t>();
 }
 
 CartridgeView::~CartridgeView()
 {
 }
 
+u8* CartridgeView::Unshare(shared_ptr<cartridge_ram_t>& ram)
+{
+    if(ram.use_count() > 1) {
+        ram = make_shared<cartridge_ram_t>(*ram);
+    } else {
+        // pairs with the release when the last other owner let go, so its reads are done before we write
+        atomic_thread_fence(memory_order_acquire);
+    }
+    return ram->data();
+}
+
 MIRRORING CartridgeView::GetNametableMirroring()
 {
     switch(cartridge->header.mapper) {
@@ -401,7 +822,7 @@ int CartridgeView::GetRomBank(u16 address)
 u8 CartridgeView::Read(u16 address)
 {
     if(address < 0x8000) {
-        if(cartridge->header.has_sram) return sram[(address - 0x6000) & 0x1FFF];
+        if(cartridge->header.has_sram) return (*sram)[(address - 0x6000) & 0x1FFF];
         return 0;
     } 
 
@@ -411,7 +832,7 @@ u8 CartridgeView::Read(u16 address)
 void CartridgeView::Write(u16 address, u8 value)
 {
     if(address < 0x8000) {
-        if(cartridge->header.has_sram) sram[(address - 0x6000) & 0x1FFF] = value;
+        if(cartridge->header.has_sram) Unshare(sram)[(address - 0x6000) & 0x1FFF] = value;
     } else {
         switch(cartridge->header.mapper) {
         case 0: // No mapper
@@ -423,11 +844,13 @@ void CartridgeView::Write(u16 address, u8 value)
             // TODO MMC1 also ignores consecutive-cycle writes, which will be a royal PITA to implement. Somehow we have to know that a 
             // read anywhere or write somewhere else occurred...
             if(value & 0x80) {
+                if(mmc1.prg_rom_bank_mode != 3) prg_generation++;
                 mmc1.shift_register_count = 0;
                 mmc1.prg_rom_bank_mode    = 3;
             } else {
                 mmc1.shift_register = ((mmc1.shift_register >> 1) | ((value & 1) << 4)) & 0x1F;
                 if(++mmc1.shift_register_count == 5) {
+                    auto const last = mmc1;
                     mmc1.shift_register_count = 0;
 
                     switch((address & 0xE000)) {
@@ -468,6 +891,19 @@ void CartridgeView::Write(u16 address, u8 value)
                         mmc1.prg_rom_bank = (mmc1.prg_rom_bank & 0x10) | (mmc1.shift_register & 0x0F);
                         break;
                     }
+
+                    // most writes only switch PRG banks, and the PPU side doesn't need to hear about those
+                    if(mmc1.chr_rom_bank != last.chr_rom_bank || mmc1.chr_rom_bank_high != last.chr_rom_bank_high
+                       || mmc1.chr_rom_bank_mode != last.chr_rom_bank_mode) {
+                        chr_generation++;
+                        mapping_generation++;
+                    } else if(mmc1.mirroring != last.mirroring) {
+                        mapping_generation++;
+                    }
+
+                    if(mmc1.prg_rom_bank != last.prg_rom_bank || mmc1.prg_rom_bank_mode != last.prg_rom_bank_mode) {
+                        prg_generation++;
+                    }
                 }
             }
             break;
@@ -476,10 +912,9 @@ void CartridgeView::Write(u16 address, u8 value)
             // https://www.nesdev.org/wiki/UxROM
             // technically only the bottom 3 or 4 bits are used to set the rom bank but we can use the whole
             // value to be compatible with multiple versions of the chip?
+            if(value >= cartridge->header.num_prg_rom_banks) value = cartridge->header.num_prg_rom_banks - 1;
+            if(mmc2.prg_rom_bank != value) prg_generation++;
             mmc2.prg_rom_bank = value;
-            if(mmc2.prg_rom_bank >= cartridge->header.num_prg_rom_banks) {
-                mmc2.prg_rom_bank = cartridge->header.num_prg_rom_banks - 1;
-            }
             break;
 
         default:
@@ -494,7 +929,7 @@ void CartridgeView::Write(u16 address, u8 value)
 u8 CartridgeView::ReadPPU(u16 address)
 {
     // no CHR ROM? check if we have CHR-RAM
-    if(cartridge->header.num_chr_rom_banks == 0) return chr_ram[address & 0x1FFF];
+    if(cartridge->header.num_chr_rom_banks == 0) return (*chr_ram)[address & 0x1FFF];
     
     // check CHR-ROM banking
     int chr_bank = SelectCHRRomBankForAddress(address);
@@ -503,7 +938,25 @@ u8 CartridgeView::ReadPPU(u16 address)
 
 void CartridgeView::WritePPU(u16 address, u8 value)
 {
-    if(cartridge->header.num_chr_rom_banks == 0) chr_ram[address & 0x1FFF] = value;
+    if(cartridge->header.num_chr_rom_banks == 0) {
+        // the first write after a fork moves CHR-RAM
+        u8 const* last_data = chr_ram->data();
+        Unshare(chr_ram)[address & 0x1FFF] = value;
+        if(chr_ram->data() != last_data) mapping_generation++;
+        chr_generation++;
+    }
+}
+
+u8 const* CartridgeView::GetCHRPage(int page)
+{
+    assert(page >= 0 && page < 8);
+    u16 address = page << 10;
+
+    if(cartridge->header.num_chr_rom_banks == 0) return &(*chr_ram)[address];
+
+    // banks are loaded as needed, but once loaded CHR-ROM never moves
+    int chr_bank = SelectCHRRomBankForAddress(address);
+    return cartridge->GetCharacterRomRelativePointer(chr_bank, address, 0x400);
 }
 
 int CartridgeView::SelectCHRRomBankForAddress(u16& address)
@@ -550,7 +1003,7 @@ void CartridgeView::CopyPatterns(u8* dest, u16 source, u16 size)
     assert(source == 0 || source == 0x1000);
 
     if(cartridge->header.num_chr_rom_banks == 0) {
-        memcpy(dest, &chr_ram[source], size);
+        memcpy(dest, &(*chr_ram)[source], size);
         return;
     }
 
@@ -558,6 +1011,18 @@ void CartridgeView::CopyPatterns(u8* dest, u16 source, u16 size)
     cartridge->CopyCharacterRomRelative(chr_bank, dest, source, size);
 }
 
+void CartridgeView::CopyCPUMemory(u8* dest)
+{
+    // same as Read() for $6000-$7FFF
+    if(cartridge->header.has_sram) memcpy(dest, sram->data(), 0x2000);
+    else                           memset(dest, 0, 0x2000);
+
+    // PRG-ROM is mapped in 16KiB banks
+    for(u32 address = 0x8000; address < 0x10000; address += 0x4000) {
+        cartridge->CopyProgramRomRelative(GetRomBank((u16)address), &dest[address - 0x6000], 0, 0x4000);
+    }
+}
+
 bool CartridgeView::Save(ostream& os, string& errmsg) const
 {
     WriteVarInt(os, 0); // reserved
@@ -566,10 +1031,16 @@ bool CartridgeView::Save(ostream& os, string& errmsg) const
     os.write((char*)&mmc1, sizeof(mmc1));
 
     if(cartridge->header.has_sram) {
-        os.write((char*)sram, sizeof(sram));
+        os.write((char*)sram->data(), sram->size());
     }
 
-    os.write((char*)chr_ram, sizeof(chr_ram));
+    // CHR-RAM is always in the save state, even for carts with CHR-ROM
+    if(chr_ram) {
+        os.write((char*)chr_ram->data(), chr_ram->size());
+    } else {
+        cartridge_ram_t empty = {};
+        os.write((char*)empty.data(), empty.size());
+    }
 
     errmsg = "Error saving CartridgeView";
     return os.good();
@@ -582,15 +1053,40 @@ bool CartridgeView::Load(istream& is, string& errmsg)
 
     is.read((char*)&mmc1, sizeof(mmc1));
 
+    // loading replaces the contents, so a block shared with a fork has to be replaced too
     if(cartridge->header.has_sram) {
-        is.read((char*)sram, sizeof(sram));
+        sram = make_shared<cartridge_ram_t>();
+        is.read((char*)sram->data(), sram->size());
+    }
+
+    if(chr_ram) {
+        chr_ram = make_shared<cartridge_ram_t>();
+        is.read((char*)chr_ram->data(), chr_ram->size());
+    } else {
+        is.ignore(sizeof(cartridge_ram_t));
     }
 
-    is.read((char*)chr_ram, sizeof(chr_ram));
+    chr_generation++;
+    mapping_generation++;
+    prg_generation++;
 
     errmsg = "Error loading CartridgeView";
     return is.good();
 }
 
+void CartridgeView::CopyState(MemoryView const& _other)
+{
+    auto& other = dynamic_cast<CartridgeView const&>(_other);
+
+    mmc1 = other.mmc1;
+
+    // share the RAM blocks rather than copying them. whichever view writes first gets its own copy
+    sram = other.sram;
+    chr_ram = other.chr_ram;
+    chr_generation++;
+    mapping_generation++;
+    prg_generation++;
+}
+
 
 }
@@ -5,15 +5,24 @@
 // LICENSE file in the root directory of this source tree. 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "systems/nes/memory.h"
 #include "systems/nes/system.h"
 
+// bank chunk data is read from project files this much at a time
+#define CARTRIDGE_CHUNK_READ_SIZE (1 << 20)
+
 namespace Systems::NES {
 
 class CartridgeView;
 class System;
+class TileCache;
 
 class Cartridge : public std::enable_shared_from_this<Cartridge> {
 public:
@@ -38,8 +47,8 @@ public:
 
     bool                               CanBank(GlobalMemoryLocation const&);
     std::shared_ptr<RAMRegion> const&  GetSRAM() { return sram; }
-    std::shared_ptr<ProgramRomBank>&   GetProgramRomBank(u8 bank) { return program_rom_banks[bank]; }
-    std::shared_ptr<CharacterRomBank>& GetCharacterRomBank(u8 bank) { return character_rom_banks[bank]; }
+    std::shared_ptr<ProgramRomBank>&   GetProgramRomBank(u8 bank) { EnsureBankLoaded(bank); return program_rom_banks[bank]; }
+    std::shared_ptr<CharacterRomBank>& GetCharacterRomBank(u8 bank) { EnsureBankLoaded(program_rom_banks.size() + bank); return character_rom_banks[bank]; }
     int                                GetNumMemoryRegions() const;
     int                                GetNumCharacterRomBanks() const { return character_rom_banks.size(); }
     std::shared_ptr<MemoryRegion>      GetMemoryRegion(GlobalMemoryLocation const&);
@@ -51,20 +60,77 @@ public:
 
     void NoteReferences();
 
+    // Banks from chunked project files are decoded in parallel when the project loads, so a bad chunk
+    // fails the load, but they aren't put in place until they're first accessed. The remaining banks
+    // can be loaded a few at a time with LoadNextDeferredBanks(). Putting a bank in place can't fail.
+    //
+    // Loading a bank notes references and creates labels, so it only happens on the load or UI
+    // thread. Anything that reaches the banks from another thread loads them all first: memory views
+    // (for the emulation thread and batch workers) in CreateMemoryView(), and the disassembly thread
+    // in System::InitDisassembly()
+    bool HasDeferredBanks() const { return deferred_banks.load(std::memory_order_acquire) != 0; }
+    void LoadNextDeferredBanks(int);
+    void LoadAllDeferredBanks();
+
     u8 ReadProgramRomRelative(int, u16);
     u8 ReadCharacterRomRelative(int, u16);
+    void CopyProgramRomRelative(int, u8*, u16, u16);
     void CopyCharacterRomRelative(int, u8*, u16, u16);
+    u8 const* GetCharacterRomRelativePointer(int, u16, u16);
+
+    // Decoded tiles of a CHR-ROM bank, made the first time they're asked for. CHR-ROM never changes so
+    // they're kept for good. Only call from the main thread
+    TileCache const& GetCharacterRomTiles(int);
 
     bool Save(std::ostream&, std::string&);
     bool Load(std::istream&, std::string&, std::shared_ptr<System>&);
 private:
+    enum BANK_CHUNK_TYPE {
+        BANK_CHUNK_PRG,
+        BANK_CHUNK_CHR
+    };
+
+    enum BANK_CHUNK_FLAGS {
+        BANK_CHUNK_FLAG_COMPRESSED = 1 << 0  // chunk is the uncompressed size followed by a CompressBlock() block
+    };
+
+    // a bank's serialized data as it was last loaded or saved
+    struct BankChunk {
+        std::shared_ptr<std::string> data;             // buffer holding the chunk, or null if the bank must be serialized again
+        u32                          offset;
+        u32                          size;
+        u32                          flags;            // BANK_CHUNK_FLAGS
+        u64                          saved_generation; // the bank's edit generation when the chunk was made
+        std::shared_ptr<MemoryRegion> decoded;         // the bank decoded from the chunk, until it's loaded
+        bool                         deferred;         // bank hasn't been loaded from the chunk yet
+    };
+
     void CreateMemoryRegions();
 
+    bool LoadChunks(std::istream&, std::string&, std::shared_ptr<System>&);
+    bool DecodeChunk(BankChunk&, bool, std::string&, std::shared_ptr<System>&);
+    void LoadDeferredBank(int);
+    void LoadBanks(std::vector<int> const&);
+
+    // bank index is PRG banks first followed by CHR banks. Only called on the load or UI thread (see above)
+    inline void EnsureBankLoaded(int bank_index) {
+        if(deferred_banks.load(std::memory_order_acquire) == 0) return;
+        LoadDeferredBank(bank_index);
+    }
+
     std::weak_ptr<System> parent_system;
 
     std::shared_ptr<RAMRegion>                     sram;
     std::vector<std::shared_ptr<ProgramRomBank>>   program_rom_banks;
     std::vector<std::shared_ptr<CharacterRomBank>> character_rom_banks;
+    std::vector<std::unique_ptr<TileCache>>        character_rom_tiles;
+
+    // the chunks from the project file are kept in memory so that unchanged banks don't need to be 
+    // serialized again when saving
+    std::vector<BankChunk> bank_chunks;
+    bool                   reuse_chunks   = false;
+    std::atomic<int>       deferred_banks = 0;
+    std::recursive_mutex   deferred_banks_mutex;
 };
 
 class CartridgeView : public MemoryView {
@@ -85,16 +151,46 @@ public:
 
     void CopyPatterns(u8*, u16, u16);
 
+    // $6000-$FFFF as Peek() sees it (0xA000 bytes), a bank at a time
+    void CopyCPUMemory(u8*);
+
+    // the CHR-ROM/RAM behind a 1KiB page of $0000-$1FFF, or null when the page can't be read directly
+    u8 const* GetCHRPage(int);
+
+    // CHR-RAM is always the full 8KiB at $0000-$1FFF
+    bool HasCHRRAM() const { return (bool)chr_ram; }
+
+    // incremented whenever GetCHRPage or GetNametableMirroring may return something different
+    u32  GetMappingGeneration() const { return mapping_generation; }
+
+    // incremented whenever what CopyPatterns() returns may have changed (CHR-RAM writes and mapper
+    // register writes that switch CHR banks)
+    u32  GetCHRGeneration() const { return chr_generation; }
+
+    // incremented whenever GetRomBank may return something different
+    u32  GetPRGGeneration() const { return prg_generation; }
+
     // save/load
     bool Save(std::ostream&, std::string&) const override;
     bool Load(std::istream&, std::string&) override;
 
+    void CopyState(MemoryView const&) override;
+
     friend class Cartridge;
 
 private:
+    // 8KiB of SRAM or CHR-RAM. Forked views share the same block until one of them writes to it,
+    // and carts that have neither don't allocate anything. ROM is always read through the Cartridge
+    typedef std::array<u8, 0x2000> cartridge_ram_t;
+    static u8* Unshare(std::shared_ptr<cartridge_ram_t>&);
+
     int SelectCHRRomBankForAddress(u16&);
     std::shared_ptr<Cartridge> cartridge;
 
+    u32 chr_generation = 0;
+    u32 mapping_generation = 0;
+    u32 prg_generation = 0;
+
     u8 reset_vector_bank;
 
     union {
@@ -115,8 +211,8 @@ private:
         } mmc2;
     };
 
-    u8  sram[0x2000];
-    u8  chr_ram[0x2000];
+    std::shared_ptr<cartridge_ram_t> sram;
+    std::shared_ptr<cartridge_ram_t> chr_ram;
 };
 
 } // namespace Systems::NES
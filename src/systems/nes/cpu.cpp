@@ -432,4 +432,12 @@ bool CPU::Load(istream& is, string& errmsg)
     return is.good();
 }
 
+void CPU::CopyState(CPU const& other)
+{
+    // ops and ops_base point into the static microcode tables, so they're valid for any CPU
+    regs = other.regs;
+    state = other.state;
+    cycle_count = other.cycle_count;
+}
+
 }
@@ -57,6 +57,9 @@ public:
     bool Save(std::ostream&, std::string&) const;
     bool Load(std::istream&, std::string&);
 
+    // copy registers and execution state, but not the bus connections
+    void CopyState(CPU const&);
+
 private:
     struct {
         // Do not re-order this structure without fixing Save/Load
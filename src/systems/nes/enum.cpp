@@ -9,6 +9,7 @@
 
 #include "systems/nes/enum.h"
 #include "systems/nes/expressions.h"
+#include "systems/nes/system.h"
 
 #include "windows/nes/project.h"
 
@@ -63,7 +64,7 @@ vector<shared_ptr<EnumElement>> const& Enum::GetElementsByValue(s64 value)
 shared_ptr<EnumElement> const& Enum::GetElement(string const& name)
 {
     static shared_ptr<EnumElement> null_element;
-    if(elements.contains(name)) return elements[name];
+    if(auto it = elements.find(name); it != elements.end()) return it->second;
     return null_element;
 }
 
@@ -104,10 +105,16 @@ bool Enum::ChangeElementExpression(shared_ptr<EnumElement> const& ee, shared_ptr
 
 bool Enum::ChangeElementName(shared_ptr<EnumElement> const& ee, string const& name, string& errmsg)
 {
+    // banks refer to elements by name, so deferred banks need to be loaded before the name changes
+    auto system = GetSystem();
+    System::memory_region_set_t referencing_banks;
+    if(system) system->GetReferencingBanks(ee, referencing_banks);
+
     // update name and emit
     string old_name = ee->name;
     ee->name = name;
     element_changed->emit(ee, old_name, ee->cached_value);
+    if(system) system->InvalidateBankChunks(referencing_banks);
     return true;
 }
 
@@ -115,6 +122,10 @@ bool Enum::ChangeElementName(shared_ptr<EnumElement> const& ee, string const& na
 void Enum::DeleteElement(shared_ptr<EnumElement> const& ee)
 {
     if(!elements.contains(ee->name)) return;
+
+    auto system = GetSystem();
+    System::memory_region_set_t referencing_banks;
+    if(system) system->GetReferencingBanks(ee, referencing_banks);
     assert(value_map.contains(ee->cached_value));
 
     auto& list = value_map[ee->cached_value];
@@ -125,6 +136,7 @@ void Enum::DeleteElement(shared_ptr<EnumElement> const& ee)
     elements.erase(ee->name);
 
     element_deleted->emit(ee);
+    if(system) system->InvalidateBankChunks(referencing_banks);
 }
 
 void Enum::DeleteElements()
@@ -0,0 +1,241 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <iostream>
+
+#include "signals.h"
+#include "util.h"
+
+#include "systems/nes/journal.h"
+#include "systems/nes/label.h"
+#include "systems/nes/system.h"
+
+using namespace std;
+
+// oldest transactions are dropped after this many
+#define MAX_UNDO_TRANSACTIONS 1000
+
+namespace Systems::NES {
+
+Journal::Journal(System* _system)
+    : system(_system)
+{
+}
+
+Journal::~Journal()
+{
+}
+
+void Journal::BeginTransaction(string const& name)
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    auto& open = open_transactions[this_thread::get_id()];
+    if(open.depth++ == 0) open.transaction.name = name;
+}
+
+void Journal::EndTransaction()
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    auto it = open_transactions.find(this_thread::get_id());
+    assert(it != open_transactions.end() && it->second.depth > 0);
+    if(--it->second.depth != 0) return;
+
+    if(it->second.transaction.records.size()) PushTransaction(move(it->second.transaction));
+    open_transactions.erase(it);
+}
+
+bool Journal::CanUndo() const
+{
+    lock_guard<recursive_mutex> lock(mutex);
+    return open_transactions.empty() && undo_stack.size() > 0;
+}
+
+bool Journal::CanRedo() const
+{
+    lock_guard<recursive_mutex> lock(mutex);
+    return open_transactions.empty() && redo_stack.size() > 0;
+}
+
+string Journal::GetUndoName() const
+{
+    lock_guard<recursive_mutex> lock(mutex);
+    return undo_stack.size() ? undo_stack.back().name : string();
+}
+
+string Journal::GetRedoName() const
+{
+    lock_guard<recursive_mutex> lock(mutex);
+    return redo_stack.size() ? redo_stack.back().name : string();
+}
+
+bool Journal::Undo()
+{
+    // the disassembly thread records into the journal as it goes
+    lock_guard<recursive_mutex> lock(mutex);
+    if(!CanUndo() || system->IsDisassembling()) return false;
+
+    auto transaction = move(undo_stack.back());
+    undo_stack.pop_back();
+
+    replaying_thread.store(this_thread::get_id(), memory_order_release);
+    {
+        signal_defer_scope defer;
+        for(auto it = transaction.records.rbegin(); it != transaction.records.rend(); ++it) Apply(*it, true);
+    }
+    replaying_thread.store(thread::id(), memory_order_release);
+
+    cout << "[Journal::Undo] undid \"" << transaction.name << "\" (" << transaction.records.size() << " change(s))" << endl;
+    redo_stack.push_back(move(transaction));
+    return true;
+}
+
+bool Journal::Redo()
+{
+    lock_guard<recursive_mutex> lock(mutex);
+    if(!CanRedo() || system->IsDisassembling()) return false;
+
+    auto transaction = move(redo_stack.back());
+    redo_stack.pop_back();
+
+    replaying_thread.store(this_thread::get_id(), memory_order_release);
+    {
+        signal_defer_scope defer;
+        for(auto& record : transaction.records) Apply(record, false);
+    }
+    replaying_thread.store(thread::id(), memory_order_release);
+
+    cout << "[Journal::Redo] redid \"" << transaction.name << "\" (" << transaction.records.size() << " change(s))" << endl;
+    undo_stack.push_back(move(transaction));
+    return true;
+}
+
+void Journal::Clear()
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    undo_stack.clear();
+    redo_stack.clear();
+    for(auto& [tid, open] : open_transactions) open.transaction.records.clear();
+}
+
+void Journal::RecordObjectChange(char const* description, GlobalMemoryLocation const& start, u32 count,
+                                 vector<ObjectState>&& before, vector<ObjectState>&& after)
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    // consecutive changes to the same objects inside a transaction (i.e., marking an instruction as code and
+    // then setting its operand expression) only need the first before state and the last after state
+    auto open = GetOpenTransaction();
+    if(open && open->transaction.records.size()) {
+        auto& last = open->transaction.records.back();
+        if(last.type == Record::TYPE::OBJECTS && last.where == start && last.count == count) {
+            last.after = move(after);
+            redo_stack.clear();
+            return;
+        }
+    }
+
+    Record record;
+    record.type   = Record::TYPE::OBJECTS;
+    record.where  = start;
+    record.count  = count;
+    record.before = move(before);
+    record.after  = move(after);
+    AddRecord(description, move(record));
+}
+
+void Journal::RecordLabelCreated(GlobalMemoryLocation const& where, string const& name)
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    Record record;
+    record.type  = Record::TYPE::LABEL_CREATED;
+    record.where = where;
+    record.name  = name;
+    AddRecord("Create label", move(record));
+}
+
+void Journal::RecordLabelDeleted(GlobalMemoryLocation const& where, string const& name)
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    Record record;
+    record.type  = Record::TYPE::LABEL_DELETED;
+    record.where = where;
+    record.name  = name;
+    AddRecord("Delete label", move(record));
+}
+
+void Journal::RecordLabelRenamed(GlobalMemoryLocation const& where, int nth, string const& old_name, string const& new_name)
+{
+    lock_guard<recursive_mutex> lock(mutex);
+
+    Record record;
+    record.type     = Record::TYPE::LABEL_RENAMED;
+    record.where    = where;
+    record.nth      = nth;
+    record.name     = old_name;
+    record.new_name = new_name;
+    AddRecord("Rename label", move(record));
+}
+
+Journal::OpenTransaction* Journal::GetOpenTransaction()
+{
+    auto it = open_transactions.find(this_thread::get_id());
+    return (it != open_transactions.end()) ? &it->second : nullptr;
+}
+
+// mutex must be held by the caller
+void Journal::AddRecord(char const* description, Record&& record)
+{
+    // any new change makes the redo history invalid
+    redo_stack.clear();
+
+    if(auto open = GetOpenTransaction()) {
+        open->transaction.records.push_back(move(record));
+        return;
+    }
+
+    Transaction transaction;
+    transaction.name = description;
+    transaction.records.push_back(move(record));
+    PushTransaction(move(transaction));
+}
+
+// mutex must be held by the caller
+void Journal::PushTransaction(Transaction&& transaction)
+{
+    undo_stack.push_back(move(transaction));
+    while(undo_stack.size() > MAX_UNDO_TRANSACTIONS) undo_stack.pop_front();
+}
+
+void Journal::Apply(Record const& record, bool undo)
+{
+    switch(record.type) {
+    case Record::TYPE::OBJECTS:
+        if(auto memory_region = system->GetMemoryRegion(record.where)) {
+            memory_region->RestoreObjectStates(record.where, record.count, undo ? record.before : record.after);
+        }
+        break;
+
+    case Record::TYPE::LABEL_CREATED:
+    case Record::TYPE::LABEL_DELETED:
+        // undoing a create is the same as redoing a delete
+        if(undo == (record.type == Record::TYPE::LABEL_CREATED)) {
+            if(auto label = system->FindLabel(record.name)) system->DeleteLabel(label);
+        } else {
+            system->CreateLabel(record.where, record.name);
+        }
+        break;
+
+    case Record::TYPE::LABEL_RENAMED:
+        system->EditLabel(record.where, undo ? record.name : record.new_name, record.nth);
+        break;
+    }
+}
+
+}
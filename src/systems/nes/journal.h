@@ -0,0 +1,119 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+
+#include "systems/nes/memory.h"
+
+namespace Systems::NES {
+
+class System;
+
+// Journal is the undo/redo history of a System. Rather than copying whole regions, each change
+// records the state of only the objects it touched, before and after (see MemoryRegion::ObjectState),
+// and label changes record just the names involved. Undoing rebuilds the recorded objects and nothing
+// else, so it costs time and memory proportional to the number of objects changed.
+//
+// Every change is its own undo step unless it's made between BeginTransaction() and EndTransaction(),
+// in which case all the changes are undone together (i.e., a whole disassembly).
+//
+// The disassembly thread records while the UI thread can still make edits, so the journal is locked
+// and transactions are kept per thread: an edit on the UI thread is never merged into a transaction
+// the disassembly thread has open. Undo and redo wait until no transaction is open.
+class Journal {
+public:
+    using ObjectState = MemoryRegion::ObjectState;
+
+    Journal(System*);
+    ~Journal();
+
+    // Transactions nest; only the outermost name is used
+    void BeginTransaction(std::string const& name);
+    void EndTransaction();
+
+    // False on the thread that is undoing or redoing, so the changes made by replaying aren't recorded again
+    bool IsRecording() const { return replaying_thread.load(std::memory_order_acquire) != std::this_thread::get_id(); }
+
+    bool CanUndo() const;
+    bool CanRedo() const;
+    std::string GetUndoName() const;
+    std::string GetRedoName() const;
+
+    bool Undo();
+    bool Redo();
+
+    // Forget the history. Needed when something a record refers to (a define, enum, etc) is deleted
+    void Clear();
+
+    // Called by MemoryRegion and System as changes are made
+    void RecordObjectChange(char const* description, GlobalMemoryLocation const& start, u32 count,
+                            std::vector<ObjectState>&& before, std::vector<ObjectState>&& after);
+    void RecordLabelCreated(GlobalMemoryLocation const&, std::string const&);
+    void RecordLabelDeleted(GlobalMemoryLocation const&, std::string const&);
+    void RecordLabelRenamed(GlobalMemoryLocation const&, int nth, std::string const& old_name, std::string const& new_name);
+
+private:
+    struct Record {
+        enum class TYPE {
+            OBJECTS,
+            LABEL_CREATED,
+            LABEL_DELETED,
+            LABEL_RENAMED
+        } type;
+
+        GlobalMemoryLocation where;
+
+        // OBJECTS
+        u32 count = 0;
+        std::vector<ObjectState> before;
+        std::vector<ObjectState> after;
+
+        // LABEL_*
+        int         nth = 0;
+        std::string name;
+        std::string new_name;
+    };
+
+    struct Transaction {
+        std::string         name;
+        std::vector<Record> records;
+    };
+
+    // a transaction being built by one thread
+    struct OpenTransaction {
+        Transaction transaction;
+        int         depth = 0;
+    };
+
+    // mutex must be held by the caller
+    OpenTransaction* GetOpenTransaction();
+    void AddRecord(char const* description, Record&&);
+    void PushTransaction(Transaction&&);
+
+    void Apply(Record const&, bool undo);
+
+    System* system;
+
+    // recursive, since replaying a record can call back into the journal
+    mutable std::recursive_mutex mutex;
+
+    std::deque<Transaction> undo_stack;
+    std::deque<Transaction> redo_stack;
+
+    std::unordered_map<std::thread::id, OpenTransaction> open_transactions;
+    std::atomic<std::thread::id>                         replaying_thread;
+};
+
+}
@@ -0,0 +1,639 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "systems/nes/apu_io.h"
+#include "systems/nes/cpu.h"
+#include "systems/nes/machine.h"
+#include "systems/nes/memory.h"
+#include "systems/nes/ppu.h"
+#include "systems/nes/ppu_renderer.h"
+#include "systems/nes/system.h"
+
+using namespace std;
+
+namespace Systems::NES {
+
+// used until SetAccessFilter is called, so the CPU never has to check for a null filter
+static Machine::AccessFilter const empty_access_filter = {};
+
+static inline u64 TimingNow()
+{
+    return (u64)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Machine::Machine(shared_ptr<System> const& _system, bool _headless)
+    : system(_system), access_filter(&empty_access_filter), headless(_headless)
+{
+    // allocate storage for framebuffers. headless machines draw straight into the completed one
+    int num_framebuffers = headless ? 1 : 3;
+    if(headless) completed_index = back_index;
+
+    framebuffers = new u32[num_framebuffers * FRAMEBUFFER_PIXELS];
+    framebuffer = &framebuffers[back_index * FRAMEBUFFER_PIXELS];
+
+    // fill the framebuffers with fully transparent pixels (0), so the bottom 16 rows aren't visible
+    memset(framebuffers, 0, num_framebuffers * FRAMEBUFFER_BYTES);
+
+    ppu_frame = new u8[PPU_FRAME_PIXELS];
+    memset(ppu_frame, 0x0F, PPU_FRAME_PIXELS); // black
+    memset(ppu_frame_masks, 0, sizeof(ppu_frame_masks));
+
+    ppu = make_shared<PPU>(
+        [this](int high) {
+            cpu->Nmi(high);
+        },
+        [this](u16 address)->u8 { // memory_view is created after the PPU, so it's looked up on every access
+            return memory_view->PeekPPU(address & 0x3FFF);
+        },
+        [this](u16 address)->u8 {
+            return memory_view->ReadPPU(address & 0x3FFF);
+        },
+        [this](u16 address, u8 value)->void {
+            memory_view->WritePPU(address & 0x3FFF, value);
+        }
+    );
+
+    apu_io = make_shared<APU_IO>();
+    oam_dma_callback_connection = apu_io->oam_dma_callback->connect(std::bind(&Machine::WriteOAMDMA, this, placeholders::_1));
+
+    memory_view = system->CreateMemoryView(ppu->CreateMemoryView(), apu_io->CreateMemoryView());
+
+    // rendering fetches read CHR and the nametables directly
+    if(auto system_view = dynamic_pointer_cast<SystemView>(memory_view)) {
+        ppu->SetFetchPages(system_view->GetPPUPages());
+    }
+
+    cpu = make_shared<CPU>(
+        [this](u16 address, bool opcode_fetch)->u8 {
+            ACCESS access = opcode_fetch ? ACCESS::EXECUTE : ACCESS::READ;
+
+            [[unlikely]] if(timing_cycle) {
+                if(access_filter->Test(access, address)) {
+                    u64 start = TimingNow();
+                    access_func(address, access);
+                    timing.breakpoints += TimingNow() - start;
+                }
+
+                u64 start = TimingNow();
+                u8 value = memory_view->Read(address);
+                timing.memory += TimingNow() - start;
+                return value;
+            }
+
+            [[unlikely]] if(access_filter->Test(access, address)) {
+                access_func(address, access);
+            }
+            return memory_view->Read(address);
+        },
+        [this](u16 address, u8 value)->void {
+            [[unlikely]] if(timing_cycle) {
+                if(access_filter->Test(ACCESS::WRITE, address)) {
+                    u64 start = TimingNow();
+                    access_func(address, ACCESS::WRITE);
+                    timing.breakpoints += TimingNow() - start;
+                }
+
+                u64 start = TimingNow();
+                memory_view->Write(address, value);
+                timing.memory += TimingNow() - start;
+                return;
+            }
+
+            [[unlikely]] if(access_filter->Test(ACCESS::WRITE, address)) {
+                access_func(address, ACCESS::WRITE);
+            }
+            memory_view->Write(address, value);
+        }
+    );
+
+    Reset();
+}
+
+Machine::~Machine()
+{
+    // stop the render thread before the frame goes away
+    renderer = nullptr;
+
+    delete [] framebuffers;
+    delete [] ppu_frame;
+}
+
+void Machine::SetAccessFilter(AccessFilter const* filter, access_func_t const& func)
+{
+    access_func = func;
+    SetAccessFilter(filter);
+}
+
+void Machine::SetAccessFilter(AccessFilter const* filter)
+{
+    access_filter = filter ? filter : &empty_access_filter;
+}
+
+void Machine::AccessFilter::Clear()
+{
+    memset(pages, PAGE_NONE, sizeof(pages));
+    memset(bits, 0, sizeof(bits));
+}
+
+void Machine::AccessFilter::Add(ACCESS access, u16 first, u16 last)
+{
+    auto& access_pages = pages[(int)access];
+    auto& access_bits = bits[(int)access];
+
+    for(int page = first >> 8; page <= (last >> 8); page++) {
+        if(access_pages[page] == PAGE_ALL) continue;
+
+        int start = max((int)first, page << 8);
+        int end = min((int)last, (page << 8) | 0xFF);
+        if(start == (page << 8) && end == ((page << 8) | 0xFF)) {
+            access_pages[page] = PAGE_ALL;
+            continue;
+        }
+
+        access_pages[page] = PAGE_SOME;
+        for(int address = start; address <= end; address++) {
+            access_bits[address >> 5] |= (1 << (address & 0x1F));
+        }
+    }
+}
+
+void Machine::Reset()
+{
+    SyncRendererState();
+
+    cpu->Reset();
+    ppu->Reset();
+    cpu_shift = 0;
+    raster_line = ppu_frame;
+    raster_y = 0;
+    in_vblank = false;
+    oam_dma_enabled = false;
+
+    if(renderer) renderer->Restart();
+}
+
+template <bool TIMED>
+bool Machine::StepCPU()
+{
+    // TODO DMC DMA has priority over OAM DMA
+    if(oam_dma_enabled && cpu->IsReadCycle()) { // CPU can only be halted on a read cycle
+        u64 start = TIMED ? TimingNow() : 0;
+
+        // simulate a "halt" cycle
+        if(!dma_halt_cycle_done) {
+            dma_halt_cycle_done = true;
+            bool ret = cpu->Step();
+            if constexpr (TIMED) timing.oam_dma += TimingNow() - start;
+            return ret;
+        }
+
+        // technically we need a random alignment cycle, but we just emulate perfect alignment so our DMA will always
+        // take 513 cycles, never 514
+
+        // and technically DMA is part of the CPU but alas...it's happening here
+        if(!oam_dma_rw) { // read
+            // reading RAM has no side effects, and the CPU is halted so it can't change. When the PPU won't
+            // look at OAM before the DMA is over, the whole page is copied at once and the remaining cycles
+            // only keep time. It isn't saved: continuing byte by byte after a load writes the same values
+            if((oam_dma_source & 0xFF) == 0) {
+                oam_dma_block = false;
+                auto system_view = dynamic_cast<SystemView*>(memory_view.get());
+                if(oam_dma_source < 0x2000 && system_view && ppu->IsOAMIdle()) {
+                    ppu->WriteOAMPage(system_view->GetRAMPage(oam_dma_source >> 8));
+                    oam_dma_block = true;
+                }
+            }
+
+            if(!oam_dma_block) oam_dma_read_latch = memory_view->Read(oam_dma_source);
+            oam_dma_rw ^= 1;
+        } else {
+            if(oam_dma_block) ppu->IncrementOAMAddress();
+            else              memory_view->Write(0x2004, oam_dma_read_latch);
+            oam_dma_rw ^= 1;
+            oam_dma_source += 1;
+            if((oam_dma_source & 0xFF) == 0) oam_dma_enabled = 0;
+        }
+
+        cpu->DmaStep();
+        if constexpr (TIMED) timing.oam_dma += TimingNow() - start;
+        return false;
+    } else if constexpr (TIMED) {
+        // memory and breakpoint time is counted by the read and write functions, so take it back out
+        u64 excluded = timing.memory + timing.breakpoints;
+        u64 start = TimingNow();
+
+        timing_cycle = true;
+        bool ret = cpu->Step();
+        timing_cycle = false;
+
+        u64 elapsed = TimingNow() - start;
+        excluded = timing.memory + timing.breakpoints - excluded;
+        timing.cpu += (elapsed > excluded) ? (elapsed - excluded) : 0;
+        return ret;
+    } else {
+        return cpu->Step();
+    }
+}
+
+template <bool TIMED>
+void Machine::StepPPU()
+{
+    u64 start = TIMED ? TimingNow() : 0;
+
+    bool hblank_new, vblank;
+    int color = ppu->Step(hblank_new, vblank);
+
+    [[unlikely]] if(renderer) {
+        // the render thread is let go a scanline at a time
+        if(ppu->GetCycle() == 0) renderer->Advance(ppu->GetDotCount());
+    } else {
+        Rasterize(ppu->GetPPUMASK(), color, hblank_new, vblank);
+    }
+
+    if(vblank) { // on high vblank
+        if(!in_vblank) {
+            in_vblank = true;
+            timing.frames++;
+            SyncRenderer();
+            ConvertFrame();
+            PresentFrame();
+            if(frame_func) frame_func(*this);
+        }
+    } else {
+        in_vblank = false;
+    }
+
+    if constexpr (TIMED) timing.ppu += TimingNow() - start;
+}
+
+template <bool TIMED>
+bool Machine::Cycle()
+{
+    bool ret;
+
+    // PPU clock is /4 master clock and CPU is /12 master clock, so it steps 3x as often
+    switch(cpu_shift) {
+    case 0:
+        ret = StepCPU<TIMED>();
+        StepPPU<TIMED>();
+        StepPPU<TIMED>();
+        break;
+    case 1:
+        StepPPU<TIMED>();
+        ret = StepCPU<TIMED>();
+        StepPPU<TIMED>();
+        StepPPU<TIMED>();
+        break;
+    case 2:
+        StepPPU<TIMED>();
+        ret = StepCPU<TIMED>();
+        StepPPU<TIMED>();
+        StepPPU<TIMED>();
+        StepPPU<TIMED>();
+        break;
+    }
+
+    cpu_shift = (cpu_shift + 1) % 3;
+    return ret;
+}
+
+bool Machine::SingleCycle()
+{
+    [[unlikely]] if(timing_enabled) {
+        if((++timing.cycles & (TIMING_SAMPLE_INTERVAL - 1)) == 0) {
+            timing.sampled_cycles++;
+            return Cycle<true>();
+        }
+    }
+
+    return Cycle<false>();
+}
+
+bool Machine::IsCrashed() const
+{
+    return cpu->GetNextUC() < 0;
+}
+
+bool Machine::RunFrame()
+{
+    int frame = ppu->GetFrame();
+    while(ppu->GetFrame() == frame) {
+        SingleCycle();
+
+        if(IsCrashed()) {
+            // perform one more cycle just to print out invalid opcode message
+            cpu->Step();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Colors for each combination of the PPUMASK greyscale and emphasis bits, 16 tables of 64
+static u32 const* GetColorTables()
+{
+    static u32 tables[16 * 64];
+    static bool initialized = false;
+
+    if(!initialized) {
+        for(int t = 0; t < 16; t++) {
+            bool greyscale = (t & 0x01);
+            int emphasis = (t >> 1); // red, green, blue
+
+            for(int i = 0; i < 64; i++) {
+                // greyscale keeps only the brightness column of the palette
+                u32 rgb = (u32)rgb_palette_map[greyscale ? (i & 0x30) : i];
+                float channels[3] = { (float)(rgb & 0xFF), (float)((rgb >> 8) & 0xFF), (float)((rgb >> 16) & 0xFF) };
+
+                // each emphasized color darkens the other two
+                for(int c = 0; c < 3; c++) {
+                    if(!(emphasis & (1 << c))) continue;
+                    for(int other = 0; other < 3; other++) {
+                        if(other != c) channels[other] *= 0.816f;
+                    }
+                }
+
+                tables[t * 64 + i] = 0xFF000000 | ((u32)channels[2] << 16) | ((u32)channels[1] << 8) | (u32)channels[0];
+            }
+        }
+        initialized = true;
+    }
+
+    return tables;
+}
+
+static inline int GetColorTableIndex(u8 ppumask)
+{
+    return ((ppumask & 0xE0) >> 4) | (ppumask & 0x01);
+}
+
+// convert the palette indexes of the frame into the back buffer, one lookup per pixel
+void Machine::ConvertFrame()
+{
+    static u32 const* const tables = GetColorTables();
+
+    for(int y = 0; y < PPU_FRAME_LINES; y++) {
+        u32 const* colors = &tables[GetColorTableIndex(ppu_frame_masks[y]) * 64];
+        u8 const* src = &ppu_frame[y * 256];
+        u32* dest = &framebuffer[y * 256];
+
+        for(int x = 0; x < 256; x += 8) {
+            dest[x + 0] = colors[src[x + 0] & 0x3F];
+            dest[x + 1] = colors[src[x + 1] & 0x3F];
+            dest[x + 2] = colors[src[x + 2] & 0x3F];
+            dest[x + 3] = colors[src[x + 3] & 0x3F];
+            dest[x + 4] = colors[src[x + 4] & 0x3F];
+            dest[x + 5] = colors[src[x + 5] & 0x3F];
+            dest[x + 6] = colors[src[x + 6] & 0x3F];
+            dest[x + 7] = colors[src[x + 7] & 0x3F];
+        }
+    }
+}
+
+// called on the machine's thread only
+void Machine::PresentFrame()
+{
+    // nothing else reads the single buffer
+    if(headless) return;
+
+    int presented = back_index;
+    int last_ready = ready_state.exchange(presented | FRAME_READY_NEW, memory_order_acq_rel);
+
+    completed_index = presented;
+    back_index = last_ready & FRAME_READY_INDEX;
+    framebuffer = &framebuffers[back_index * FRAMEBUFFER_PIXELS];
+}
+
+u32 const* Machine::TakeLatestFrame(bool& new_frame)
+{
+    assert(!headless);
+
+    new_frame = (bool)(ready_state.load(memory_order_relaxed) & FRAME_READY_NEW);
+    if(new_frame) {
+        int ready = ready_state.exchange(front_index, memory_order_acq_rel);
+        front_index = ready & FRAME_READY_INDEX;
+    }
+
+    return &framebuffers[front_index * FRAMEBUFFER_PIXELS];
+}
+
+void Machine::SetPipelinedRendering(bool enable)
+{
+    if(enable == (bool)renderer) return;
+
+    if(enable) {
+        auto system_view = dynamic_pointer_cast<SystemView>(memory_view);
+        if(!system_view) return;
+
+        renderer = make_shared<PPURenderer>(*this);
+        ppu->SetTimingOnly(true);
+
+        // everything that changes what the render thread's PPU sees is logged on the dot it happens
+        ppu->SetRegisterFunction([this](u16 reg, u8 value, bool write) {
+            renderer->LogRegister(ppu->GetDotCount(), reg, value, write);
+        });
+        ppu_pages_changed_connection = system_view->ppu_pages_changed->connect([this]() {
+            renderer->LogMapping(ppu->GetDotCount());
+        });
+    } else {
+        SyncRendererState();
+        ppu_pages_changed_connection = nullptr;
+        ppu->SetRegisterFunction(nullptr);
+        ppu->SetTimingOnly(false);
+        renderer = nullptr;
+    }
+}
+
+void Machine::SyncRenderer() const
+{
+    if(renderer) renderer->Sync(ppu->GetDotCount());
+}
+
+// The machine's PPU skips the pixel pipeline (the shift registers, latches and sprite output) while
+// rendering is pipelined. The render thread's PPU is in the same state plus all of that, so it's copied
+// back whenever this PPU is about to be saved or copied, including into the renderer by Restart
+void Machine::SyncRendererState() const
+{
+    if(!renderer) return;
+    renderer->Sync(ppu->GetDotCount());
+    ppu->CopyState(*renderer->GetPPU());
+}
+
+void Machine::WriteOAMDMA(u8 page)
+{
+    oam_dma_enabled = true;
+    oam_dma_block = false;
+    oam_dma_source = (page << 8);
+    oam_dma_rw = 0;
+    dma_halt_cycle_done = false;
+}
+
+void Machine::CopyState(Machine const& other)
+{
+    assert(system == other.system);
+
+    SyncRenderer();
+    other.SyncRendererState();
+
+    cpu->CopyState(*other.cpu);
+    ppu->CopyState(*other.ppu);
+    apu_io->CopyState(*other.apu_io);
+    memory_view->CopyState(*other.memory_view);
+
+    cpu_shift = other.cpu_shift;
+
+    // show the other machine's last frame, then continue the one it's drawing
+    if(!headless) {
+        memcpy(framebuffer, other.GetFramebuffer(), FRAMEBUFFER_BYTES);
+        PresentFrame();
+    }
+    memcpy(ppu_frame, other.ppu_frame, PPU_FRAME_PIXELS);
+    memcpy(ppu_frame_masks, other.ppu_frame_masks, sizeof(ppu_frame_masks));
+    hblank = other.hblank;
+    in_vblank = other.in_vblank;
+    raster_line = ppu_frame + (other.raster_line - other.ppu_frame);
+    raster_y = other.raster_y;
+    raster_x = other.raster_x;
+
+    oam_dma_enabled = other.oam_dma_enabled;
+    oam_dma_source = other.oam_dma_source;
+    oam_dma_rw = other.oam_dma_rw;
+    oam_dma_read_latch = other.oam_dma_read_latch;
+    dma_halt_cycle_done = other.dma_halt_cycle_done;
+    oam_dma_block = other.oam_dma_block;
+
+    if(renderer) renderer->Restart();
+}
+
+shared_ptr<Machine> Machine::Fork(bool headless) const
+{
+    auto machine = make_shared<Machine>(system, headless);
+    machine->CopyState(*this);
+    return machine;
+}
+
+bool Machine::SaveState(ostream& os, string& errmsg) const
+{
+    SyncRendererState();
+
+    WriteVarInt(os, 2); // version. 1 saved the whole color framebuffer
+
+    // save CPU
+    if(!cpu->Save(os, errmsg)) return false;
+
+    // save PPU
+    if(!ppu->Save(os, errmsg)) return false;
+
+    // save APU_IO
+    if(!apu_io->Save(os, errmsg)) return false;
+
+    // save memory_view (i.e., all VRAM, RAM, cart state, etc)
+    if(!memory_view->Save(os, errmsg)) return false;
+
+    // save DMA state
+    WriteVarInt(os, (int)oam_dma_enabled);
+    WriteVarInt(os, oam_dma_source);
+    WriteVarInt(os, oam_dma_rw);
+    WriteVarInt(os, oam_dma_read_latch);
+    WriteVarInt(os, (int)dma_halt_cycle_done);
+
+    // save a copy of the frame being drawn so we can display it when state loads without running
+    os.write((char*)ppu_frame, 256 * PPU_FRAME_LINES);
+    os.write((char*)ppu_frame_masks, PPU_FRAME_LINES);
+
+    // and the raster positions
+    WriteVarInt(os, (int)hblank);
+    WriteVarInt(os, raster_x);
+    WriteVarInt(os, raster_y);
+
+    errmsg = "Error saving machine state";
+    return os.good();
+}
+
+bool Machine::LoadState(istream& is, string& errmsg)
+{
+    // states come from project files and movies, so a bad version is an error and not a bug
+    int version = ReadVarInt<int>(is);
+    if(!is.good()) {
+        errmsg = "Error reading save state";
+        return false;
+    }
+
+    if(version != 1 && version != 2) {
+        errmsg = "Unsupported save state version";
+        return false;
+    }
+
+    SyncRenderer();
+
+    // load CPU
+    if(!cpu->Load(is, errmsg)) return false;
+
+    // load PPU
+    if(!ppu->Load(is, errmsg)) return false;
+
+    // load APU_IO
+    if(!apu_io->Load(is, errmsg)) return false;
+
+    // load memory_view
+    if(!memory_view->Load(is, errmsg)) return false;
+
+    // load DMA state
+    oam_dma_enabled     = (bool)ReadVarInt<int>(is);
+    oam_dma_source      = ReadVarInt<u16>(is);
+    oam_dma_rw          = ReadVarInt<u8>(is);
+    oam_dma_read_latch  = ReadVarInt<u8>(is);
+    dma_halt_cycle_done = (bool)ReadVarInt<int>(is);
+    oam_dma_block       = false;
+
+    // load the frame being drawn
+    if(version == 1) {
+        // colors are turned back into palette indexes, which is exact since emphasis wasn't emulated then
+        is.read((char*)framebuffer, FRAMEBUFFER_BYTES);
+        for(int i = 0; i < 256 * PPU_FRAME_LINES; i++) {
+            u32 rgb = framebuffer[i] & 0x00FFFFFF;
+            u8 index = 0x0F;
+            for(int c = 0; c < 64; c++) {
+                if((u32)rgb_palette_map[c] == rgb) {
+                    index = c;
+                    break;
+                }
+            }
+            ppu_frame[i] = index;
+        }
+        memset(ppu_frame_masks, 0, sizeof(ppu_frame_masks));
+    } else {
+        is.read((char*)ppu_frame, 256 * PPU_FRAME_LINES);
+        is.read((char*)ppu_frame_masks, PPU_FRAME_LINES);
+    }
+
+    // show it right away, and keep drawing on top of it
+    ConvertFrame();
+    PresentFrame();
+
+    // and the raster positions
+    hblank = (bool)ReadVarInt<int>(is);
+    raster_x = ReadVarInt<int>(is);
+    raster_y = ReadVarInt<int>(is);
+
+    // fixup raster_line to point to the correct row
+    // raster_y == 0 means we're in vblank and will set render_line later
+    if(raster_y > 0) raster_line = &ppu_frame[(raster_y - 1) * 256];
+
+    // not saved, but it only matters for knowing when the next frame completes
+    in_vblank = (ppu->GetScanline() >= 240);
+
+    if(renderer) renderer->Restart();
+
+    errmsg = "Error loading machine state";
+    return is.good();
+}
+
+}
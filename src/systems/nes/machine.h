@@ -0,0 +1,254 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "signals.h"
+#include "util.h"
+
+// NTSC CPU clock, for reporting emulation speed as a percentage of real hardware
+#define NES_CPU_CLOCK_HZ 1789773.0
+
+// One of every this many cycles is timed when timing is enabled. Must be a power of 2
+#define TIMING_SAMPLE_INTERVAL 256
+
+#define FRAMEBUFFER_PIXELS (256 * 256)
+#define FRAMEBUFFER_BYTES  (sizeof(u32) * FRAMEBUFFER_PIXELS)
+
+// the PPU's output before it's converted to color, one palette index per pixel. Only the 240 visible
+// lines are converted and saved
+#define PPU_FRAME_PIXELS   (256 * 256)
+#define PPU_FRAME_LINES    240
+
+namespace Systems::NES {
+
+class APU_IO;
+class CPU;
+class MemoryView;
+class PPU;
+class PPURenderer;
+class System;
+
+// Machine is the emulated hardware of one running NES: the CPU, PPU, APU/IO and memory view, plus
+// the glue between them (OAM DMA and rasterizing into the framebuffer). It has no UI and no thread
+// of its own, so it can be stepped by a SystemInstance's emulation thread or by a BatchRunner worker.
+//
+// With pipelined rendering, the pixels are drawn by a PPURenderer on a second thread instead, and the
+// two meet at every vblank so that the frame function sees the same complete frame.
+class Machine {
+public:
+    enum class ACCESS { READ, WRITE, EXECUTE };
+    typedef std::function<void(u16, ACCESS)> access_func_t;
+    typedef std::function<void(Machine&)> frame_func_t;
+
+    // Which CPU accesses call the access function, kept separately for each ACCESS type. The page table
+    // is checked first, so an access to a page with nothing in it costs a single test, and a page that's
+    // entirely covered (like a watched range or bank) never needs its bits
+    struct AccessFilter {
+        enum { PAGE_NONE = 0, PAGE_SOME, PAGE_ALL };
+
+        u8  pages[3][0x100];
+        u32 bits[3][0x10000 / 32];
+
+        void Clear();
+
+        // add every address from first to last (inclusive)
+        void Add(ACCESS, u16 first, u16 last);
+
+        bool Test(ACCESS access, u16 address) const {
+            u8 page = pages[(int)access][address >> 8];
+            [[likely]] if(page == PAGE_NONE) return false;
+            return page == PAGE_ALL || (bits[(int)access][address >> 5] & (1 << (address & 0x1F)));
+        }
+    };
+
+    // Where emulation time goes. Only one cycle in TIMING_SAMPLE_INTERVAL is timed, so the times
+    // (in nanoseconds) are for sampled_cycles and have to be scaled to estimate the total. Take the
+    // difference of two copies to get the breakdown for a period of time
+    struct Timing {
+        u64 cycles         = 0; // CPU cycles run while timing was enabled, timed or not
+        u64 frames         = 0; // counted even when timing is disabled
+        u64 sampled_cycles = 0;
+        u64 cpu            = 0; // CPU stepping, not counting the two below
+        u64 memory         = 0; // CPU reads and writes through the memory view
+        u64 breakpoints    = 0; // the access function, for addresses set in the access filter
+        u64 ppu            = 0; // PPU stepping including its bus, and rasterizing
+        u64 oam_dma        = 0;
+
+        u64 SampledTotal() const { return cpu + memory + breakpoints + ppu + oam_dma; }
+
+        Timing operator-(Timing const& other) const {
+            Timing t;
+            t.cycles         = cycles - other.cycles;
+            t.frames         = frames - other.frames;
+            t.sampled_cycles = sampled_cycles - other.sampled_cycles;
+            t.cpu            = cpu - other.cpu;
+            t.memory         = memory - other.memory;
+            t.breakpoints    = breakpoints - other.breakpoints;
+            t.ppu            = ppu - other.ppu;
+            t.oam_dma        = oam_dma - other.oam_dma;
+            return t;
+        }
+    };
+
+    // A headless machine is never displayed (i.e., batch jobs and movie verification), so it has a single
+    // framebuffer that always holds the last completed frame, and TakeLatestFrame can't be used
+    Machine(std::shared_ptr<System> const&, bool headless = false);
+    ~Machine();
+
+    bool IsHeadless() const { return headless; }
+
+    std::shared_ptr<APU_IO>     const& GetAPUIO()      const { return apu_io; }
+    std::shared_ptr<CPU>        const& GetCPU()        const { return cpu; }
+    std::shared_ptr<PPU>        const& GetPPU()        const { return ppu; }
+    std::shared_ptr<MemoryView> const& GetMemoryView() const { return memory_view; }
+    std::shared_ptr<System>     const& GetSystem()     const { return system; }
+
+    // The most recently completed frame. Only safe to read on the thread running the machine (e.g.,
+    // in the frame function) or while it isn't running
+    u32 const* GetFramebuffer() const { return &framebuffers[completed_index * FRAMEBUFFER_PIXELS]; }
+
+    // The newest completed frame for display, from any one thread while the machine runs on another.
+    // new_frame is set when it differs from the last call. The buffer can be read until the next call
+    u32 const* TakeLatestFrame(bool& new_frame);
+
+    // access_func is called before any CPU access that passes the filter. The filter is owned by the
+    // caller and is read without a lock, so it can't be written while the machine runs. To change it,
+    // swap in another filter between cycles from the thread running the machine
+    void SetAccessFilter(AccessFilter const* filter, access_func_t const& func);
+    void SetAccessFilter(AccessFilter const* filter);
+
+    // func is called on the first cycle of vblank, when the framebuffer holds a complete frame
+    void SetFrameFunction(frame_func_t const& func) { frame_func = func; }
+
+    // Counters are kept while enabled, which costs about one clock read per 20 cycles. They can be
+    // read from any thread, though a copy taken while running may be slightly inconsistent
+    void   EnableTiming(bool enable) { timing_enabled = enable; }
+    bool   IsTimingEnabled() const   { return timing_enabled; }
+    Timing GetTiming() const         { return timing; }
+
+    // Draw on a second thread, leaving this one to keep time. Only change it while the machine isn't
+    // running. The CPU and everything it sees are the same either way, but the PPU's pixel pipeline
+    // (shift registers and latches) is only up to date at vblank
+    void SetPipelinedRendering(bool enable);
+    bool IsPipelinedRendering() const { return (bool)renderer; }
+
+    void Reset();
+
+    // Returns true on the cycle that the CPU fetches an opcode
+    bool SingleCycle();
+
+    // Run until the PPU starts the next frame. Returns false if the CPU crashed on an invalid opcode
+    bool RunFrame();
+    bool IsCrashed() const;
+
+    // The full machine state, including a copy of the framebuffer
+    bool SaveState(std::ostream&, std::string&) const;
+    bool LoadState(std::istream&, std::string&);
+
+    // Make this machine an exact copy of another one of the same System, which must not be running.
+    // ROM is shared through the System and cartridge RAM is shared until written, so only the
+    // few KiB of CPU, PPU and RAM state (and the framebuffer) are copied. A headless copy doesn't
+    // take the last completed frame, since nothing looks at it before the next one is drawn
+    void CopyState(Machine const&);
+    std::shared_ptr<Machine> Fork(bool headless = false) const;
+
+private:
+    template <bool TIMED> bool Cycle();
+    template <bool TIMED> bool StepCPU();
+    template <bool TIMED> void StepPPU();
+    void WriteOAMDMA(u8);
+    void ConvertFrame();
+    void PresentFrame();
+    void SyncRenderer() const;
+    void SyncRendererState() const;
+
+    // draws one dot of PPU output into ppu_frame, from the render thread when rendering is pipelined
+    void Rasterize(u8 ppumask, int color, bool hblank_new, bool vblank) {
+        if(vblank) {
+            // start drawing the next frame from the top
+            raster_line = ppu_frame;
+            raster_y = 0;
+        } else if(hblank_new && hblank_new != hblank) { // on rising edge of hblank
+            hblank = hblank_new;
+            // move scanline down
+            ppu_frame_masks[raster_y] = ppumask;
+            raster_line = &ppu_frame[raster_y++ * 256];
+            raster_x = 0;
+        } else if(!hblank_new) {
+            hblank = false;
+            // display color
+            raster_line[raster_x++] = (u8)color;
+        }
+    }
+
+    friend class PPURenderer;
+
+    std::shared_ptr<System>      system;
+    std::shared_ptr<CPU>         cpu;
+    std::shared_ptr<PPU>         ppu;
+    std::shared_ptr<APU_IO>      apu_io;
+    std::shared_ptr<MemoryView>  memory_view;
+
+    AccessFilter const*          access_filter;
+    access_func_t                access_func;
+    frame_func_t                 frame_func;
+
+    bool                         timing_enabled = false;
+    bool                         timing_cycle = false; // set while a timed cycle runs
+    Timing                       timing;
+
+    int                          cpu_shift = 0;
+
+    // Framebuffers are 0xAABBGGRR format (MSB = alpha). There are three, used as a lock free triple
+    // buffer: the rasterizer draws into the back buffer, PresentFrame() swaps it with the ready buffer
+    // on every vblank, and TakeLatestFrame() swaps the ready buffer with the front buffer when there's
+    // a new one. ready_state holds the ready buffer's index, plus FRAME_READY_NEW until it's taken
+    static int const FRAME_READY_INDEX = 0x03;
+    static int const FRAME_READY_NEW   = 0x04;
+
+    bool                         headless;
+    u32*                         framebuffers;         // only one when headless
+    u32*                         framebuffer;          // the back buffer
+    int                          back_index      = 0;
+    int                          completed_index = 1;  // the last buffer presented
+    std::atomic<int>             ready_state     = 1;
+    int                          front_index     = 2;  // only used by TakeLatestFrame
+
+    // The rasterizer draws palette indexes into ppu_frame, and ConvertFrame() turns the whole frame into
+    // color at vblank. Greyscale and color emphasis are applied per line, using PPUMASK from the start
+    // of the line
+    u8*                          ppu_frame;
+    u8                           ppu_frame_masks[256];
+
+    // rasterizer position
+    bool                         hblank = false;
+    bool                         in_vblank = false;
+    u8*                          raster_line;
+    int                          raster_y = 0;
+    int                          raster_x = 0;
+
+    // OAM DMA
+    bool                         oam_dma_enabled = false;
+    u16                          oam_dma_source;
+    u8                           oam_dma_rw;
+    u8                           oam_dma_read_latch;
+    bool                         dma_halt_cycle_done;
+    bool                         oam_dma_block = false; // the page was already copied, only count the cycles
+
+    signal_connection            oam_dma_callback_connection;
+
+    // pipelined rendering
+    std::shared_ptr<PPURenderer> renderer;
+    signal_connection            ppu_pages_changed_connection;
+};
+
+}
@@ -13,11 +13,13 @@
 #include "imgui_internal.h"
 
 #include "magic_enum.hpp"
+#include "trace.h"
 #include "util.h"
 
 #include "systems/nes/comment.h"
 #include "systems/nes/disasm.h"
 #include "systems/nes/expressions.h"
+#include "systems/nes/journal.h"
 #include "systems/nes/label.h"
 #include "systems/nes/system.h"
 
@@ -109,6 +111,8 @@ void MemoryRegion::_SumListingItemCountsUp(shared_ptr<MemoryObjectTreeNode>& tre
 
 void MemoryRegion::RecreateListingItems()
 {
+    TRACE_SCOPE("MemoryRegion::RecreateListingItems");
+
     u32 region_offset = 0;
     while(region_offset < region_size) {
         shared_ptr<MemoryObject> obj = object_refs[region_offset];
@@ -128,6 +132,11 @@ void MemoryRegion::RecreateListingItemsForMemoryObject(shared_ptr<MemoryObject>&
     // but in the future, we need to count up labels, comments, etc
     obj->listing_items.clear();
 
+    // anything that recreates listing items may have changed how the object is formatted
+    // and what it saves
+    obj->InvalidateFormatCache();
+    MarkEdited();
+
     if(obj->default_blank_line) {
         // create a blank line inbetween other memory and labels, unless at the start of the bank
         // TODO or if it's a local label
@@ -270,6 +279,8 @@ void MemoryRegion::_ReinializeFromObjectRefs(shared_ptr<MemoryObjectTreeNode>& t
 
 void MemoryRegion::InitializeFromData(u8* data, int count)
 {
+    TRACE_SCOPE("MemoryRegion::InitializeFromData");
+
     assert(count == region_size); // can only initialize the memory region tree with an exact number of bytes
 
     // Kill all content blocks and references
@@ -295,7 +306,10 @@ void MemoryRegion::InitializeFromData(u8* data, int count)
 
     // first pass create listing items
     RecreateListingItems();
-    RecalculateListingItemCounts();
+    {
+        TRACE_SCOPE("MemoryRegion::RecalculateListingItemCounts");
+        RecalculateListingItemCounts();
+    }
 
     cout << "[MemoryRegion::InitializeWithData] set $" << hex << uppercase << setfill('0') << setw(0) << count 
          << " bytes of data for memory base $" << setw(4) << base_address << endl;
@@ -303,6 +317,8 @@ void MemoryRegion::InitializeFromData(u8* data, int count)
 
 void MemoryRegion::ReinitializeFromObjectRefs()
 {
+    TRACE_SCOPE("MemoryRegion::ReinitializeFromObjectRefs");
+
     // we need a mapping from unique object index to offset in the region
     // that requires a once-over the entire list of objects
     std::vector<int> objmap;
@@ -331,7 +347,10 @@ void MemoryRegion::ReinitializeFromObjectRefs()
 
     // creating the listing items and recalculate the tree
     RecreateListingItems();
-    RecalculateListingItemCounts();
+    {
+        TRACE_SCOPE("MemoryRegion::RecalculateListingItemCounts");
+        RecalculateListingItemCounts();
+    }
 
     cout << "[MemoryRegion::ReinitializeFromObjectRefs] processed " << count << " objects" << endl;
 }
@@ -382,9 +401,154 @@ shared_ptr<MemoryObject> MemoryRegion::GetMemoryObject(GlobalMemoryLocation cons
     return ret;
 }
 
+// Captures the objects covering an edit before it happens and records the change in the
+// system journal when the edit returns. Nothing is recorded while the journal is replaying
+struct MemoryRegion::EditScope {
+    EditScope(MemoryRegion* _memory_region, GlobalMemoryLocation const& where, u32 byte_count, char const* _description)
+        : memory_region(_memory_region), description(_description)
+    {
+        if(auto system = memory_region->parent_system.lock()) {
+            if(auto& system_journal = system->GetJournal(); system_journal && system_journal->IsRecording()) {
+                journal = system_journal;
+                memory_region->GetObjectRange(where, byte_count, &start, &count);
+                memory_region->CaptureObjectStates(start, count, before);
+            }
+        }
+    }
+
+    ~EditScope() {
+        if(!journal) return;
+
+        vector<ObjectState> after;
+        memory_region->CaptureObjectStates(start, count, after);
+
+        // failed edits don't change anything
+        if(after != before) journal->RecordObjectChange(description, start, count, move(before), move(after));
+    }
+
+    MemoryRegion*            memory_region;
+    char const*              description;
+    shared_ptr<Journal>      journal;
+    GlobalMemoryLocation     start;
+    u32                      count = 0;
+    vector<ObjectState>      before;
+};
+
+void MemoryRegion::GetObjectRange(GlobalMemoryLocation const& where, u32 byte_count, GlobalMemoryLocation* start, u32* count)
+{
+    auto disassembler = parent_system.lock()->GetDisassembler();
+
+    int offset;
+    GetMemoryObject(where, &offset);
+    *start = where;
+    start->address -= offset;
+
+    // extend the end out to the end of the last object
+    u32 end = min(where.address + max(byte_count, 1U), GetEndAddress());
+    GlobalMemoryLocation last(where);
+    last.address = end - 1;
+    auto last_object = GetMemoryObject(last, &offset);
+    end = last.address - offset + last_object->GetSize(disassembler);
+
+    *count = end - start->address;
+}
+
+void MemoryRegion::CaptureObjectStates(GlobalMemoryLocation const& start, u32 count, vector<ObjectState>& out)
+{
+    auto disassembler = parent_system.lock()->GetDisassembler();
+    u32 region_offset = ConvertToRegionOffset(start.address);
+
+    for(u32 offset = 0; offset < count;) {
+        auto& memory_object = object_refs[region_offset + offset];
+        u32 size = max(memory_object->GetSize(disassembler), 1U);
+
+        bool plain = memory_object->type == MemoryObject::TYPE_UNDEFINED
+            && !memory_object->comments.eol && !memory_object->comments.pre && !memory_object->comments.post
+            && memory_object->blank_lines == 0 && memory_object->default_blank_line;
+
+        if(!plain) {
+            out.push_back(ObjectState {
+                .offset             = offset,
+                .size               = size,
+                .type               = memory_object->type,
+                .enum_type          = (memory_object->user_type.index() == 1) ? get<shared_ptr<Enum>>(memory_object->user_type) : nullptr,
+                .operand_expression = memory_object->operand_expression,
+                .comments           = { memory_object->comments.eol, memory_object->comments.pre, memory_object->comments.post },
+                .blank_lines        = memory_object->blank_lines,
+                .default_blank_line = memory_object->default_blank_line
+            });
+        }
+
+        offset += size;
+    }
+}
+
+void MemoryRegion::RestoreObjectStates(GlobalMemoryLocation const& start, u32 count, vector<ObjectState> const& states)
+{
+    // break everything in the range back down into undefined bytes. labels stay on the first byte of each object
+    MarkMemoryAsUndefined(start, count);
+
+    // undefined bytes keep their comments and blank lines, so clear those as well
+    u32 region_offset = ConvertToRegionOffset(start.address);
+    for(u32 offset = 0; offset < count; offset++) {
+        auto& memory_object = object_refs[region_offset + offset];
+        auto& comments = memory_object->comments;
+        if(!comments.eol && !comments.pre && !comments.post
+           && memory_object->blank_lines == 0 && memory_object->default_blank_line) continue;
+
+        for(auto comment : { &comments.eol, &comments.pre, &comments.post }) {
+            if(*comment) (*comment)->ClearReferences();
+            *comment = nullptr;
+        }
+        memory_object->blank_lines = 0;
+        memory_object->default_blank_line = true;
+        _UpdateMemoryObject(memory_object, region_offset + offset);
+    }
+
+    // and rebuild the captured objects on top
+    for(auto const& state : states) {
+        GlobalMemoryLocation where = start + state.offset;
+
+        switch(state.type) {
+        case MemoryObject::TYPE_UNDEFINED:
+            break;
+        case MemoryObject::TYPE_BYTE:
+            MarkMemoryAsBytes(where, state.size);
+            break;
+        case MemoryObject::TYPE_WORD:
+            MarkMemoryAsWords(where, state.size);
+            break;
+        case MemoryObject::TYPE_CODE:
+            MarkMemoryAsCode(where);
+            break;
+        case MemoryObject::TYPE_STRING:
+            MarkMemoryAsString(where, state.size);
+            break;
+        case MemoryObject::TYPE_ENUM:
+            MarkMemoryAsEnum(where, state.size, state.enum_type);
+            break;
+        }
+
+        if(state.operand_expression) SetOperandExpression(where, state.operand_expression);
+
+        for(int type = MemoryObject::COMMENT_TYPE_EOL; type <= MemoryObject::COMMENT_TYPE_POST; type++) {
+            if(state.comments[type]) SetComment(where, (MemoryObject::COMMENT_TYPE)type, state.comments[type]);
+        }
+
+        auto memory_object = GetMemoryObject(where);
+        memory_object->blank_lines = state.blank_lines;
+        memory_object->default_blank_line = state.default_blank_line;
+        UpdateMemoryObject(where);
+    }
+
+    MarkEdited();
+}
+
 // to mark data as undefined, we just delete the current node and recreate new bytes in its place
 bool MemoryRegion::MarkMemoryAsUndefined(GlobalMemoryLocation const& where, u32 byte_count)
 {
+    EditScope edit_scope(this, where, byte_count, "Mark as undefined");
+
     for(u32 offset = 0; offset < byte_count;) {
         auto memory_object = GetMemoryObject(where + offset);
         assert(memory_object);
@@ -448,6 +612,8 @@ bool MemoryRegion::MarkMemoryAsUndefined(GlobalMemoryLocation const& where, u32
 
 bool MemoryRegion::MarkMemoryAsBytes(GlobalMemoryLocation const& where, u32 byte_count)
 {
+    EditScope edit_scope(this, where, byte_count, "Mark as bytes");
+
     // Check to see if all selected memory is undefined. other data cannot be converted
     for(u32 i = 0; i < byte_count; i++) {
         auto memory_object = GetMemoryObject(where + i);
@@ -484,6 +650,8 @@ bool MemoryRegion::MarkMemoryAsWords(GlobalMemoryLocation const& where, u32 byte
     // Round up
     if((byte_count % 2) == 1) byte_count++;
 
+    EditScope edit_scope(this, where, byte_count, "Mark as words");
+
     // Check to see if all selected memory is undefined. other data cannot be converted
     for(u32 i = 0; i < byte_count; i += 2) {
         auto memory_object = GetMemoryObject(where + i);
@@ -546,6 +714,8 @@ bool MemoryRegion::MarkMemoryAsCode(GlobalMemoryLocation const& where)
     assert(inst->backed);
     int instruction_size = disassembler->GetInstructionSize(*inst->data_ptr);
 
+    EditScope edit_scope(this, where, instruction_size, "Mark as code");
+
     // Check to see if all selected memory can be converted
     // opcode and operands must be TYPE_UNDEFINED to convert
     for(u32 i = 0; i < instruction_size; i++) {
@@ -580,6 +750,8 @@ bool MemoryRegion::MarkMemoryAsCode(GlobalMemoryLocation const& where)
 
 bool MemoryRegion::MarkMemoryAsString(GlobalMemoryLocation const& where, u32 byte_count)
 {
+    EditScope edit_scope(this, where, byte_count, "Mark as string");
+
     // Check to see if all selected memory can be converted
     for(u32 i = 0; i < byte_count; i++) {
         auto memory_object = GetMemoryObject(where + i);
@@ -617,6 +789,9 @@ bool MemoryRegion::MarkMemoryAsEnum(GlobalMemoryLocation const& where, u32 byte_
 {
     int enum_size = enum_type->GetSize();
 
+    // the last element can run past byte_count
+    EditScope edit_scope(this, where, ((byte_count + enum_size - 1) / enum_size) * enum_size, "Mark as enum");
+
     // Check to see if all selected memory is undefined. other data cannot be converted
     for(int loop = 0; loop < 2; loop++) {
         for(u32 i = 0; i < byte_count; i += enum_size) {
@@ -669,10 +844,14 @@ bool MemoryRegion::MarkMemoryAsEnum(GlobalMemoryLocation const& where, u32 byte_
 
 void MemoryRegion::SetOperandExpression(GlobalMemoryLocation const& where, std::shared_ptr<Expression> const& expr)
 {
+    EditScope edit_scope(this, where, 1, "Set operand expression");
+
     if(auto memory_object = GetMemoryObject(where)) {
         memory_object->RemoveReferences(where); // clear any references the previous operand expression referred to
         memory_object->operand_expression = expr;
         memory_object->NoteReferences(where);   // mark the new ones
+        memory_object->InvalidateFormatCache();
+        MarkEdited();
     }
 }
 
@@ -799,6 +978,8 @@ void MemoryRegion::NextLabelReference(GlobalMemoryLocation const& where)
 {
     if(auto memory_object = GetMemoryObject(where)) {
         memory_object->NextLabelReference(where);
+        memory_object->InvalidateFormatCache();
+        MarkEdited();
     }
 }
 
@@ -1297,6 +1478,53 @@ string MemoryObject::FormatOperandField(u32 /* internal_offset */, shared_ptr<Di
     return ss.str();
 }
 
+string MemoryObject::FormatRawBytes()
+{
+    int objsize = GetSize();
+    stringstream ss;
+    ss << hex << setfill('0') << uppercase;
+    for(int i = 0; i < objsize; i++) {
+        if(backed) {
+            int bval = (int)data_ptr[i];
+            ss << setw(2) << bval;
+        } else {
+            ss << "??";
+        }
+        if(i != (objsize - 1)) ss << " ";
+    }
+
+    return ss.str();
+}
+
+void MemoryObject::UpdateFormatCache(shared_ptr<Disassembler> const& disassembler)
+{
+    auto generation = BaseSystem::GetFormatGeneration();
+    if(format_cache.generation == generation) return;
+
+    format_cache.instruction = FormatInstructionField(disassembler);
+    format_cache.operand     = FormatOperandField(0, disassembler);
+    format_cache.raw_bytes   = FormatRawBytes();
+    format_cache.generation  = generation;
+}
+
+string const& MemoryObject::GetCachedInstructionField(shared_ptr<Disassembler> const& disassembler)
+{
+    UpdateFormatCache(disassembler);
+    return format_cache.instruction;
+}
+
+string const& MemoryObject::GetCachedOperandField(shared_ptr<Disassembler> const& disassembler)
+{
+    UpdateFormatCache(disassembler);
+    return format_cache.operand;
+}
+
+string const& MemoryObject::GetCachedRawBytes(shared_ptr<Disassembler> const& disassembler)
+{
+    UpdateFormatCache(disassembler);
+    return format_cache.raw_bytes;
+}
+
 bool MemoryObject::Save(std::ostream& os, std::string& errmsg)
 {
     // save type and if there's data
@@ -1579,6 +1807,8 @@ bool MemoryRegion::Load(GlobalMemoryLocation const& base, std::istream& is, std:
 
 void MemoryRegion::SetComment(GlobalMemoryLocation const& where, MemoryObject::COMMENT_TYPE type, 
                 shared_ptr<BaseComment> const& comment) {
+    EditScope edit_scope(this, where, 1, "Set comment");
+
     if(auto memory_object = GetMemoryObject(where)) {
         memory_object->SetComment(type, comment);
         // TODO when GlobalMemoryLocation is no longer part of Systems::NES
@@ -1591,6 +1821,8 @@ void MemoryRegion::SetComment(GlobalMemoryLocation const& where, MemoryObject::C
 
 void MemoryRegion::AddBlankLine(GlobalMemoryLocation const& where)
 {
+    EditScope edit_scope(this, where, 1, "Add blank line");
+
     if(auto memory_object = GetMemoryObject(where)) {
         memory_object->blank_lines++;
         memory_object->default_blank_line = false;
@@ -1600,6 +1832,8 @@ void MemoryRegion::AddBlankLine(GlobalMemoryLocation const& where)
 
 void MemoryRegion::RemoveBlankLine(GlobalMemoryLocation const& where)
 {
+    EditScope edit_scope(this, where, 1, "Remove blank line");
+
     if(auto memory_object = GetMemoryObject(where)) {
         if(memory_object->blank_lines > 0) {
             memory_object->blank_lines--;
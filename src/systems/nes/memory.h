@@ -5,6 +5,7 @@
 // LICENSE file in the root directory of this source tree. 
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #ifdef ERROR
 #  undef ERROR
@@ -226,6 +227,13 @@ struct MemoryObject {
 
     std::string FormatInstructionField(std::shared_ptr<Disassembler> disassembler = nullptr);
     std::string FormatOperandField(u32 = 0, std::shared_ptr<Disassembler> disassembler = nullptr);
+    std::string FormatRawBytes();
+
+    // cached versions of the above, used by the listing every frame
+    std::string const& GetCachedInstructionField(std::shared_ptr<Disassembler> const&);
+    std::string const& GetCachedOperandField(std::shared_ptr<Disassembler> const&);
+    std::string const& GetCachedRawBytes(std::shared_ptr<Disassembler> const&);
+    void InvalidateFormatCache() { format_cache.generation = 0; }
 
     std::shared_ptr<BaseComment> GetComment(COMMENT_TYPE type) const {
         switch(type) {
@@ -251,6 +259,16 @@ struct MemoryObject {
     bool Load(std::istream&, std::string&);
 
 private:
+    // formatted text is valid as long as generation matches BaseSystem::GetFormatGeneration()
+    struct {
+        u64 generation = 0;
+        std::string instruction;
+        std::string operand;
+        std::string raw_bytes;
+    } format_cache;
+
+    void UpdateFormatCache(std::shared_ptr<Disassembler> const&);
+
     void ClearReferencesToLabels(GlobalMemoryLocation const& where);
     void NextLabelReference(GlobalMemoryLocation const& where);
     int  DeleteLabel(std::shared_ptr<Label> const&); // call MemoryRegion::DeleteLabel
@@ -333,6 +351,9 @@ public:
     inline void Copy(u8* dest, int offset, int size) {
         memcpy(dest, flat_memory + ConvertToRegionOffset(offset), size);
     }
+    inline u8 const* GetDataPointer(int offset) {
+        return flat_memory + ConvertToRegionOffset(offset);
+    }
 
     // Labels
     void ApplyLabel(std::shared_ptr<Label>&);
@@ -370,6 +391,33 @@ public:
     // References
     void NoteReferences(GlobalMemoryLocation const&);
 
+    // Incremented on every change to the region's content, so that saving can skip regions
+    // that haven't changed since they were last written
+    u64  GetEditGeneration() const { return edit_generation; }
+    void MarkEdited() { edit_generation++; }
+
+    // Undo support. ObjectState is everything about a MemoryObject that an edit can change. Plain
+    // undefined bytes aren't captured, so a capture only costs memory for the objects that have content
+    struct ObjectState {
+        u32                          offset;      // from the start of the captured range
+        u32                          size;
+        MemoryObject::TYPE           type;
+        std::shared_ptr<Enum>        enum_type;   // TYPE_ENUM only
+        std::shared_ptr<Expression>  operand_expression;
+        std::shared_ptr<BaseComment> comments[3]; // indexed by MemoryObject::COMMENT_TYPE
+        int                          blank_lines;
+        bool                         default_blank_line;
+
+        bool operator==(ObjectState const&) const = default;
+    };
+
+    // Widen a range so that it starts and ends on object boundaries
+    void GetObjectRange(GlobalMemoryLocation const& where, u32 byte_count, GlobalMemoryLocation* start, u32* count);
+    void CaptureObjectStates(GlobalMemoryLocation const& start, u32 count, std::vector<ObjectState>&);
+
+    // Rebuild only the objects in the range so that they match a previous capture
+    void RestoreObjectStates(GlobalMemoryLocation const& start, u32 count, std::vector<ObjectState> const&);
+
     // Load and save
     virtual bool Save(std::ostream&, std::string&);
     virtual bool Load(GlobalMemoryLocation const&, std::istream&, std::string&);
@@ -383,6 +431,11 @@ private:
     std::string name;
     u8* flat_memory = nullptr;
 
+    std::atomic<u64> edit_generation = 0;
+
+    // records the edit in the system journal when the edit function returns
+    struct EditScope;
+
     void Erase();
 
     // We need a list of all memory addresses pointing to objects
@@ -489,6 +542,9 @@ public:
     // save/load
     virtual bool Save(std::ostream&, std::string&) const { return true; }
     virtual bool Load(std::istream&, std::string&)       { return true; }
+
+    // copy the mutable state of another view of the same kind, i.e., when forking a running machine
+    virtual void CopyState(MemoryView const&) {}
 };
 
 } // namespace Systems::NES
@@ -0,0 +1,366 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <sstream>
+
+#include "compression.h"
+
+#include "systems/nes/apu_io.h"
+#include "systems/nes/cartridge.h"
+#include "systems/nes/machine.h"
+#include "systems/nes/memory.h"
+#include "systems/nes/movie.h"
+#include "systems/nes/system.h"
+
+using namespace std;
+
+// FNV-1a
+#define HASH_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define HASH_PRIME        0x00000100000001B3ULL
+
+namespace Systems::NES {
+
+Movie::Movie()
+{
+}
+
+Movie::~Movie()
+{
+    Stop();
+}
+
+Movie::Movie(Movie const& other)
+    : start_state(other.start_state), rom_hash(other.rom_hash), inputs(other.inputs), 
+      hash_interval(other.hash_interval), hashes(other.hashes)
+{
+}
+
+bool Movie::StartRecording(Machine& _machine, int _hash_interval, string& errmsg)
+{
+    Stop();
+
+    stringstream ss;
+    if(!_machine.SaveState(ss, errmsg)) return false;
+    start_state = ss.str();
+    rom_hash = HashROM(_machine);
+
+    inputs.clear();
+    hashes.clear();
+    hash_interval  = max(1, _hash_interval);
+    running_hash   = HASH_OFFSET_BASIS;
+    frame          = 0;
+    diverged_frame = 0;
+
+    Attach(_machine);
+    mode = MODE::RECORDING;
+
+    cout << "[Movie::StartRecording] recording with a state hash every " << dec << hash_interval << " frame(s)" << endl;
+    return true;
+}
+
+bool Movie::StartPlayback(Machine& _machine, string& errmsg)
+{
+    Stop();
+    if(!CheckROM(_machine, errmsg)) return false;
+
+    // a state that fails part way through loading would leave the machine half loaded, so it's loaded
+    // into a scratch machine first
+    auto scratch = make_shared<Machine>(_machine.GetSystem(), true);
+    MemoryInputStream is((u8 const*)start_state.data(), start_state.size());
+    if(!scratch->LoadState(is, errmsg)) return false;
+    _machine.CopyState(*scratch);
+
+    BeginPlayback(_machine);
+    return true;
+}
+
+bool Movie::CheckROM(Machine& _machine, string& errmsg) const
+{
+    if(rom_hash && rom_hash != HashROM(_machine)) {
+        errmsg = "Movie was recorded on a different ROM";
+        return false;
+    }
+    return true;
+}
+
+void Movie::BeginPlayback(Machine& _machine)
+{
+    running_hash   = HASH_OFFSET_BASIS;
+    frame          = 0;
+    diverged_frame = 0;
+
+    Attach(_machine);
+    mode = MODE::PLAYING;
+}
+
+void Movie::Stop()
+{
+    if(machine) {
+        machine->GetAPUIO()->SetLatchFunction(nullptr);
+        machine->SetFrameFunction(nullptr);
+        machine = nullptr;
+    }
+
+    mode = MODE::IDLE;
+}
+
+bool Movie::Verify(Machine& _machine, string& errmsg, atomic<bool> const* cancel)
+{
+    // the machine is only used for this, so a state that fails to load can go straight into it. that 
+    // also keeps machines (and their memory views) from being created on the verifying thread
+    Stop();
+    if(!CheckROM(_machine, errmsg)) return false;
+
+    MemoryInputStream is((u8 const*)start_state.data(), start_state.size());
+    if(!_machine.LoadState(is, errmsg)) return false;
+    BeginPlayback(_machine);
+
+    while(mode == MODE::PLAYING && !HasDiverged()) {
+        if(cancel && cancel->load(memory_order_relaxed)) {
+            errmsg = "Verification was canceled";
+            Stop();
+            return false;
+        }
+
+        if(!_machine.RunFrame()) {
+            stringstream ss;
+            ss << "CPU crashed on frame " << frame;
+            errmsg = ss.str();
+            Stop();
+            return false;
+        }
+    }
+
+    Stop();
+
+    if(HasDiverged()) {
+        stringstream ss;
+        ss << "Machine state differs from the recording by frame " << diverged_frame;
+        errmsg = ss.str();
+        return false;
+    }
+
+    return true;
+}
+
+void Movie::Attach(Machine& _machine)
+{
+    machine = &_machine;
+    machine->GetAPUIO()->SetLatchFunction(std::bind(&Movie::Latch, this, placeholders::_1, placeholders::_2));
+    machine->SetFrameFunction(std::bind(&Movie::FrameCompleted, this, placeholders::_1));
+}
+
+void Movie::Latch(u8& joy1, u8& joy2)
+{
+    u64 f = frame;
+
+    switch(mode) {
+    case MODE::RECORDING:
+        // the first strobe in a frame decides the buttons for the whole frame, so any later strobes
+        // see the same buttons both now and on playback
+        if(f == inputs.size()) {
+            inputs.push_back((u16)joy1 | ((u16)joy2 << 8));
+            break;
+        }
+        [[fallthrough]];
+
+    case MODE::PLAYING:
+        if(f < inputs.size()) {
+            joy1 = (u8)(inputs[f] & 0xFF);
+            joy2 = (u8)(inputs[f] >> 8);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Movie::FrameCompleted(Machine& _machine)
+{
+    auto current_mode = mode.load();
+    if(current_mode == MODE::IDLE) return;
+
+    // frames where the game never read the joypads hold the previous buttons
+    if(current_mode == MODE::RECORDING && inputs.size() <= frame) {
+        inputs.push_back(inputs.size() ? inputs.back() : 0);
+    }
+
+    u64 f = ++frame;
+
+    if((f % hash_interval) == 0) {
+        running_hash = HashMachine(_machine, running_hash);
+
+        if(current_mode == MODE::RECORDING) {
+            hashes.push_back(running_hash);
+        } else {
+            u64 index = f / hash_interval - 1;
+            if(index < hashes.size() && hashes[index] != running_hash && !diverged_frame) {
+                diverged_frame = f;
+                cout << "[Movie::FrameCompleted] playback diverged from the recording by frame " << dec << f << endl;
+            }
+        }
+    }
+
+    if(current_mode == MODE::PLAYING && f >= inputs.size()) {
+        // leave the callbacks attached, they can't be removed from inside one
+        mode = MODE::IDLE;
+        cout << "[Movie::FrameCompleted] playback finished after " << dec << f << " frame(s)" << endl;
+    }
+}
+
+u64 Movie::HashMachine(Machine& _machine, u64 seed) const
+{
+    u64 hash = seed;
+    auto mix = [&hash](u8 v) {
+        hash = (hash ^ v) * HASH_PRIME;
+    };
+
+    auto& memory_view = _machine.GetMemoryView();
+    for(u16 address = 0; address < 0x800; address++) mix(memory_view->Peek(address));
+
+    // the visible 240 lines of the frame
+    auto framebuffer = (u8 const*)_machine.GetFramebuffer();
+    for(int i = 0; i < 256 * 240 * 4; i++) mix(framebuffer[i]);
+
+    return hash;
+}
+
+// the ROM never changes, so this is only needed when recording or playback starts
+u64 Movie::HashROM(Machine& _machine)
+{
+    u64 hash = HASH_OFFSET_BASIS;
+    auto mix = [&hash](u8 const* data, u32 size) {
+        for(u32 i = 0; i < size; i++) hash = (hash ^ data[i]) * HASH_PRIME;
+    };
+
+    auto& cartridge = _machine.GetSystem()->GetCartridge();
+    u8 mapper = cartridge->header.mapper;
+    mix(&mapper, 1);
+
+    for(int i = 0; i < cartridge->header.num_prg_rom_banks; i++) {
+        auto& bank = cartridge->GetProgramRomBank(i);
+        mix(bank->GetDataPointer(bank->GetBaseAddress()), bank->GetRegionSize());
+    }
+
+    for(int i = 0; i < cartridge->GetNumCharacterRomBanks(); i++) {
+        auto& bank = cartridge->GetCharacterRomBank(i);
+        mix(bank->GetDataPointer(bank->GetBaseAddress()), bank->GetRegionSize());
+    }
+
+    return hash;
+}
+
+bool Movie::Save(ostream& os, string& errmsg) const
+{
+    u64 magic = MOVIE_FILE_MAGIC;
+    os.write((char*)&magic, sizeof(magic));
+    WriteVarInt(os, MOVIE_FILE_VERSION);
+
+    WriteVarInt(os, hash_interval);
+    os.write((char*)&rom_hash, sizeof(rom_hash));
+
+    // the starting state, compressed the same way as save states
+    WriteVarInt(os, (u32)start_state.size());
+    string compressed;
+    if(CompressBlock((u8 const*)start_state.data(), (u32)start_state.size(), compressed)) {
+        WriteVarInt(os, (u32)compressed.size());
+        os.write(compressed.data(), compressed.size());
+    } else {
+        WriteVarInt(os, (u32)0);
+        os.write(start_state.data(), start_state.size());
+    }
+
+    // buttons rarely change from one frame to the next, so store them as runs
+    WriteVarInt(os, (u64)inputs.size());
+    for(size_t i = 0; i < inputs.size(); ) {
+        size_t run = 1;
+        while(i + run < inputs.size() && inputs[i + run] == inputs[i]) run++;
+        WriteVarInt(os, (u64)run);
+        WriteVarInt(os, inputs[i]);
+        i += run;
+    }
+
+    WriteVarInt(os, (u64)hashes.size());
+    for(auto& hash : hashes) os.write((char*)&hash, sizeof(hash));
+
+    errmsg = "Error saving Movie";
+    return os.good();
+}
+
+bool Movie::Load(istream& is, string& errmsg)
+{
+    Stop();
+
+    u64 magic;
+    is.read((char*)&magic, sizeof(magic));
+    if(!is.good() || magic != MOVIE_FILE_MAGIC) {
+        errmsg = "Not a movie file";
+        return false;
+    }
+
+    // movie files don't depend on the project file version
+    auto last_readvarint_version = util_readvarint_version;
+    util_readvarint_version = UTIL_READVARINT_VERSION2;
+
+    bool ret = false;
+    u32 start_state_size, compressed_size;
+    u64 count;
+
+    int version = ReadVarInt<int>(is);
+    if(version < 1 || version > MOVIE_FILE_VERSION) {
+        errmsg = "Unsupported movie file version";
+        goto done;
+    }
+
+    hash_interval = max(1, ReadVarInt<int>(is));
+
+    rom_hash = 0;
+    if(version >= 2) is.read((char*)&rom_hash, sizeof(rom_hash));
+
+    start_state_size = ReadVarInt<u32>(is);
+    compressed_size = ReadVarInt<u32>(is);
+    start_state.resize(start_state_size);
+    if(compressed_size) {
+        string compressed(compressed_size, '\0');
+        is.read(compressed.data(), compressed_size);
+        if(!is.good() || !DecompressBlock((u8 const*)compressed.data(), compressed_size, (u8*)start_state.data(), start_state_size)) {
+            errmsg = "Error decompressing movie state";
+            goto done;
+        }
+    } else {
+        is.read(start_state.data(), start_state_size);
+    }
+
+    inputs.clear();
+    count = ReadVarInt<u64>(is);
+    while(inputs.size() < count && is.good()) {
+        u64 run = ReadVarInt<u64>(is);
+        u16 buttons = ReadVarInt<u16>(is);
+        if(run == 0 || inputs.size() + run > count) {
+            errmsg = "Invalid movie input data";
+            goto done;
+        }
+        inputs.insert(inputs.end(), run, buttons);
+    }
+
+    count = ReadVarInt<u64>(is);
+    if(count > inputs.size()) {
+        errmsg = "Invalid movie hash data";
+        goto done;
+    }
+
+    hashes.resize(count);
+    for(auto& hash : hashes) is.read((char*)&hash, sizeof(hash));
+
+    errmsg = "Error loading Movie";
+    ret = is.good();
+
+done:
+    util_readvarint_version = last_readvarint_version;
+    return ret;
+}
+
+}
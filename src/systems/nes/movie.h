@@ -0,0 +1,97 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+#define MOVIE_FILE_MAGIC   0x8781A90AFDE1F318ULL
+#define MOVIE_FILE_VERSION 2   // 2 added the ROM hash
+
+namespace Systems::NES {
+
+class Machine;
+
+// Movie is a recording of the joypads for every frame, starting from a saved machine state. Buttons
+// are captured (and replayed) when the game strobes the joypads, not when keys are pressed, so
+// playback is exact no matter how fast it runs or what thread it runs on.
+//
+// Every hash_interval frames the RAM and framebuffer are hashed into a running hash. Playback compares
+// against the recorded hashes and notes the first frame that doesn't match. The PRG and CHR ROM are
+// hashed when recording starts too, so a movie won't play back on a different ROM.
+//
+// A movie is attached to one Machine at a time, and its callbacks run on that machine's thread.
+class Movie {
+public:
+    enum class MODE {
+        IDLE,
+        RECORDING,
+        PLAYING
+    };
+
+    Movie();
+    ~Movie();
+
+    // Copies only the recording. The copy is idle and not attached to any machine
+    Movie(Movie const&);
+
+    // Recording starts from the machine's current state, which becomes part of the movie
+    bool StartRecording(Machine&, int hash_interval, std::string& errmsg);
+
+    // Playback loads the movie's starting state into the machine. Movie files are untrusted, so the ROM
+    // and the state are checked first, and the machine is left untouched if either is wrong
+    bool StartPlayback(Machine&, std::string& errmsg);
+
+    // Detach from the machine. The machine must not be running
+    void Stop();
+
+    // Play the whole movie as fast as possible on a machine that isn't being run by anyone else (i.e., a
+    // headless fork on a worker thread). Returns false if the machine state ever differs from the recording,
+    // or if cancel is set before it's done
+    bool Verify(Machine&, std::string& errmsg, std::atomic<bool> const* cancel = nullptr);
+
+    MODE GetMode()          const { return mode; }
+    u64  GetFrame()         const { return frame; }
+    u64  GetLength()        const { return inputs.size(); }
+    bool HasDiverged()      const { return diverged_frame != 0; }
+    u64  GetDivergedFrame() const { return diverged_frame; }
+
+    bool Save(std::ostream&, std::string&) const;
+    bool Load(std::istream&, std::string&);
+
+private:
+    bool CheckROM(Machine&, std::string& errmsg) const;
+    void BeginPlayback(Machine&);
+    void Attach(Machine&);
+    void Latch(u8& joy1, u8& joy2);
+    void FrameCompleted(Machine&);
+    u64  HashMachine(Machine&, u64 seed) const;
+    static u64 HashROM(Machine&);
+
+    Machine*             machine = nullptr;
+    std::atomic<MODE>    mode = MODE::IDLE;
+
+    // machine state the movie starts from, and the ROM it was recorded on. 0 if unknown (version 1 files)
+    std::string          start_state;
+    u64                  rom_hash = 0;
+
+    // joypads for every frame, joy1 in the low byte and joy2 in the high byte
+    std::vector<u16>     inputs;
+
+    // running hash after every hash_interval frames
+    int                  hash_interval = 60;
+    std::vector<u64>     hashes;
+    u64                  running_hash = 0;
+
+    std::atomic<u64>     frame = 0;
+    std::atomic<u64>     diverged_frame = 0; // frame count when the hashes first differed, 0 if they haven't
+};
+
+}
@@ -117,6 +117,7 @@ public:
             break;
 
         case 0x02: // PPUSTAT
+            if(ppu->register_func) ppu->register_func(reg, 0, false);
             ret = ppu->ppustat;
             ppu->vblank = 0;
             ppu->nmi(0);
@@ -134,6 +135,7 @@ public:
             break;
 
         case 0x07: // PPUDATA
+            if(ppu->register_func) ppu->register_func(reg, 0, false);
             ret = ppu->vram_read_buffer;
             ppu->vram_read_buffer = ReadPPU(ppu->vram_address_v & 0x3FFF);
             // TODO there's a technicality here when reading palettes. 
@@ -158,6 +160,8 @@ public:
         latch_value = value;
 
         u16 reg = address & 0x07;
+        if(ppu->register_func) ppu->register_func(reg, value, true);
+
         switch(reg) {
         case 0x00: // PPUCONT
             // if the PPU is currentinly in vblank (and the PPUSTAT vblank flag is still set to 1),
@@ -195,6 +199,7 @@ public:
             }
             ppu->primary_oam[ppu->primary_oam_address] = value;
             ppu->primary_oam_address += 1;
+            ppu->oam_generation++;
             break;
 
         case 0x05: // PPUSCRL write x2
@@ -268,6 +273,7 @@ public:
                 palette_index &= ~0x10;
             }
             ppu->palette_ram[palette_index] = value;
+            ppu->palette_generation++;
         } else {
             ppu->Write(address, value);
         }
@@ -288,6 +294,10 @@ public:
         return is.good();
     }
 
+    void CopyState(MemoryView const& other) override {
+        latch_value = dynamic_cast<PPUView const&>(other).latch_value;
+    }
+
 private:
     shared_ptr<PPU> ppu;
     u8              latch_value;
@@ -296,6 +306,9 @@ private:
 PPU::PPU(nmi_function_t const& nmi_function, read_func_t const& peek_func, read_func_t const& read_func, write_func_t const& write_func)
     : nmi(nmi_function), Peek(peek_func), Read(read_func), Write(write_func)
 {
+    // until SetFetchPages is called, every fetch goes through Read
+    static u8 const* const no_fetch_pages[16] = {};
+    fetch_pages = no_fetch_pages;
 }
 
 PPU::~PPU()
@@ -319,6 +332,19 @@ void PPU::Reset()
     prevent_nmi_this_frame = false;
 }
 
+void PPU::WriteOAMPage(u8 const* page)
+{
+    // the same as 256 writes to OAMDATA, which ends with OAMADDR where it started
+    if(register_func) {
+        for(int i = 0; i < 0x100; i++) register_func(0x04, page[i], true);
+    }
+
+    int first = 0x100 - primary_oam_address;
+    memcpy(&primary_oam[primary_oam_address], &page[0], first);
+    memcpy(&primary_oam[0], &page[first], 0x100 - first);
+    oam_generation++;
+}
+
 shared_ptr<MemoryView> PPU::CreateMemoryView()
 {
     return make_shared<PPUView>(shared_from_this());
@@ -326,10 +352,13 @@ shared_ptr<MemoryView> PPU::CreateMemoryView()
 
 int PPU::Step(bool& hblank_out, bool& vblank_out)
 {
+    dot_count++;
+
     // used throughout
     rendering_enabled = show_background || show_sprites;
 
-    int color = 0;
+    // pixels outside of cycles 1..256 come out black (palette index $0F)
+    int color = 0x0F;
 
     // external wires for this particular pixel
     vblank_out = (scanline >= 240);
@@ -434,13 +463,17 @@ int PPU::Step(bool& hblank_out, bool& vblank_out)
 
 int PPU::InternalStep(bool sprite_fetch)
 {
-    // if rendering is disabled nothing in this substep matters
-    if(!rendering_enabled) return 0;
+    // if rendering is disabled nothing in this substep matters, and the pixel is black
+    if(!rendering_enabled) return 0x0F;
+
+    // when only keeping time, pixels are still needed wherever sprite 0 hit can happen. From cycle 257 on,
+    // the fetches are for the next line
+    bool pixels = !timing_only || (!sprite0_hit && (cycle < 257 ? sprite_zero_present : sprite_zero_next_present));
 
     // phase 1 needs the shift register fully shifted 8 times
     // shift registers start shifting at cycle 2, and the first latch of the shift register happens at cycle 9
     // so we can be sure (at cycles 2, 3, 4, 5, 6, 7, 8, and 9) 8 bits are shifted out before the latch at cycle 9
-    if(cycle >= 2 && cycle <= 337) Shift();
+    if(pixels && cycle >= 2 && cycle <= 337) Shift();
 
     // Look over OAM and prepare sprites
     EvaluateSprites();
@@ -465,7 +498,7 @@ int PPU::InternalStep(bool sprite_fetch)
 
     case 2:
         // latch NT byte
-        nametable_latch = Read(vram_address);
+        if(pixels) nametable_latch = Fetch(vram_address);
         break;
 
     case 3:
@@ -489,7 +522,7 @@ int PPU::InternalStep(bool sprite_fetch)
 
     case 4:
         // latch attribute byte
-        attribute_latch = Read(vram_address);
+        if(pixels) attribute_latch = Fetch(vram_address);
         break;
 
     case 5:
@@ -505,9 +538,9 @@ int PPU::InternalStep(bool sprite_fetch)
         // latch lsbits tile byte
         if(sprite_fetch) {
             int sprite = (secondary_oam_address >> 2) - 1; // secondary_oam_address is pointing to the next sprite at this point
-            sprite_lsbits[sprite] = Read(vram_address);
+            if(pixels) sprite_lsbits[sprite] = Fetch(vram_address);
         } else {
-            background_lsbits_latch = Read(vram_address);
+            if(pixels) background_lsbits_latch = Fetch(vram_address);
         }
         break;
 
@@ -520,9 +553,9 @@ int PPU::InternalStep(bool sprite_fetch)
         // latch msbits tile byte
         if(sprite_fetch) {
             int sprite = (secondary_oam_address >> 2) - 1; // secondary_oam_address is pointing to the next sprite at this point
-            sprite_msbits[sprite] = Read(vram_address);
+            if(pixels) sprite_msbits[sprite] = Fetch(vram_address);
         } else {
-            background_msbits_latch = Read(vram_address);
+            if(pixels) background_msbits_latch = Fetch(vram_address);
 
             // increment 1 tile in X and wrap to the next nametable
             if((vram_address_v & 0x1F) == 0x1F) { // check wrap X to the horizontal nametable
@@ -535,7 +568,7 @@ int PPU::InternalStep(bool sprite_fetch)
         break;
     }
 
-    return DeterminePixel();
+    return pixels ? DeterminePixel() : 0x0F;
 }
 
 void PPU::Shift()
@@ -769,7 +802,8 @@ int PPU::DeterminePixel()
         if(sprite_zero_present && (sprite == 0) && (tile_color != 0)) sprite_zero_hit_buffer = 1;
     } 
 
-    return rgb_palette_map[mux_color];
+    // the palette index. Machine turns it into color for the whole frame at once
+    return mux_color;
 }
 
 // DeterminePixel has no side effects
@@ -942,9 +976,41 @@ bool PPU::Load(istream& is, string& errmsg)
 
     is.read((char*)palette_ram, sizeof(palette_ram));
 
+    palette_generation++;
+    oam_generation++;
+
     errmsg = "Error loading PPU";
     return is.good();
 }
 
+void PPU::CopyState(PPU const& other)
+{
+    // everything except the functions, fetch pages and mode is plain state, so copy the whole object
+    // and put back the connections to this PPU's own machine
+    auto _nmi = move(nmi);
+    auto _peek = move(Peek);
+    auto _read = move(Read);
+    auto _write = move(Write);
+    auto _register_func = move(register_func);
+    auto _fetch_pages = fetch_pages;
+    auto _timing_only = timing_only;
+    auto _palette_generation = palette_generation;
+    auto _oam_generation = oam_generation;
+
+    *this = other;
+
+    nmi = move(_nmi);
+    Peek = move(_peek);
+    Read = move(_read);
+    Write = move(_write);
+    register_func = move(_register_func);
+    fetch_pages = _fetch_pages;
+    timing_only = _timing_only;
+
+    // the contents changed, but the generations have to keep moving forward
+    palette_generation = _palette_generation + 1;
+    oam_generation = _oam_generation + 1;
+}
+
 
 }
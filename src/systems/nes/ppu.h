@@ -40,24 +40,64 @@ public:
     inline u16 GetScrollX() const { return scroll_x; }
     inline u16 GetScrollY() const { return scroll_y; }
 
+    // incremented on every write to palette RAM and OAM, so viewers can tell when to redraw
+    inline u32 GetPaletteGeneration() const { return palette_generation; }
+    inline u32 GetOAMGeneration() const { return oam_generation; }
+
     inline void CopyOAM(u8* dest) {
         memcpy(dest, primary_oam, sizeof(primary_oam));
     }
 
+    // true when OAM can be replaced without the PPU noticing for the length of an OAM DMA (~4.5
+    // scanlines), i.e., rendering is off or it's early enough in vblank
+    inline bool IsOAMIdle() const {
+        return !(show_background || show_sprites) || (scanline >= 240 && scanline < 256);
+    }
+
+    // OAM DMA fast path: store a whole page starting at OAMADDR without moving OAMADDR. Each DMA write
+    // cycle then calls IncrementOAMAddress, so OAMADDR is always where the byte by byte copy would have it
+    void WriteOAMPage(u8 const* page);
+    inline void IncrementOAMAddress() { primary_oam_address += 1; }
+
     inline void CopyPaletteRAM(u8* dest, bool sprites) {
         memcpy(dest, sprites ? &palette_ram[0x10] : palette_ram, 0x10);
     }
 
-    // returns color, outputs true for either blanking period
+    // returns the pixel's palette index, outputs true for either blanking period
     int Step(bool& hblank_out, bool& vblank_out);
 
+    // While set, the PPU only keeps time: the flags, NMI, sprite evaluation and the address registers all
+    // work, but pixels are only fetched and mixed where sprite 0 hit can still happen. Other pixels are black
+    void SetTimingOnly(bool enable) { timing_only = enable; }
+
+    // Called with the register (0-7) and value of every register access that changes the PPU's state,
+    // i.e., all writes and reads of PPUSTAT and PPUDATA, so that another PPU can repeat them
+    typedef std::function<void(u16, u8, bool)> register_func_t;
+    void SetRegisterFunction(register_func_t const& func) { register_func = func; }
+
+    // the number of times Step has been called. It isn't saved
+    inline u64 GetDotCount() const { return dot_count; }
+
+    // The PPU bus as 16 1KiB pages ($0000-$3FFF) of direct pointers for the rendering fetches. A null page
+    // goes through the read function. The owner of the bus keeps it up to date as the mapping changes
+    void SetFetchPages(u8 const* const* pages) { fetch_pages = pages; }
+
     std::shared_ptr<MemoryView> CreateMemoryView();
 
     bool Save(std::ostream&, std::string&) const;
     bool Load(std::istream&, std::string&);
 
+    // copy all rendering state, but not the bus and NMI connections
+    void CopyState(PPU const&);
+
 private:
     int  InternalStep(bool);
+
+    inline u8 Fetch(u16 address) {
+        address &= 0x3FFF;
+        if(u8 const* page = fetch_pages[address >> 10]) return page[address & 0x3FF];
+        return Read(address);
+    }
     void Shift();
     void EvaluateSprites();
     int  DeterminePixel();
@@ -126,6 +166,10 @@ private:
     read_func_t Peek;
     read_func_t Read;
     write_func_t Write;
+    u8 const* const* fetch_pages;
+    register_func_t register_func;
+    bool timing_only = false;
+    u64 dot_count = 0;
 
     // internal counting registers
     int frame;
@@ -183,6 +227,9 @@ private:
     // palette RAM, 16 bytes for BG, 16 for OAM
     u8 palette_ram[0x20];
 
+    u32 palette_generation = 0;
+    u32 oam_generation = 0;
+
     friend class PPUView;
 };
 
@@ -0,0 +1,232 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <cassert>
+
+#include "systems/nes/cartridge.h"
+#include "systems/nes/machine.h"
+#include "systems/nes/memory.h"
+#include "systems/nes/ppu.h"
+#include "systems/nes/ppu_renderer.h"
+#include "systems/nes/system.h"
+
+using namespace std;
+
+namespace Systems::NES {
+
+PPURenderer::PPURenderer(Machine& _machine)
+    : machine(_machine)
+{
+    system_view = dynamic_pointer_cast<SystemView>(machine.GetMemoryView());
+    assert(system_view);
+
+    auto read = [this](u16 address)->u8 {
+        u8 const* page = pages[(address & 0x3FFF) >> 10];
+        return page ? page[address & 0x3FF] : 0;
+    };
+
+    ppu = make_shared<PPU>(
+        [](int) {}, // the machine's PPU has the NMI
+        read,
+        read,
+        [this](u16 address, u8 value)->void {
+            address &= 0x3FFF;
+            if(address >= 0x2000) {
+                vram[SystemView::GetNametableOffset(mirroring, address)] = value;
+            } else if(has_chr_ram) {
+                chr_ram[address] = value;
+            }
+        }
+    );
+
+    ppu_view = ppu->CreateMemoryView();
+    ppu->SetFetchPages(pages);
+
+    log.resize(PPU_RENDERER_LOG_SIZE);
+
+    Restart();
+    render_thread = make_shared<thread>(std::bind(&PPURenderer::RenderThread, this));
+}
+
+PPURenderer::~PPURenderer()
+{
+    exit_thread = true;
+    requests.fetch_add(1, memory_order_release);
+    requests.notify_one();
+
+    render_thread->join();
+}
+
+void PPURenderer::Restart()
+{
+    ppu->CopyState(*machine.GetPPU());
+    system_view->CopyVRAM(vram);
+
+    auto& cartridge_view = system_view->GetCartridgeView();
+    has_chr_ram = cartridge_view->HasCHRRAM();
+    if(has_chr_ram) {
+        cartridge_view->CopyPatterns(&chr_ram[0x0000], 0x0000, 0x1000);
+        cartridge_view->CopyPatterns(&chr_ram[0x1000], 0x1000, 0x1000);
+    }
+
+    u8 const* const* system_pages = system_view->GetPPUPages();
+    for(int page = 0; page < 8; page++) {
+        pages[page] = has_chr_ram ? &chr_ram[page << 10] : system_pages[page];
+    }
+    SetMirroring(cartridge_view->GetNametableMirroring());
+
+    // anything left in the log is already in the state copied above
+    log_head.store(0, memory_order_relaxed);
+    log_tail.store(0, memory_order_relaxed);
+
+    Advance(ppu->GetDotCount());
+}
+
+void PPURenderer::SetMirroring(MIRRORING _mirroring)
+{
+    mirroring = _mirroring;
+    for(int page = 8; page < 16; page++) {
+        pages[page] = &vram[SystemView::GetNametableOffset(mirroring, (page & 3) << 10)];
+    }
+}
+
+void PPURenderer::Push(LogEntry const& entry)
+{
+    u64 head = log_head.load(memory_order_relaxed);
+
+    u64 tail;
+    while(head - (tail = log_tail.load(memory_order_acquire)) == PPU_RENDERER_LOG_SIZE) {
+        // full, so let the render thread catch up to here
+        Advance(entry.dot);
+        log_tail.wait(tail, memory_order_acquire);
+    }
+
+    log[head & (PPU_RENDERER_LOG_SIZE - 1)] = entry;
+    log_head.store(head + 1, memory_order_release);
+}
+
+void PPURenderer::LogRegister(u64 dot, u16 reg, u8 value, bool write)
+{
+    Push({
+        .dot     = dot,
+        .page    = nullptr,
+        .address = reg,
+        .value   = value,
+        .type    = write ? LOG_REGISTER_WRITE : LOG_REGISTER_READ
+    });
+}
+
+void PPURenderer::LogMapping(u64 dot)
+{
+    Push({
+        .dot     = dot,
+        .page    = nullptr,
+        .address = 0,
+        .value   = (u8)system_view->GetCartridgeView()->GetNametableMirroring(),
+        .type    = LOG_MIRRORING
+    });
+
+    // CHR-RAM is never banked, and the render thread has its own copy
+    if(has_chr_ram) return;
+
+    u8 const* const* system_pages = system_view->GetPPUPages();
+    for(int page = 0; page < 8; page++) {
+        Push({
+            .dot     = dot,
+            .page    = system_pages[page],
+            .address = (u16)page,
+            .value   = 0,
+            .type    = LOG_CHR_PAGE
+        });
+    }
+}
+
+void PPURenderer::Apply(LogEntry const& entry)
+{
+    switch(entry.type) {
+    case LOG_REGISTER_WRITE:
+        ppu_view->Write(entry.address, entry.value);
+        break;
+
+    case LOG_REGISTER_READ:
+        ppu_view->Read(entry.address);
+        break;
+
+    case LOG_MIRRORING:
+        SetMirroring((MIRRORING)entry.value);
+        break;
+
+    case LOG_CHR_PAGE:
+        pages[entry.address] = entry.page;
+        break;
+    }
+}
+
+void PPURenderer::Advance(u64 dot)
+{
+    // only this thread makes requests, so there's no need for an atomic increment. Releasing progress
+    // means the render thread that reads it also sees everything logged before the dot
+    progress.store(dot, memory_order_release);
+    requests.store(requests.load(memory_order_relaxed) + 1, memory_order_release);
+    requests.notify_one();
+}
+
+void PPURenderer::Sync(u64 dot)
+{
+    Advance(dot);
+
+    // finishing the request also applied everything logged up to dot
+    u64 request = requests.load(memory_order_relaxed);
+    u64 last;
+    while((last = done.load(memory_order_acquire)) < request) done.wait(last, memory_order_acquire);
+}
+
+void PPURenderer::RenderThread()
+{
+    u64 request = requests.load(memory_order_acquire);
+    while(!exit_thread) {
+        Render(progress.load(memory_order_acquire));
+
+        done.store(request, memory_order_release);
+        done.notify_all();
+
+        requests.wait(request, memory_order_acquire);
+        request = requests.load(memory_order_acquire);
+    }
+}
+
+void PPURenderer::Render(u64 target)
+{
+    u64 head = log_head.load(memory_order_acquire);
+    u64 tail = log_tail.load(memory_order_relaxed);
+    u64 dot = ppu->GetDotCount();
+
+    while(true) {
+        // everything logged on this dot happened before the next step
+        while(tail != head) {
+            LogEntry const& entry = log[tail & (PPU_RENDERER_LOG_SIZE - 1)];
+            if(entry.dot > dot) break;
+            Apply(entry);
+            tail++;
+        }
+
+        if(dot >= target) break;
+
+        u64 stop = target;
+        if(tail != head) stop = min(stop, log[tail & (PPU_RENDERER_LOG_SIZE - 1)].dot);
+
+        for(; dot < stop; dot++) {
+            bool hblank, vblank;
+            int color = ppu->Step(hblank, vblank);
+            machine.Rasterize(ppu->GetPPUMASK(), color, hblank, vblank);
+        }
+    }
+
+    // the machine may be waiting for room in the log
+    log_tail.store(tail, memory_order_release);
+    log_tail.notify_one();
+}
+
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+#include "systems/nes/defs.h"
+
+// entries in the register log. Must be a power of 2
+#define PPU_RENDERER_LOG_SIZE 16384
+
+namespace Systems::NES {
+
+class Machine;
+class MemoryView;
+class PPU;
+class SystemView;
+
+// PPURenderer draws a Machine's frames on a second thread. The machine's own PPU only keeps time (see
+// PPU::SetTimingOnly), and logs every register access and cartridge mapping change with the dot it
+// happened on. The PPU here repeats them on the same dots, with its own copy of VRAM and CHR-RAM, and
+// draws through the machine's rasterizer.
+//
+// The log is a single producer, single consumer ring. Advance lets the render thread run up to a dot,
+// and it never gets ahead of that, so every access is seen at exactly the right time. Nothing drawn
+// here goes back to the CPU: sprite 0 hit is still found by the machine's PPU. All of the functions
+// are only called from the thread running the machine
+class PPURenderer {
+public:
+    PPURenderer(Machine&);
+    ~PPURenderer();
+
+    // the register log, stamped with the machine PPU's dot count
+    void LogRegister(u64 dot, u16 reg, u8 value, bool write);
+    void LogMapping(u64 dot);
+
+    // let the render thread draw everything before dot
+    void Advance(u64 dot);
+
+    // Advance and wait until it's done. Afterwards the render thread is idle until the next Advance,
+    // and the frame and this PPU are up to date
+    void Sync(u64 dot);
+
+    // Start over from the machine's current PPU, VRAM and CHR-RAM. Must be synced first, and the machine's
+    // PPU needs the pixel pipeline state too (see Machine::SyncRendererState)
+    void Restart();
+
+    std::shared_ptr<PPU> const& GetPPU() const { return ppu; }
+
+private:
+    enum LOG_TYPE : u8 {
+        LOG_REGISTER_WRITE,
+        LOG_REGISTER_READ,
+        LOG_MIRRORING,
+        LOG_CHR_PAGE
+    };
+
+    struct LogEntry {
+        u64       dot;
+        u8 const* page;    // LOG_CHR_PAGE
+        u16       address; // register or page number
+        u8        value;
+        LOG_TYPE  type;
+    };
+
+    void Push(LogEntry const&);
+    void Apply(LogEntry const&);
+    void SetMirroring(MIRRORING);
+
+    void RenderThread();
+    void Render(u64 target);
+
+    Machine&                    machine;
+    std::shared_ptr<SystemView> system_view;
+
+    std::shared_ptr<PPU>        ppu;
+    std::shared_ptr<MemoryView> ppu_view;
+
+    // this PPU's bus
+    u8                          vram[0x800];
+    u8                          chr_ram[0x2000];
+    bool                        has_chr_ram;
+    MIRRORING                   mirroring;
+    u8 const*                   pages[16];
+
+    std::vector<LogEntry>       log;
+    std::atomic<u64>            log_head = 0;  // written by the machine
+    std::atomic<u64>            log_tail = 0;  // written by the render thread
+
+    // every Advance is a new request, and done is the last one the render thread finished
+    std::atomic<u64>            progress = 0;  // the dot the render thread can run to
+    std::atomic<u64>            requests = 0;
+    std::atomic<u64>            done     = 0;
+    std::atomic<bool>           exit_thread = false;
+    std::shared_ptr<std::thread> render_thread;
+};
+
+}
@@ -0,0 +1,229 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <bit>
+#include <cstring>
+
+#include "systems/nes/machine.h"
+#include "systems/nes/memory.h"
+#include "systems/nes/ram_search.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define RAM_SEARCH_SSE2
+#   include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace Systems::NES {
+
+namespace {
+
+enum {
+    COMPARE_EQUAL,
+    COMPARE_NOT_EQUAL,
+    COMPARE_GREATER,
+    COMPARE_LESS
+};
+
+}
+
+RAMSearcher::RAMSearcher()
+{
+    candidates.resize(RAM_SEARCH_SIZE / 64, 0);
+    previous.resize(RAM_SEARCH_SIZE, 0);
+    last_dropped.resize(RAM_SEARCH_SIZE, 0);
+}
+
+RAMSearcher::~RAMSearcher()
+{
+}
+
+int RAMSearcher::GetIndex(u16 address)
+{
+    if(address < 0x2000) return address & (RAM_SEARCH_RAM_SIZE - 1);
+    if(address >= 0x6000 && address < 0x8000) return RAM_SEARCH_RAM_SIZE + (address - 0x6000);
+    return -1;
+}
+
+void RAMSearcher::Gather(u8 const* cpu_memory, u8* dest)
+{
+    memcpy(&dest[0], &cpu_memory[0x0000], RAM_SEARCH_RAM_SIZE);
+    memcpy(&dest[RAM_SEARCH_RAM_SIZE], &cpu_memory[0x6000], RAM_SEARCH_SRAM_SIZE);
+}
+
+void RAMSearcher::ReadMachine(Machine& machine, u8* dest)
+{
+    auto& memory_view = machine.GetMemoryView();
+    for(int i = 0; i < RAM_SEARCH_SIZE; i++) dest[i] = memory_view->Peek(GetAddress(i));
+}
+
+void RAMSearcher::ResetCandidates()
+{
+    for(auto& word : candidates) word = ~0ULL;
+    num_candidates = RAM_SEARCH_SIZE;
+    first_frame = 0;
+    num_frames = 0;
+    dropped_frames = false;
+}
+
+void RAMSearcher::Reset(u8 const* cpu_memory)
+{
+    Gather(cpu_memory, previous.data());
+    ResetCandidates();
+}
+
+void RAMSearcher::Reset(Machine& machine)
+{
+    ReadMachine(machine, previous.data());
+    ResetCandidates();
+}
+
+u8* RAMSearcher::NextFrame()
+{
+    // once the ring is full the oldest frame is dropped. it was only needed for every_frame searches,
+    // which now start from it
+    if(num_frames == RAM_SEARCH_MAX_FRAMES) {
+        memcpy(last_dropped.data(), GetFrame(0), RAM_SEARCH_SIZE);
+        dropped_frames = true;
+        first_frame = (first_frame + 1) % RAM_SEARCH_MAX_FRAMES;
+        num_frames -= 1;
+    } else if(frames.size() < (size_t)(num_frames + 1) * RAM_SEARCH_SIZE) {
+        // only grows before wrapping, when first_frame is still 0
+        frames.resize((size_t)(num_frames + 1) * RAM_SEARCH_SIZE);
+    }
+
+    num_frames += 1;
+    return (u8*)GetFrame(num_frames - 1);
+}
+
+void RAMSearcher::AddFrame(u8 const* cpu_memory)
+{
+    Gather(cpu_memory, NextFrame());
+}
+
+void RAMSearcher::AddFrame(Machine& machine)
+{
+    ReadMachine(machine, NextFrame());
+}
+
+template<int COMPARE>
+void RAMSearcher::Filter(u8 const* current, u8 const* reference, bool relative, u8 value)
+{
+#if defined(RAM_SEARCH_SSE2)
+    __m128i const operand = _mm_set1_epi8((char)value);
+#endif
+
+    for(int w = 0; w < (int)candidates.size(); w++) {
+        // nothing left to narrow down in these 64 bytes
+        if(!candidates[w]) continue;
+
+        u64 mask = 0;
+        for(int k = 0; k < 4; k++) {
+            int offset = w * 64 + k * 16;
+
+#if defined(RAM_SEARCH_SSE2)
+            __m128i a = _mm_loadu_si128((__m128i const*)&current[offset]);
+            __m128i b = relative ? _mm_add_epi8(_mm_loadu_si128((__m128i const*)&reference[offset]), operand) : operand;
+
+            // there are no unsigned byte compares in SSE2, but max() tells which is larger. the result is
+            // the opposite of what's wanted for all but EQUAL
+            __m128i m;
+            if constexpr (COMPARE == COMPARE_EQUAL || COMPARE == COMPARE_NOT_EQUAL) {
+                m = _mm_cmpeq_epi8(a, b);
+            } else if constexpr (COMPARE == COMPARE_GREATER) {
+                m = _mm_cmpeq_epi8(_mm_max_epu8(a, b), b); // a <= b
+            } else {
+                m = _mm_cmpeq_epi8(_mm_max_epu8(a, b), a); // a >= b
+            }
+
+            u64 bits = (u16)_mm_movemask_epi8(m);
+            if constexpr (COMPARE != COMPARE_EQUAL) bits ^= 0xFFFF;
+#else
+            u64 bits = 0;
+            for(int i = 0; i < 16; i++) {
+                u8 a = current[offset + i];
+                u8 b = relative ? (u8)(reference[offset + i] + value) : value;
+
+                bool match;
+                if constexpr (COMPARE == COMPARE_EQUAL) match = (a == b);
+                else if constexpr (COMPARE == COMPARE_NOT_EQUAL) match = (a != b);
+                else if constexpr (COMPARE == COMPARE_GREATER) match = (a > b);
+                else match = (a < b);
+
+                bits |= (u64)match << i;
+            }
+#endif
+
+            mask |= bits << (k * 16);
+        }
+
+        candidates[w] &= mask;
+    }
+}
+
+int RAMSearcher::Apply(PREDICATE predicate, int value, bool every_frame)
+{
+    int compare = COMPARE_EQUAL;
+    bool relative = false;
+
+    switch(predicate) {
+    case PREDICATE::EQUAL_TO:     compare = COMPARE_EQUAL;     break;
+    case PREDICATE::NOT_EQUAL_TO: compare = COMPARE_NOT_EQUAL; break;
+    case PREDICATE::GREATER_THAN: compare = COMPARE_GREATER;   break;
+    case PREDICATE::LESS_THAN:    compare = COMPARE_LESS;      break;
+    case PREDICATE::CHANGED:      compare = COMPARE_NOT_EQUAL; relative = true; value = 0; break;
+    case PREDICATE::UNCHANGED:    compare = COMPARE_EQUAL;     relative = true; value = 0; break;
+    case PREDICATE::INCREASED:    compare = COMPARE_GREATER;   relative = true; value = 0; break;
+    case PREDICATE::DECREASED:    compare = COMPARE_LESS;      relative = true; value = 0; break;
+    case PREDICATE::INCREASED_BY: compare = COMPARE_EQUAL;     relative = true; break;
+    case PREDICATE::DECREASED_BY: compare = COMPARE_EQUAL;     relative = true; value = -value; break;
+    }
+
+    auto filter = [&](u8 const* current, u8 const* reference) {
+        switch(compare) {
+        case COMPARE_EQUAL:     Filter<COMPARE_EQUAL>    (current, reference, relative, (u8)value); break;
+        case COMPARE_NOT_EQUAL: Filter<COMPARE_NOT_EQUAL>(current, reference, relative, (u8)value); break;
+        case COMPARE_GREATER:   Filter<COMPARE_GREATER>  (current, reference, relative, (u8)value); break;
+        case COMPARE_LESS:      Filter<COMPARE_LESS>     (current, reference, relative, (u8)value); break;
+        }
+    };
+
+    if(num_frames == 0) {
+        // nothing new, so previous values are compared against themselves
+        filter(previous.data(), previous.data());
+    } else if(every_frame) {
+        for(int i = 0; i < num_frames; i++) {
+            u8 const* first_reference = dropped_frames ? last_dropped.data() : previous.data();
+            filter(GetFrame(i), (i == 0) ? first_reference : GetFrame(i - 1));
+        }
+    } else {
+        filter(GetFrame(num_frames - 1), previous.data());
+    }
+
+    // the latest frame is what the next search compares against
+    if(num_frames) memcpy(previous.data(), GetFrame(num_frames - 1), RAM_SEARCH_SIZE);
+    first_frame = 0;
+    num_frames = 0;
+    dropped_frames = false;
+
+    num_candidates = 0;
+    for(auto& word : candidates) num_candidates += popcount(word);
+    return num_candidates;
+}
+
+void RAMSearcher::GetCandidates(vector<int>& out, int max_count) const
+{
+    out.clear();
+    for(int w = 0; w < (int)candidates.size() && (int)out.size() < max_count; w++) {
+        u64 word = candidates[w];
+        while(word && (int)out.size() < max_count) {
+            out.push_back(w * 64 + countr_zero(word));
+            word &= word - 1;
+        }
+    }
+}
+
+}
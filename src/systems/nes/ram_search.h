@@ -0,0 +1,102 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <vector>
+
+#include "util.h"
+
+// bytes searched: the 2KiB of CPU RAM followed by the 8KiB of SRAM at $6000
+#define RAM_SEARCH_RAM_SIZE  0x800
+#define RAM_SEARCH_SRAM_SIZE 0x2000
+#define RAM_SEARCH_SIZE      (RAM_SEARCH_RAM_SIZE + RAM_SEARCH_SRAM_SIZE)
+
+// frames kept between searches before the oldest are dropped (about 40MiB). every_frame searches only
+// cover the frames still kept
+#define RAM_SEARCH_MAX_FRAMES 4096
+
+namespace Systems::NES {
+
+class Machine;
+
+// RAMSearcher finds the addresses that behave a certain way, i.e., the byte that counts down when the
+// player loses a life. Every frame of RAM is added with AddFrame, and each Apply narrows the candidate
+// addresses to the ones matching a predicate, either comparing the latest frame to the one from the
+// previous Apply, or requiring the predicate to hold from every frame to the next.
+//
+// Candidates are a packed bitset, and Apply compares 16 addresses at a time with SSE2 where available,
+// skipping any 64 addresses that are no longer candidates. There's nothing NES specific beyond where
+// the memory comes from, and it doesn't need a UI or a running thread.
+class RAMSearcher {
+public:
+    enum class PREDICATE {
+        EQUAL_TO,       // == value
+        NOT_EQUAL_TO,   // != value
+        GREATER_THAN,   // > value
+        LESS_THAN,      // < value
+        CHANGED,        // != previous
+        UNCHANGED,      // == previous
+        INCREASED,      // > previous
+        DECREASED,      // < previous
+        INCREASED_BY,   // == previous + value
+        DECREASED_BY    // == previous - value
+    };
+
+    RAMSearcher();
+    ~RAMSearcher();
+
+    // the address of a search index and back
+    static u16 GetAddress(int index) { return (index < RAM_SEARCH_RAM_SIZE) ? (u16)index : (u16)(0x6000 + index - RAM_SEARCH_RAM_SIZE); }
+    static int GetIndex(u16 address);
+
+    // start over with every address a candidate. cpu_memory is a 64KiB image of the CPU address space
+    void Reset(u8 const* cpu_memory);
+    void Reset(Machine&);
+
+    void AddFrame(u8 const* cpu_memory);
+    void AddFrame(Machine&);
+
+    // returns the number of candidates left. every_frame only matters for the predicates that compare
+    // against the previous value or when more than one frame has been added since the last Apply
+    int  Apply(PREDICATE, int value, bool every_frame);
+
+    int  GetNumCandidates()   const { return num_candidates; }
+    int  GetNumFrames()       const { return num_frames; }
+    bool IsCandidate(int index) const { return (candidates[index >> 6] >> (index & 63)) & 1; }
+
+    // search indexes of the candidates in address order, up to max_count of them
+    void GetCandidates(std::vector<int>&, int max_count = RAM_SEARCH_SIZE) const;
+
+    // the value at the last Apply (or Reset) and in the most recent frame
+    u8   GetPreviousValue(int index) const { return previous[index]; }
+    u8   GetCurrentValue(int index)  const { return num_frames ? GetFrame(num_frames - 1)[index] : previous[index]; }
+
+private:
+    static void Gather(u8 const* cpu_memory, u8* dest);
+    static void ReadMachine(Machine&, u8* dest);
+
+    void        ResetCandidates();
+    u8*         NextFrame();
+    u8 const*   GetFrame(int i) const { return &frames[((first_frame + i) % RAM_SEARCH_MAX_FRAMES) * RAM_SEARCH_SIZE]; }
+
+    template<int COMPARE>
+    void Filter(u8 const* current, u8 const* reference, bool relative, u8 value);
+
+    std::vector<u64> candidates;
+    int              num_candidates = 0;
+
+    std::vector<u8>  previous;
+
+    // ring buffer of the frames added since the last Apply, grown as needed. Once frames are dropped,
+    // every_frame compares the first one kept against the last one dropped instead of previous
+    std::vector<u8>  frames;
+    int              first_frame = 0;
+    int              num_frames  = 0;
+    std::vector<u8>  last_dropped;
+    bool             dropped_frames = false;
+};
+
+}
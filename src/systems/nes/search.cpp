@@ -0,0 +1,539 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "util.h"
+
+#include "systems/nes/cartridge.h"
+#include "systems/nes/comment.h"
+#include "systems/nes/disasm.h"
+#include "systems/nes/expressions.h"
+#include "systems/nes/label.h"
+#include "systems/nes/memory.h"
+#include "systems/nes/search.h"
+#include "systems/nes/system.h"
+
+using namespace std;
+
+namespace Systems::NES {
+
+Searcher::Searcher(shared_ptr<System> const& system)
+    : current_system(system)
+{
+}
+
+Searcher::~Searcher()
+{
+    Stop();
+}
+
+bool Searcher::Start(SEARCH_TYPE _search_type, string const& _query, string& errmsg)
+{
+    auto system = current_system.lock();
+    if(!system) {
+        errmsg = "No system";
+        return false;
+    }
+
+    // only one search at a time
+    Stop();
+
+    disassembler = system->GetDisassembler();
+
+    search_type = _search_type;
+    query = _query;
+
+    switch(search_type) {
+    case SEARCH_TYPE::BYTES:
+        if(!ParseBytePattern(query, errmsg)) return false;
+        break;
+
+    case SEARCH_TYPE::INSTRUCTIONS:
+        if(!ParseInstructionPattern(query, errmsg)) return false;
+        break;
+
+    case SEARCH_TYPE::TEXT:
+        query_lower = strlower(query);
+        if(query_lower.size() == 0) {
+            errmsg = "Empty search";
+            return false;
+        }
+
+        // the disassembly thread owns the memory objects while it runs
+        if(system->IsDisassembling()) {
+            errmsg = "Can't search text while disassembling";
+            return false;
+        }
+        break;
+    }
+
+    // gather the banks to scan. CHR banks never contain code
+    banks.clear();
+    auto cartridge = system->GetCartridge();
+    for(int i = 0; i < cartridge->header.num_prg_rom_banks; i++) {
+        banks.push_back(cartridge->GetProgramRomBank(i));
+    }
+
+    if(search_type != SEARCH_TYPE::INSTRUCTIONS) {
+        for(int i = 0; i < cartridge->GetNumCharacterRomBanks(); i++) {
+            banks.push_back(cartridge->GetCharacterRomBank(i));
+        }
+    }
+
+    if(search_type == SEARCH_TYPE::TEXT) UpdateTextIndex(system);
+
+    {
+        lock_guard<mutex> lock(results_mutex);
+        results.clear();
+    }
+
+    total_banks = banks.size();
+    banks_done = 0;
+    stop_search = false;
+    running = true;
+    search_thread = make_shared<thread>(std::bind(&Searcher::SearchThread, this));
+    return true;
+}
+
+void Searcher::Stop()
+{
+    stop_search = true;
+    if(search_thread) {
+        search_thread->join();
+        search_thread = nullptr;
+    }
+    running = false;
+}
+
+int Searcher::GetResults(vector<Result>& out, int start)
+{
+    lock_guard<mutex> lock(results_mutex);
+    for(int i = start; i < results.size(); i++) out.push_back(results[i]);
+    return results.size();
+}
+
+bool Searcher::ParseBytePattern(string const& s, string& errmsg)
+{
+    pattern_bytes.clear();
+    pattern_mask.clear();
+
+    // allow whitespace anywhere, but bytes are always two characters
+    string nospace;
+    for(auto c : s) if(!isspace(c)) nospace.push_back(c);
+
+    if(nospace.size() == 0 || (nospace.size() % 2) != 0) {
+        errmsg = "Byte patterns must be pairs of hex digits or ??";
+        return false;
+    }
+
+    bool has_anchor = false;
+    for(int i = 0; i < nospace.size(); i += 2) {
+        string b = nospace.substr(i, 2);
+        if(b == "??") {
+            pattern_bytes.push_back(0);
+            pattern_mask.push_back(0);
+            continue;
+        }
+
+        if(!isxdigit(b[0]) || !isxdigit(b[1])) {
+            errmsg = "Invalid byte '" + b + "'";
+            return false;
+        }
+
+        pattern_bytes.push_back((u8)strtol(b.c_str(), nullptr, 16));
+        pattern_mask.push_back(0xFF);
+        has_anchor = true;
+    }
+
+    if(!has_anchor) {
+        errmsg = "Byte pattern needs at least one non-wildcard byte";
+        return false;
+    }
+
+    return true;
+}
+
+bool Searcher::ParseInstructionPattern(string const& s, string& errmsg)
+{
+    instruction_patterns.clear();
+
+    int start = 0;
+    while(start < s.size()) {
+        int end = s.find_first_of(";\n", start);
+        if(end == string::npos) end = s.size();
+
+        string instruction = s.substr(start, end - start);
+        start = end + 1;
+
+        // skip empty instructions, i.e. a trailing ';'
+        if(all_of(instruction.begin(), instruction.end(), [](char c) { return isspace(c); })) continue;
+
+        InstructionPattern pattern;
+        if(!ParseInstruction(instruction, pattern, errmsg)) return false;
+        instruction_patterns.push_back(pattern);
+    }
+
+    if(instruction_patterns.size() == 0) {
+        errmsg = "Empty search";
+        return false;
+    }
+
+    return true;
+}
+
+// Parse a single "MNEMONIC operand" into the set of opcodes it can match
+bool Searcher::ParseInstruction(string const& s, InstructionPattern& pattern, string& errmsg)
+{
+    // split off the mnemonic and remove all whitespace from the operand
+    stringstream ss(s);
+    string mnemonic, operand, part;
+    ss >> mnemonic;
+    while(ss >> part) operand += part;
+
+    mnemonic = strlower(mnemonic);
+    operand  = strlower(operand);
+
+    bitset<AM_RELATIVE + 1> modes;
+    string value_str;
+
+    if(operand.size() == 0) {
+        modes[AM_IMPLIED] = modes[AM_ACCUM] = true;
+    } else if(operand == "a") {
+        modes[AM_ACCUM] = true;
+    } else if(operand == "?" || operand == "*") { // any operand at all
+        modes.set();
+    } else if(operand[0] == '#') {
+        modes[AM_IMMEDIATE] = true;
+        value_str = operand.substr(1);
+    } else if(operand[0] == '(') {
+        if(operand.ends_with(",x)")) {
+            modes[AM_INDIRECT_X] = true;
+            value_str = operand.substr(1, operand.size() - 4);
+        } else if(operand.ends_with("),y")) {
+            modes[AM_INDIRECT_Y] = true;
+            value_str = operand.substr(1, operand.size() - 4);
+        } else if(operand.ends_with(")")) {
+            modes[AM_INDIRECT] = true;
+            value_str = operand.substr(1, operand.size() - 2);
+        } else {
+            errmsg = "Invalid indirect operand '" + operand + "'";
+            return false;
+        }
+    } else if(operand.ends_with(",x")) {
+        modes[AM_ZEROPAGE_X] = modes[AM_ABSOLUTE_X] = true;
+        value_str = operand.substr(0, operand.size() - 2);
+    } else if(operand.ends_with(",y")) {
+        modes[AM_ZEROPAGE_Y] = modes[AM_ABSOLUTE_Y] = true;
+        value_str = operand.substr(0, operand.size() - 2);
+    } else {
+        modes[AM_ZEROPAGE] = modes[AM_ABSOLUTE] = modes[AM_RELATIVE] = true;
+        value_str = operand;
+    }
+
+    // determine the operand value, if any
+    pattern.value = -1;
+    if(value_str == "?" || value_str == "*" || value_str == "imm" || value_str == "addr") {
+        // wildcard
+    } else if(value_str.size()) {
+        string digits = (value_str[0] == '$') ? value_str.substr(1) : value_str;
+        if(digits.size() == 0 || digits.size() > 4
+                || !all_of(digits.begin(), digits.end(), [](char c) { return isxdigit(c); })) {
+            errmsg = "Invalid operand value '" + value_str + "'";
+            return false;
+        }
+
+        pattern.value = strtol(digits.c_str(), nullptr, 16);
+
+        // the number of digits determines zero page vs absolute, same as the assembler would
+        if(digits.size() > 2) {
+            modes[AM_ZEROPAGE] = modes[AM_ZEROPAGE_X] = modes[AM_ZEROPAGE_Y] = false;
+        } else if(!modes[AM_IMMEDIATE] && !modes[AM_INDIRECT_X] && !modes[AM_INDIRECT_Y]) {
+            modes[AM_ABSOLUTE] = modes[AM_ABSOLUTE_X] = modes[AM_ABSOLUTE_Y] = modes[AM_INDIRECT] = false;
+        }
+    }
+
+    pattern.opcodes.reset();
+    for(int op = 0; op < 256; op++) {
+        if(disassembler->GetInstructionSize(op) == 0) continue;
+        if(strlower(disassembler->GetInstruction(op)) != mnemonic) continue;
+
+        auto mode = disassembler->GetAddressingMode(op);
+        if(mode == UNIMPLEMENTED || !modes[mode]) continue;
+
+        pattern.opcodes[op] = true;
+    }
+
+    if(pattern.opcodes.none()) {
+        errmsg = "No instruction matches '" + s + "'";
+        return false;
+    }
+
+    return true;
+}
+
+void Searcher::SearchThread()
+{
+    if(search_type == SEARCH_TYPE::TEXT) {
+        // labels first, then the banks
+        SearchText(text_snapshot[0]);
+        for(int i = 1; i < (int)text_snapshot.size() && !stop_search; i++) {
+            SearchText(text_snapshot[i]);
+            banks_done++;
+        }
+    } else {
+        for(auto& bank : banks) {
+            if(stop_search) break;
+
+            if(search_type == SEARCH_TYPE::BYTES) SearchBytes(bank);
+            else SearchInstructions(bank);
+
+            banks_done++;
+        }
+    }
+
+    cout << "[Searcher::SearchThread] search for \"" << query << "\" found " << dec << results.size() << " result(s)" << endl;
+    running = false;
+}
+
+void Searcher::SearchBytes(shared_ptr<MemoryRegion> const& bank)
+{
+    u32 size = bank->GetRegionSize();
+    u32 pattern_size = pattern_bytes.size();
+    if(size < pattern_size) return;
+
+    // ROM contents don't change, so a copy is safe to scan without holding up anything else
+    vector<u8> data(size);
+    bank->Copy(data.data(), bank->GetBaseAddress(), size);
+
+    // find the first fixed byte of the pattern and use memchr() to skip to candidates
+    u32 anchor = 0;
+    while(pattern_mask[anchor] == 0) anchor++;
+
+    u32 last_start = size - pattern_size;
+    u32 start = 0;
+    while(start <= last_start && !stop_search) {
+        u8 const* p = (u8 const*)memchr(&data[start + anchor], pattern_bytes[anchor], last_start - start + 1);
+        if(!p) break;
+
+        start = (p - data.data()) - anchor;
+
+        bool match = true;
+        for(u32 i = 0; i < pattern_size && match; i++) {
+            match = ((data[start + i] & pattern_mask[i]) == pattern_bytes[i]);
+        }
+
+        if(match) {
+            stringstream ss;
+            ss << hex << setfill('0') << uppercase;
+            for(u32 i = 0; i < pattern_size; i++) {
+                ss << setw(2) << (int)data[start + i];
+                if(i != pattern_size - 1) ss << " ";
+            }
+
+            AddResult(bank, start, pattern_size, ss.str());
+        }
+
+        start++;
+    }
+}
+
+bool Searcher::MatchInstructions(u8 const* data, u32 size, u32 base_address, u32 offset, u32* length)
+{
+    u32 start = offset;
+    for(auto& pattern : instruction_patterns) {
+        if(offset >= size) return false;
+
+        u8 op = data[offset];
+        if(!pattern.opcodes[op]) return false;
+
+        int instruction_size = disassembler->GetInstructionSize(op);
+        if(offset + instruction_size > size) return false;
+
+        if(pattern.value >= 0) {
+            s64 value;
+            if(disassembler->GetAddressingMode(op) == AM_RELATIVE) { // branches match against the target address
+                value = (base_address + offset + 2 + (s8)data[offset + 1]) & 0xFFFF;
+            } else if(instruction_size == 3) {
+                value = (u16)data[offset + 1] | ((u16)data[offset + 2] << 8);
+            } else {
+                value = data[offset + 1];
+            }
+
+            if(value != pattern.value) return false;
+        }
+
+        offset += instruction_size;
+    }
+
+    *length = offset - start;
+    return true;
+}
+
+void Searcher::SearchInstructions(shared_ptr<MemoryRegion> const& bank)
+{
+    u32 size = bank->GetRegionSize();
+    u32 base_address = bank->GetBaseAddress();
+
+    vector<u8> data(size);
+    bank->Copy(data.data(), base_address, size);
+
+    // the first instruction's opcode set is used to quickly reject most offsets
+    auto const& first_opcodes = instruction_patterns[0].opcodes;
+
+    // every offset is tried, since code that hasn't been disassembled yet should be found too
+    for(u32 offset = 0; offset < size && !stop_search; offset++) {
+        if(!first_opcodes[data[offset]]) continue;
+
+        u32 length;
+        if(!MatchInstructions(data.data(), size, base_address, offset, &length)) continue;
+
+        // format the matched instructions for display
+        stringstream ss;
+        for(u32 i = offset; i < offset + length; ) {
+            u8 op = data[i];
+            if(i != offset) ss << "; ";
+            ss << disassembler->GetInstruction(op);
+
+            auto mode = disassembler->GetAddressingMode(op);
+            if(mode == AM_RELATIVE) {
+                ss << " $" << hex << setw(4) << setfill('0') << uppercase << ((base_address + i + 2 + (s8)data[i + 1]) & 0xFFFF);
+            } else if(mode == AM_ACCUM) {
+                ss << " A";
+            } else if(mode != AM_IMPLIED) {
+                ss << " " << disassembler->FormatOperand(op, &data[i + 1]);
+            }
+
+            i += disassembler->GetInstructionSize(op);
+        }
+
+        AddResult(bank, offset, length, ss.str());
+    }
+}
+
+void Searcher::UpdateTextIndex(shared_ptr<System> const& system)
+{
+    u64 format_generation = BaseSystem::GetFormatGeneration();
+
+    // creating, renaming or deleting a label changes the format generation
+    if(!label_index.entries || label_index.format_generation != format_generation) {
+        auto entries = make_shared<text_index_t>();
+        system->IterateLabels([&entries](shared_ptr<Label>& label) {
+            entries->push_back(TextEntry {
+                .where   = label->GetMemoryLocation(),
+                .length  = 1,
+                .text    = strlower(label->GetString()),
+                .context = label->GetString(),
+            });
+        });
+
+        label_index.format_generation = format_generation;
+        label_index.entries = entries;
+    }
+
+    // the bank list only depends on the cartridge, so indexes line up from one search to the next
+    bank_indexes.resize(banks.size());
+
+    int rebuilt = 0;
+    text_snapshot.clear();
+    text_snapshot.push_back(label_index.entries);
+    for(int i = 0; i < (int)banks.size(); i++) {
+        auto& index = bank_indexes[i];
+        u64 edit_generation = banks[i]->GetEditGeneration();
+        if(!index.entries || index.edit_generation != edit_generation || index.format_generation != format_generation) {
+            index.edit_generation = edit_generation;
+            index.format_generation = format_generation;
+            index.entries = IndexBank(banks[i]);
+            rebuilt++;
+        }
+
+        text_snapshot.push_back(index.entries);
+    }
+
+    if(rebuilt) cout << "[Searcher::UpdateTextIndex] reindexed " << dec << rebuilt << " of " << banks.size() << " bank(s)" << endl;
+}
+
+// Only called on the thread that owns the memory objects
+shared_ptr<Searcher::text_index_t const> Searcher::IndexBank(shared_ptr<MemoryRegion> const& bank)
+{
+    static MemoryObject::COMMENT_TYPE const comment_types[] = {
+        MemoryObject::COMMENT_TYPE_PRE, MemoryObject::COMMENT_TYPE_EOL, MemoryObject::COMMENT_TYPE_POST
+    };
+
+    auto entries = make_shared<text_index_t>();
+
+    u32 size = bank->GetRegionSize();
+    u32 offset = 0;
+    while(offset < size) {
+        GlobalMemoryLocation where;
+        bank->GetGlobalMemoryLocation(offset, &where);
+
+        auto memory_object = bank->GetMemoryObject(where);
+        if(!memory_object) break;
+
+        int object_size = memory_object->GetSize(disassembler);
+
+        if(memory_object->operand_expression) {
+            stringstream ss;
+            ss << *memory_object->operand_expression;
+            entries->push_back(TextEntry {
+                .where   = where,
+                .length  = object_size,
+                .text    = strlower(ss.str()),
+                .context = ss.str(),
+            });
+        }
+
+        for(auto comment_type : comment_types) {
+            if(auto comment = memory_object->GetComment(comment_type)) {
+                string text;
+                comment->GetFullCommentText(text);
+                entries->push_back(TextEntry {
+                    .where   = where,
+                    .length  = object_size,
+                    .text    = strlower(text),
+                    .context = "; " + text.substr(0, text.find('\n')),
+                });
+            }
+        }
+
+        offset += max(object_size, 1);
+    }
+
+    return entries;
+}
+
+void Searcher::SearchText(shared_ptr<text_index_t const> const& entries)
+{
+    vector<Result> matches;
+    for(auto const& entry : *entries) {
+        if(entry.text.find(query_lower) == string::npos) continue;
+        matches.push_back(Result {
+            .where   = entry.where,
+            .length  = entry.length,
+            .context = entry.context,
+        });
+    }
+
+    lock_guard<mutex> lock(results_mutex);
+    results.insert(results.end(), matches.begin(), matches.end());
+}
+
+void Searcher::AddResult(shared_ptr<MemoryRegion> const& bank, u32 offset, int length, string const& context)
+{
+    Result result;
+    if(!bank->GetGlobalMemoryLocation(offset, &result.where)) return;
+    result.length  = length;
+    result.context = context;
+
+    lock_guard<mutex> lock(results_mutex);
+    results.push_back(result);
+}
+
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+#include "systems/nes/memory.h"
+
+namespace Systems::NES {
+
+class Disassembler;
+class MemoryRegion;
+class System;
+
+// Searcher scans the cartridge ROM banks on a worker thread. Results are appended as they
+// are found and can be collected from the UI thread at any time with GetResults().
+//
+// Supported queries:
+//   BYTES        - hex bytes with ?? wildcards, i.e., "A9 ?? 8D 00 20"
+//   INSTRUCTIONS - instructions separated by ';', i.e., "LDA #imm; STA $2000". Operand values
+//                  can be replaced with '?' (or "imm"/"addr") to match any value
+//   TEXT         - case insensitive substring match over labels, comments and operands
+//
+// Text is searched in an index of the labels and of each bank's comments and operands, which is kept
+// between searches and only rebuilt for the banks that changed. The index is updated by Start() on
+// the thread that owns the memory objects, so the search thread never reads them.
+class Searcher {
+public:
+    enum class SEARCH_TYPE { BYTES, INSTRUCTIONS, TEXT };
+
+    struct Result {
+        GlobalMemoryLocation where;
+        int         length;
+        std::string context; // what was matched, for display
+    };
+
+    Searcher(std::shared_ptr<System> const&);
+    ~Searcher();
+
+    bool Start(SEARCH_TYPE, std::string const&, std::string& errmsg);
+    void Stop();
+
+    bool  IsRunning()   const { return running; }
+    float GetProgress() const { return (total_banks == 0) ? 1.0f : (float)banks_done / (float)total_banks; }
+
+    // copy out results starting at index `start`, returns the total number of results
+    int GetResults(std::vector<Result>& out, int start);
+
+private:
+    struct InstructionPattern {
+        std::bitset<256> opcodes;  // opcodes that can match this instruction
+        s64              value;    // operand value to match, or -1 for any
+    };
+
+    bool ParseBytePattern(std::string const&, std::string& errmsg);
+    bool ParseInstructionPattern(std::string const&, std::string& errmsg);
+    bool ParseInstruction(std::string const&, InstructionPattern&, std::string& errmsg);
+
+    void SearchThread();
+    void SearchBytes(std::shared_ptr<MemoryRegion> const&);
+    void SearchInstructions(std::shared_ptr<MemoryRegion> const&);
+
+    bool MatchInstructions(u8 const*, u32, u32, u32, u32*);
+    void AddResult(std::shared_ptr<MemoryRegion> const&, u32, int, std::string const&);
+
+    struct TextEntry {
+        GlobalMemoryLocation where;
+        int                  length;
+        std::string          text;    // lowercase, for matching
+        std::string          context; // for display
+    };
+    typedef std::vector<TextEntry> text_index_t;
+
+    // an index is current while the generations match the bank's edit generation and the format
+    // generation, since operands and comments print label names
+    struct TextIndex {
+        u64 edit_generation   = 0;
+        u64 format_generation = 0;
+        std::shared_ptr<text_index_t const> entries;
+    };
+
+    void UpdateTextIndex(std::shared_ptr<System> const&);
+    std::shared_ptr<text_index_t const> IndexBank(std::shared_ptr<MemoryRegion> const&);
+    void SearchText(std::shared_ptr<text_index_t const> const&);
+
+    std::weak_ptr<System>         current_system;
+    std::shared_ptr<Disassembler> disassembler;
+
+    SEARCH_TYPE search_type;
+    std::string query;
+
+    // BYTES
+    std::vector<u8> pattern_bytes;
+    std::vector<u8> pattern_mask;
+
+    // INSTRUCTIONS
+    std::vector<InstructionPattern> instruction_patterns;
+
+    // TEXT. text_snapshot is what the search thread scans: the labels followed by each bank
+    std::string query_lower;
+    TextIndex   label_index;
+    std::vector<TextIndex> bank_indexes;
+    std::vector<std::shared_ptr<text_index_t const>> text_snapshot;
+
+    std::vector<std::shared_ptr<MemoryRegion>> banks;
+    std::atomic<int>  total_banks = 0;
+    std::atomic<int>  banks_done  = 0;
+
+    std::shared_ptr<std::thread> search_thread;
+    std::atomic<bool> running     = false;
+    std::atomic<bool> stop_search = false;
+
+    std::mutex          results_mutex;
+    std::vector<Result> results;
+};
+
+}
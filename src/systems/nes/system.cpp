@@ -10,20 +10,24 @@
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <optional>
 
 #include "magic_enum.hpp"
 
 #include "systems/nes/cartridge.h"
+#include "systems/nes/comment.h"
 #include "systems/nes/defines.h"
 #include "systems/nes/disasm.h"
 #include "systems/nes/enum.h"
 #include "systems/nes/expressions.h"
+#include "systems/nes/journal.h"
 #include "systems/nes/label.h"
 #include "systems/nes/memory.h"
 #include "systems/nes/system.h"
 
 #include "windows/nes/project.h"
 
+#include "trace.h"
 #include "util.h"
 
 using namespace std;
@@ -34,6 +38,7 @@ System::System()
     : ::BaseSystem(), disassembling(false)
 {
     disassembler = make_shared<Disassembler>();
+    journal = make_shared<Journal>(this);
 }
 
 System::~System()
@@ -112,6 +117,8 @@ void System::CreateDefaultLabels()
     p.address = 0x4016; CreateLabel(p, "JOY1");
     p.address = 0x4017; CreateLabel(p, "JOY2");
 
+    // the default labels aren't something to undo
+    journal->Clear();
 }
 
 // Memory
@@ -686,6 +693,7 @@ shared_ptr<Define> System::CreateDefine(string const& name, string& errmsg)
     defines[define_name] = define;
 
     // notify the system of new defines
+    InvalidateFormatCaches();
     define_created->emit(define);
 
     return define;
@@ -693,13 +701,22 @@ shared_ptr<Define> System::CreateDefine(string const& name, string& errmsg)
 
 bool System::DeleteDefine(shared_ptr<Define> const& define)
 {
+    // banks refer to defines by name, and any references deferred banks have need to be noted
+    memory_region_set_t referencing_banks;
+    GetReferencingBanks(define, referencing_banks);
+
+    // the undo history may have expressions that refer to the define
+    journal->Clear();
+
     if(define->GetNumReverseReferences()) {
         cout << "[Systems::NES::System] warning: deleting define with nonzero RRefs" << endl;
     }
 
     defines.erase(define->GetName());
+    InvalidateFormatCaches();
     define_deleted->emit(define);
     define->ClearReferences();
+    InvalidateBankChunks(referencing_banks);
 
     return true;
 }
@@ -747,13 +764,16 @@ shared_ptr<Label> System::GetOrCreateLabel(GlobalMemoryLocation const& where, st
 
     if(auto memory_region = GetMemoryRegion(where)) {
         memory_region->ApplyLabel(label);
+        InvalidateFormatCaches();
+
+        if(journal->IsRecording()) journal->RecordLabelCreated(where, label_str);
 
         // notify the system of new labels
         label_created->emit(label, was_user_created);
 
         // and the specific listing address
-        if(label_created_at.contains(where)) {
-            label_created_at[where]->emit(label, was_user_created);
+        if(auto it = label_created_at.find(where); it != label_created_at.end()) {
+            it->second->emit(label, was_user_created);
         }
     }
 
@@ -776,11 +796,17 @@ shared_ptr<Label> System::EditLabel(GlobalMemoryLocation const& where, string co
     if(auto memory_object = GetMemoryObject(where)) {
         if(nth < memory_object->labels.size()) {
             auto label = memory_object->labels.at(nth);
+            if(journal->IsRecording()) journal->RecordLabelRenamed(where, nth, label->GetString(), label_str);
+
             // remove label from the database
             label_database.erase(label->GetString());
             // change the label name and add the new reference to the db
             label->SetString(label_str);
             label_database[label_str] = label;
+            InvalidateFormatCaches();
+
+            // label names are saved with the memory object they're on
+            if(auto memory_region = GetMemoryRegion(where)) memory_region->MarkEdited();
             return label;
         }
     }
@@ -791,17 +817,27 @@ shared_ptr<Label> System::EditLabel(GlobalMemoryLocation const& where, string co
 
 void System::DeleteLabel(shared_ptr<Label> const& label)
 {
+    // expressions refer to labels by their index at the target, which can shift after a delete
     auto where = label->GetMemoryLocation();
+    memory_region_set_t referencing_banks;
+    GetReferencingBanks(where, referencing_banks);
+
     if(auto memory_region = GetMemoryRegion(where)) {
         if(int nth = memory_region->DeleteLabel(label); nth >= 0) {
             auto name = label->GetString();
             label_database.erase(name);
+            InvalidateFormatCaches();
+
+            if(journal->IsRecording()) journal->RecordLabelDeleted(where, name);
 
-            label_deleted->emit(label, nth);
+            // nth is only right until the next label at where changes, so these are never deferred
+            label_deleted->emit_now(label, nth);
 
-            if(label_deleted_at.contains(where)) {
-                label_deleted_at[where]->emit(label, nth);
+            if(auto it = label_deleted_at.find(where); it != label_deleted_at.end()) {
+                it->second->emit_now(label, nth);
             }
+
+            InvalidateBankChunks(referencing_banks);
         }
     }
 }
@@ -824,7 +860,7 @@ shared_ptr<Enum> System::CreateEnum(string const& name)
 shared_ptr<Enum> const& System::GetEnum(string const& name)
 {
     static shared_ptr<Enum> null_enum;
-    if(enums.contains(name)) return enums[name];
+    if(auto it = enums.find(name); it != enums.end()) return it->second;
     return null_enum; 
 }
 
@@ -837,10 +873,17 @@ shared_ptr<EnumElement> const& System::GetEnumElement(string const& name)
 
 bool System::DeleteEnum(shared_ptr<Enum> const& e)
 {
+    // banks refer to enums by name. the elements take care of their own references when they're deleted
+    memory_region_set_t referencing_banks;
+    GetReferencingBanks(e, referencing_banks);
+    journal->Clear();
+
     enum_deleted->emit(e);
     e->DeleteElements();
     assert(enums.contains(e->GetName()));
     enums.erase(e->GetName());
+    InvalidateFormatCaches();
+    InvalidateBankChunks(referencing_banks);
     return true;
 }
 
@@ -854,6 +897,7 @@ void System::EnumElementAdded(shared_ptr<EnumElement> const& ee)
 
     enum_elements_by_name[ee->GetFormattedName("_")]  = ee;
 
+    InvalidateFormatCaches();
     enum_element_added->emit(ee);
 }
 
@@ -877,6 +921,7 @@ void System::EnumElementChanged(shared_ptr<EnumElement> const& ee, std::string c
         list2.push_back(ee);
     }
 
+    InvalidateFormatCaches();
     enum_element_changed->emit(ee, old_value);
 }
 
@@ -889,11 +934,18 @@ void System::EnumElementDeleted(shared_ptr<EnumElement> const& ee)
     assert(it != list.end());
     list.erase(it);
 
+    // expressions in the undo history may refer to the element
+    journal->Clear();
+
+    InvalidateFormatCaches();
     enum_element_deleted->emit(ee);
 }
 
 void System::InitDisassembly(GlobalMemoryLocation const& where)
 {
+    // the disassembly thread can follow code into any bank, and banks are only loaded on this thread
+    if(cartridge) cartridge->LoadAllDeferredBanks();
+
     disassembly_address = where;
 
     disassembling = true;
@@ -901,9 +953,19 @@ void System::InitDisassembly(GlobalMemoryLocation const& where)
 
 int System::DisassemblyThread()
 {
+    TRACE_THREAD_NAME("Disassembly");
+    TRACE_SCOPE("System::DisassemblyThread");
+
     std::deque<GlobalMemoryLocation> locations;
     locations.push_back(disassembly_address);
 
+    // labels and references created during disassembly are delivered in one batch at the end
+    std::optional<signal_defer_scope> defer_signals;
+    defer_signals.emplace();
+
+    // the whole disassembly is undone in one step
+    journal->BeginTransaction("Disassemble");
+
     while(disassembling && locations.size()) {
         GlobalMemoryLocation current_loc = locations.front();
         locations.pop_front();
@@ -1004,6 +1066,11 @@ int System::DisassemblyThread()
         }
     }
 
+    journal->EndTransaction();
+
+    // deliver the queued signals before anyone is told disassembly is done
+    defer_signals.reset();
+
     // leave the dialog up for at least a moment
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
@@ -1021,6 +1088,10 @@ void System::CreateDefaultOperandExpression(GlobalMemoryLocation const& where, b
     // only create operand expressions for code
     if(code_object->type != MemoryObject::TYPE_CODE) return;
 
+    // the target label and the expression are undone together. if det_func asks the user for a bank,
+    // the expression is set later and recorded on its own
+    journal->BeginTransaction("Create operand expression");
+
     switch(auto am = disassembler->GetAddressingMode(*code_object->data_ptr)) {
     case AM_ABSOLUTE:
     case AM_ABSOLUTE_X:
@@ -1170,10 +1241,14 @@ void System::CreateDefaultOperandExpression(GlobalMemoryLocation const& where, b
     default:
         break;
     }
+
+    journal->EndTransaction();
 }
 
 bool System::Save(ostream& os, string& errmsg)
 {
+    TRACE_SCOPE("System::Save");
+
     // save the enums before defines, as defines can reference enums and they need to
     // be loaded before defines in Load()
     WriteVarInt(os, enums.size());
@@ -1216,6 +1291,8 @@ done:
 
 bool System::Load(istream& is, string& errmsg)
 {
+    TRACE_SCOPE("System::Load");
+
     int num_defines = 0;
     int num_labels = 0;
 
@@ -1314,8 +1391,70 @@ done:
     return is.good();
 }
 
+void System::LoadDeferredBanks()
+{
+    if(cartridge) cartridge->LoadAllDeferredBanks();
+}
+
+template<class T>
+void System::AddReferencingBanks(shared_ptr<T> const& referenceable, memory_region_set_t& regions)
+{
+    auto add = [this, &regions](GlobalMemoryLocation const& where) {
+        if(auto memory_region = GetMemoryRegion(where)) regions.insert(memory_region);
+    };
+
+    referenceable->IterateReverseReferences([&add](int, auto const& rref) {
+        visit([&add](auto const& ref) {
+            typedef typename decay_t<decltype(ref)>::element_type ref_t;
+            if constexpr(is_base_of_v<GlobalMemoryLocation, ref_t>) {
+                add(*ref);
+            } else if constexpr(is_same_v<ref_t, BaseComment>) {
+                if(auto comment = dynamic_pointer_cast<Comment>(ref)) add(comment->GetLocation());
+            }
+            // defines that refer to other defines or enum elements are saved with the system
+        }, rref);
+    });
+}
+
+void System::GetReferencingBanks(shared_ptr<Define> const& define, memory_region_set_t& regions)
+{
+    LoadDeferredBanks();
+    AddReferencingBanks(define, regions);
+}
+
+void System::GetReferencingBanks(shared_ptr<Enum> const& e, memory_region_set_t& regions)
+{
+    LoadDeferredBanks();
+    AddReferencingBanks(e, regions);
+}
+
+void System::GetReferencingBanks(shared_ptr<EnumElement> const& ee, memory_region_set_t& regions)
+{
+    LoadDeferredBanks();
+    AddReferencingBanks(ee, regions);
+}
+
+void System::GetReferencingBanks(GlobalMemoryLocation const& label_target, memory_region_set_t& regions)
+{
+    LoadDeferredBanks();
+
+    // every label at the target can change index, and the labels themselves are saved with the target
+    if(auto memory_region = GetMemoryRegion(label_target)) regions.insert(memory_region);
+    if(auto memory_object = GetMemoryObject(label_target)) {
+        for(auto& label : memory_object->labels) AddReferencingBanks(label, regions);
+    }
+}
+
+void System::InvalidateBankChunks(memory_region_set_t const& regions)
+{
+    for(auto& memory_region : regions) memory_region->MarkEdited();
+}
+
 void System::NoteReferences()
 {
+    // every reference noted fires reverse_references_changed, which only needs to happen once per object
+    signal_defer_scope defer_signals;
+
     // cpu_ram, ppu_registers, and io_registers aren't backed memory, so they can't refer to other memory
     cartridge->NoteReferences();
 }
@@ -1331,6 +1470,7 @@ SystemView::SystemView(shared_ptr<BaseSystem> const& _system, shared_ptr<MemoryV
     system = dynamic_pointer_cast<System>(_system);
 
     cartridge_view = dynamic_pointer_cast<CartridgeView>(system->cartridge->CreateMemoryView());
+    UpdatePPUPages();
 }
 
 SystemView::~SystemView()
@@ -1350,6 +1490,31 @@ u8 SystemView::Peek(u16 address)
     }
 }
 
+void SystemView::CopyCPUMemory(u8* dest)
+{
+    // RAM is mirrored four times
+    for(int i = 0; i < 4; i++) memcpy(&dest[i * 0x800], RAM, sizeof(RAM));
+
+    // the eight PPU registers are mirrored through $3FFF
+    for(int reg = 0; reg < 8; reg++) dest[0x2000 + reg] = ppu_view->Peek(reg);
+    for(int i = 0x2008; i < 0x4000; i += 8) memcpy(&dest[i], &dest[0x2000], 8);
+
+    // APU and IO registers only go up to $401F, and the rest peeks as 0
+    for(int i = 0; i < 0x20; i++) dest[0x4000 + i] = apu_io_view->Peek(i);
+    memset(&dest[0x4020], 0, 0x6000 - 0x4020);
+
+    cartridge_view->CopyCPUMemory(&dest[0x6000]);
+}
+
+void SystemView::CopyNametables(u8* dest)
+{
+    // same mirroring as PeekPPU, a 1KiB page at a time
+    MIRRORING mirroring = cartridge_view->GetNametableMirroring();
+    for(int page = 0; page < 8; page++) {
+        memcpy(&dest[page << 10], &VRAM[GetNametableOffset(mirroring, page << 10)], 0x400);
+    }
+}
+
 u8 SystemView::Read(u16 address)
 {
     if(address < 0x2000) {
@@ -1373,6 +1538,7 @@ void SystemView::Write(u16 address, u8 value)
         apu_io_view->Write(address & 0x1FFF, value);
     } else {
         cartridge_view->Write(address, value);
+        CheckPPUPages();
     }
 }
 
@@ -1432,6 +1598,7 @@ void SystemView::WritePPU(u16 address, u8 value)
     if(address < 0x2000) {
         // write to cartridge CHR-RAM
         cartridge_view->WritePPU(address, value);
+        CheckPPUPages();
     } else if(address < 0x4000) {
         // we have space for 2KiB of nametables - two full nametables,
         // and our linear local space is 0-0x7FF bytes for that.  It's trivial
@@ -1467,6 +1634,7 @@ void SystemView::WritePPU(u16 address, u8 value)
 
         // apply mirroring throughout 0x3000..0x3FFF as well
         VRAM[address & 0x7FF] = value;
+        vram_generation++;
     } else {
         assert(false);
     }
@@ -1496,15 +1664,68 @@ bool SystemView::Load(istream& is, string& errmsg)
 
     is.read((char*)RAM, sizeof(RAM));
     is.read((char*)VRAM, sizeof(VRAM));
+    vram_generation++;
     if(!is.good()) goto done;
 
     if(!ppu_view->Load(is, errmsg)) return false;
     if(!apu_io_view->Load(is, errmsg)) return false;
     if(!cartridge_view->Load(is, errmsg)) return false;
+    UpdatePPUPages();
 
 done:
     errmsg = "Error loading SystemView";
     return is.good();
 }
 
+void SystemView::CopyState(MemoryView const& _other)
+{
+    auto& other = dynamic_cast<SystemView const&>(_other);
+
+    memcpy(RAM, other.RAM, sizeof(RAM));
+    memcpy(VRAM, other.VRAM, sizeof(VRAM));
+    vram_generation++;
+
+    ppu_view->CopyState(*other.ppu_view);
+    apu_io_view->CopyState(*other.apu_io_view);
+    cartridge_view->CopyState(*other.cartridge_view);
+    UpdatePPUPages();
+}
+
+inline void SystemView::CheckPPUPages()
+{
+    if(cartridge_view->GetMappingGeneration() != ppu_pages_generation) UpdatePPUPages();
+}
+
+void SystemView::UpdatePPUPages()
+{
+    ppu_pages_generation = cartridge_view->GetMappingGeneration();
+
+    for(int page = 0; page < 8; page++) ppu_pages[page] = cartridge_view->GetCHRPage(page);
+
+    // each of the four nametables and their mirrors at $3000
+    MIRRORING mirroring = cartridge_view->GetNametableMirroring();
+    for(int page = 8; page < 16; page++) {
+        ppu_pages[page] = &VRAM[GetNametableOffset(mirroring, (page & 3) << 10)];
+    }
+
+    ppu_pages_changed->emit();
+}
+
+// same mirroring as ReadPPU
+u16 SystemView::GetNametableOffset(MIRRORING mirroring, u16 address)
+{
+    address = 0x2000 | (address & 0x0FFF);
+    switch(mirroring) {
+    case MIRRORING_VERTICAL:
+        address &= ~0x800;
+        break;
+
+    case MIRRORING_HORIZONTAL: 
+        address = ((address & 0x800) >> 1) | (address & ~0xC00);
+        break;
+    }
+
+    return address & 0x7FF;
+}
+
 }
@@ -9,6 +9,7 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "systems/system.h"
@@ -33,6 +34,7 @@ class Enum;
 class EnumElement;
 class Expression;
 class ExpressionNodeCreator;
+class Journal;
 class Label;
 class ProgramRomBank;
 class SystemView;
@@ -70,33 +72,27 @@ public:
 
     // On-demand new signal handlers for specific addresses
     std::shared_ptr<label_created_t> LabelCreatedAt(GlobalMemoryLocation const& where) {
-        if(!label_created_at.contains(where)) {
-            label_created_at[where] = std::make_shared<decltype(label_created)::element_type>();
-        }
-        return label_created_at[where];
+        auto& s = label_created_at[where];
+        if(!s) s = std::make_shared<label_created_t>();
+        return s;
     }
 
     std::shared_ptr<label_deleted_t> LabelDeletedAt(GlobalMemoryLocation const& where) {
-        if(!label_deleted_at.contains(where)) {
-            label_deleted_at[where] = std::make_shared<decltype(label_deleted)::element_type>();
-        }
-        return label_deleted_at[where];
+        auto& s = label_deleted_at[where];
+        if(!s) s = std::make_shared<label_deleted_t>();
+        return s;
     }
 
     // Be polite and tell me when you disconnect
     void LabelCreatedAtRemoved(GlobalMemoryLocation const& where) {
-        if(label_created_at.contains(where)) {
-            if(label_created_at[where]->connections.size() == 0) {
-                label_created_at.erase(where);
-            }
+        if(auto it = label_created_at.find(where); it != label_created_at.end() && it->second->empty()) {
+            label_created_at.erase(it);
         }
     }
 
     void LabelDeletedAtRemoved(GlobalMemoryLocation const& where) {
-        if(label_deleted_at.contains(where)) {
-            if(label_deleted_at[where]->connections.size() == 0) {
-                label_deleted_at.erase(where);
-            }
+        if(auto it = label_deleted_at.find(where); it != label_deleted_at.end() && it->second->empty()) {
+            label_deleted_at.erase(it);
         }
     }
 
@@ -156,7 +152,7 @@ public:
     void CreateDefaultDefines(); // for new projects
     std::shared_ptr<Define> CreateDefine(std::string const& name, std::string& errmsg);
     std::shared_ptr<Define> FindDefine(std::string const& name) {
-        if(defines.contains(name)) return defines[name];
+        if(auto it = defines.find(name); it != defines.end()) return it->second;
         return nullptr;
     }
 
@@ -176,7 +172,7 @@ public:
     std::vector<std::shared_ptr<Label>> const& GetLabelsAt(GlobalMemoryLocation const&);
 
     std::shared_ptr<Label> FindLabel(std::string const& label_str) {
-        if(label_database.contains(label_str)) return label_database[label_str];
+        if(auto it = label_database.find(label_str); it != label_database.end()) return it->second;
         return nullptr;
     }
 
@@ -282,11 +278,28 @@ public:
     //!    return label_database[where];
     //!}
 
+    // Undo and redo
+    std::shared_ptr<Journal> const& GetJournal() const { return journal; }
+
     // Save and load
     bool Save(std::ostream&, std::string&) override;
     bool Load(std::istream&, std::string&) override;
 
+    // Banks save the defines, enums and enum elements they refer to by name, and labels by their index
+    // at the target. Before one of those is renamed or deleted, GetReferencingBanks loads any deferred 
+    // banks so that their references are noted, and collects the banks that refer to it. Once the change 
+    // is made, InvalidateBankChunks marks just those banks so that they're serialized again on the next save
+    typedef std::unordered_set<std::shared_ptr<MemoryRegion>> memory_region_set_t;
+    void GetReferencingBanks(std::shared_ptr<Define> const&, memory_region_set_t&);
+    void GetReferencingBanks(std::shared_ptr<Enum> const&, memory_region_set_t&);
+    void GetReferencingBanks(std::shared_ptr<EnumElement> const&, memory_region_set_t&);
+    void GetReferencingBanks(GlobalMemoryLocation const& label_target, memory_region_set_t&);
+    void InvalidateBankChunks(memory_region_set_t const&);
+
 private:
+    void LoadDeferredBanks();
+    template<class T> void AddReferencingBanks(std::shared_ptr<T> const&, memory_region_set_t&);
+
     std::unordered_map<GlobalMemoryLocation, std::shared_ptr<label_created_t>> label_created_at;
     std::unordered_map<GlobalMemoryLocation, std::shared_ptr<label_deleted_t>> label_deleted_at;
 
@@ -320,6 +333,8 @@ private:
 
     std::shared_ptr<Disassembler> disassembler;
 
+    std::shared_ptr<Journal> journal;
+
     // Userdata passed to ExploreExpressionNodeCallback
     struct ExploreExpressionNodeData {
         std::string& errmsg; // any error generated sets an error message
@@ -363,12 +378,41 @@ public:
     u8 ReadPPU(u16) override;
     void WritePPU(u16, u8) override;
 
+    void CopyRAM(u8* dest) {
+        memcpy(dest, RAM, sizeof(RAM));
+    }
+
+    // the whole CPU address space as Peek() sees it, copied a page or bank at a time instead of a byte
+    // at a time
+    void CopyCPUMemory(u8* dest);
+
+    // $2000-$3FFF of the PPU bus as PeekPPU() sees it
+    void CopyNametables(u8* dest);
+
+    // a 256 byte page of RAM, including the mirrors up to $1FFF
+    u8 const* GetRAMPage(u8 page) const {
+        assert(page < 0x20);
+        return &RAM[(page << 8) & 0x7FF];
+    }
+
+    // incremented on every write to VRAM
+    u32 GetVRAMGeneration() const { return vram_generation; }
+
     void CopyVRAM(u8* dest, u16 offset = 0, u16 size = 0x800) {
         assert(offset < 0x800);
         int left = 0x800 - offset;
         memcpy(dest, &VRAM[offset], (left < size) ? left : size);
     }
 
+    // the PPU bus pages for PPU::SetFetchPages, rebuilt whenever the cartridge's mapping changes
+    u8 const* const* GetPPUPages() const { return ppu_pages; }
+
+    // where a nametable address ($2000-$3EFF) lands in the 2KiB of VRAM
+    static u16 GetNametableOffset(MIRRORING, u16 address);
+
+    // emitted after the PPU pages are rebuilt
+    make_signal(ppu_pages_changed, void());
+
     std::shared_ptr<MemoryView> const& GetPPUView() const { return ppu_view; }
     std::shared_ptr<CartridgeView> const& GetCartridgeView() const { return cartridge_view; }
 
@@ -376,7 +420,12 @@ public:
     bool Save(std::ostream&, std::string&) const override;
     bool Load(std::istream&, std::string&) override;
 
+    void CopyState(MemoryView const&) override;
+
 private:
+    void UpdatePPUPages();
+    void CheckPPUPages();
+
     std::shared_ptr<System> system;
     std::shared_ptr<MemoryView> ppu_view;
     std::shared_ptr<MemoryView> apu_io_view;
@@ -386,6 +435,12 @@ private:
     // read/writes there, but RAM is so simple I think I'll just embed it directly into SystemView.
     u8 RAM[0x800];
     u8 VRAM[0x800];
+    u32 vram_generation = 0;
+
+    // $0000-$1FFF CHR, $2000-$2FFF nametables, and $3000-$3FFF mirroring the nametables (palette RAM
+    // is inside the PPU, so the bus never sees $3F00-$3FFF reads for rendering)
+    u8 const* ppu_pages[16];
+    u32 ppu_pages_generation;
 };
 
 }
@@ -0,0 +1,58 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+// 
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. 
+#include <cstring>
+
+#include "systems/nes/tile_cache.h"
+
+using namespace std;
+
+namespace Systems::NES {
+
+TileCache::TileCache(int _num_tiles)
+    : num_tiles(_num_tiles)
+{
+    patterns.resize(num_tiles * TILE_PATTERN_BYTES);
+    pixels.resize(num_tiles * TILE_PIXELS);
+    serials.resize(num_tiles, 0);
+}
+
+TileCache::~TileCache()
+{
+}
+
+void TileCache::Decode(u8 const* pattern, u8* pixels)
+{
+    for(int y = 0; y < 8; y++) {
+        u8 row0 = pattern[y + 0];
+        u8 row1 = pattern[y + 8];
+        for(int x = 0; x < 8; x++) {
+            *pixels++ = (((row1 >> (7 - x)) & 0x01) << 1) | ((row0 >> (7 - x)) & 0x01);
+        }
+    }
+}
+
+bool TileCache::Update(u8 const* new_patterns, u32 new_generation)
+{
+    if(valid && new_generation == generation) return false;
+
+    bool changed = false;
+    for(int tile = 0; tile < num_tiles; tile++) {
+        u8 const* pattern = &new_patterns[tile * TILE_PATTERN_BYTES];
+        u8* last_pattern = &patterns[tile * TILE_PATTERN_BYTES];
+        if(valid && memcmp(pattern, last_pattern, TILE_PATTERN_BYTES) == 0) continue;
+
+        memcpy(last_pattern, pattern, TILE_PATTERN_BYTES);
+        Decode(pattern, &pixels[tile * TILE_PIXELS]);
+        serials[tile] = next_serial++;
+        changed = true;
+    }
+
+    valid = true;
+    generation = new_generation;
+    return changed;
+}
+
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+// 
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. 
+#pragma once
+
+#include <vector>
+
+#include "util.h"
+
+#define TILE_PATTERN_BYTES 16
+#define TILE_PIXELS        64
+
+namespace Systems::NES {
+
+// TileCache keeps 8x8 tiles decoded from their two bitplanes into one 2-bit color index per pixel (row
+// major), so drawing a tile is a copy through a 4 entry color table instead of bit twiddling.
+//
+// A cache covers one page of pattern data, like a CHR-ROM bank or the pattern tables the PPU currently
+// sees. Update() only looks at the data when its generation changes, and then only re-decodes the tiles
+// that differ from what was decoded before.
+class TileCache {
+public:
+    TileCache(int _num_tiles);
+    ~TileCache();
+
+    static void Decode(u8 const* pattern, u8* pixels);
+
+    // returns true if any tile was re-decoded
+    bool Update(u8 const* patterns, u32 generation);
+
+    int       GetNumTiles()        const { return num_tiles; }
+    u8 const* GetTile(int tile)    const { return &pixels[tile * TILE_PIXELS]; }
+
+    // changes every time the tile is re-decoded
+    u32       GetTileSerial(int tile) const { return serials[tile]; }
+
+private:
+    int              num_tiles;
+    bool             valid = false;
+    u32              generation = 0;
+
+    std::vector<u8>  patterns; // the pattern data as last decoded
+    std::vector<u8>  pixels;
+    std::vector<u32> serials;
+    u32              next_serial = 1;
+};
+
+}
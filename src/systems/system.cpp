@@ -9,6 +9,8 @@
 
 using namespace std;
 
+atomic<u64> BaseSystem::format_generation = 1;
+
 BaseSystem::BaseSystem() 
 {
 }
@@ -5,6 +5,7 @@
 // LICENSE file in the root directory of this source tree. 
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <functional>
@@ -19,4 +20,12 @@ public:
 
     virtual bool Save(std::ostream& os, std::string&) = 0;
     virtual bool Load(std::istream&, std::string&) = 0;
+
+    // The UI caches formatted text (operands, comments, etc). Anything that can change how a name is
+    // printed (labels, defines, enums) bumps the format generation, which invalidates every cache at once
+    static u64  GetFormatGeneration()    { return format_generation; }
+    static void InvalidateFormatCaches() { format_generation++; }
+
+private:
+    static std::atomic<u64> format_generation;
 };
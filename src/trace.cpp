@@ -0,0 +1,209 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include "trace.h"
+
+#if defined(ENABLE_TRACING)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace Trace {
+
+namespace {
+
+struct Event {
+    char const* name;
+    u64         start;
+    u64         duration;
+};
+
+// Only the owning thread writes to a buffer. count is published with release so that Export sees
+// every event before it
+struct ThreadBuffer {
+    int                 tid;
+    string              name;
+    unique_ptr<Event[]> events = make_unique<Event[]>(TRACE_BUFFER_SIZE);
+    atomic<u64>         count = 0;
+};
+
+struct RetiredEvent {
+    int   tid;
+    Event event;
+};
+
+// live holds the buffers of running threads. when a thread exits, its events move to retired (so the
+// load and save threads still show up after they finish) and its buffer is emptied and kept for the next
+// new thread, so short lived threads don't each allocate one. every thread gets its own tid
+struct Buffers {
+    mutex                            lock;
+    vector<shared_ptr<ThreadBuffer>> live;
+    vector<shared_ptr<ThreadBuffer>> spare;
+    deque<RetiredEvent>              retired;
+    unordered_map<int, string>       retired_names;
+    int                              next_tid = 1;
+};
+
+Buffers& GetBuffers()
+{
+    static Buffers buffers;
+    return buffers;
+}
+
+struct ThreadBufferHolder {
+    shared_ptr<ThreadBuffer> buffer;
+
+    ~ThreadBufferHolder() {
+        if(!buffer) return;
+
+        auto& buffers = GetBuffers();
+        lock_guard<mutex> lock(buffers.lock);
+
+        u64 count = buffer->count.load(memory_order_relaxed);
+        u64 start = (count > TRACE_BUFFER_SIZE) ? (count - TRACE_BUFFER_SIZE) : 0;
+        for(u64 i = start; i < count; i++) {
+            buffers.retired.push_back({ buffer->tid, buffer->events[i & (TRACE_BUFFER_SIZE - 1)] });
+        }
+        while(buffers.retired.size() > TRACE_RETIRED_EVENTS) buffers.retired.pop_front();
+        if(buffer->name.size()) buffers.retired_names[buffer->tid] = buffer->name;
+
+        buffers.live.erase(find(buffers.live.begin(), buffers.live.end(), buffer));
+
+        buffer->name.clear();
+        buffer->count.store(0, memory_order_relaxed);
+        buffers.spare.push_back(buffer);
+    }
+};
+
+thread_local ThreadBufferHolder thread_buffer;
+
+ThreadBuffer* GetThreadBuffer()
+{
+    [[unlikely]] if(!thread_buffer.buffer) {
+        auto& buffers = GetBuffers();
+        lock_guard<mutex> lock(buffers.lock);
+
+        if(buffers.spare.size()) {
+            thread_buffer.buffer = buffers.spare.back();
+            buffers.spare.pop_back();
+        } else {
+            thread_buffer.buffer = make_shared<ThreadBuffer>();
+        }
+
+        thread_buffer.buffer->tid = buffers.next_tid++;
+        buffers.live.push_back(thread_buffer.buffer);
+    }
+
+    return thread_buffer.buffer.get();
+}
+
+chrono::steady_clock::time_point const process_start = chrono::steady_clock::now();
+
+void WriteJSONString(ostream& os, char const* s)
+{
+    os << '"';
+    for(; s && *s; s++) {
+        if(*s == '"' || *s == '\\') os << '\\';
+        if((u8)*s >= 0x20) os << *s;
+    }
+    os << '"';
+}
+
+}
+
+u64 Now()
+{
+    return (u64)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - process_start).count();
+}
+
+void Record(char const* name, u64 start, u64 end)
+{
+    auto buffer = GetThreadBuffer();
+    u64 index = buffer->count.load(memory_order_relaxed);
+
+    auto& event = buffer->events[index & (TRACE_BUFFER_SIZE - 1)];
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+
+    buffer->count.store(index + 1, memory_order_release);
+}
+
+void SetThreadName(char const* name)
+{
+    auto buffer = GetThreadBuffer();
+
+    lock_guard<mutex> lock(GetBuffers().lock);
+    buffer->name = name;
+}
+
+bool Export(ostream& os, string& errmsg)
+{
+    auto& buffers = GetBuffers();
+    lock_guard<mutex> lock(buffers.lock);
+
+    // timestamps are in microseconds
+    auto write_time = [&os](u64 ns) {
+        os << (ns / 1000) << '.' << (char)('0' + (ns / 100) % 10) << (char)('0' + (ns / 10) % 10) << (char)('0' + ns % 10);
+    };
+
+    os << "{\"traceEvents\":[" << endl;
+
+    bool first = true;
+    auto write_name = [&os, &first](int tid, string const& name) {
+        os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+        WriteJSONString(os, name.c_str());
+        os << "}}";
+        first = false;
+    };
+
+    auto write_event = [&os, &first, &write_time](int tid, Event const& event) {
+        os << (first ? "" : ",\n") << "{\"name\":";
+        WriteJSONString(os, event.name);
+        os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+        write_time(event.start);
+        os << ",\"dur\":";
+        write_time(event.duration);
+        os << "}";
+        first = false;
+    };
+
+    for(auto& [tid, name] : buffers.retired_names) write_name(tid, name);
+    for(auto& retired : buffers.retired) write_event(retired.tid, retired.event);
+
+    for(auto& buffer : buffers.live) {
+        if(buffer->name.size()) write_name(buffer->tid, buffer->name);
+
+        u64 count = buffer->count.load(memory_order_acquire);
+        u64 start = (count > TRACE_BUFFER_SIZE) ? (count - TRACE_BUFFER_SIZE) : 0;
+        for(u64 i = start; i < count; i++) write_event(buffer->tid, buffer->events[i & (TRACE_BUFFER_SIZE - 1)]);
+    }
+
+    os << "\n],\"displayTimeUnit\":\"ms\"}" << endl;
+
+    errmsg = "Error writing trace";
+    return os.good();
+}
+
+void Clear()
+{
+    auto& buffers = GetBuffers();
+    lock_guard<mutex> lock(buffers.lock);
+    for(auto& buffer : buffers.live) buffer->count.store(0, memory_order_release);
+    buffers.retired.clear();
+    buffers.retired_names.clear();
+}
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "util.h"
+
+// Scoped tracing. Put TRACE_SCOPE("Name") at the top of a block, and the time spent in the block is
+// recorded into a ring buffer owned by the calling thread. Trace::Export writes everything that has
+// been recorded as Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev can open.
+//
+// Tracing only exists when ENABLE_TRACING is defined (the ENABLE_TRACING CMake option). Otherwise the
+// macros expand to nothing and there is no cost at all.
+//
+// Names must be string literals (or otherwise live forever), since only the pointer is recorded.
+
+// events kept per thread before the oldest are overwritten. must be a power of 2
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+// events kept from threads that have exited, across all of them, before the oldest are dropped
+#define TRACE_RETIRED_EVENTS (1 << 18)
+
+#if defined(ENABLE_TRACING)
+
+namespace Trace {
+
+// nanoseconds since the process started
+u64  Now();
+
+void Record(char const* name, u64 start, u64 end);
+
+// Name the calling thread in the exported trace
+void SetThreadName(char const* name);
+
+// Write every thread's events. Threads can keep recording while this runs, but events that are
+// overwritten during the export may come out garbled
+bool Export(std::ostream&, std::string& errmsg);
+
+// Forget all recorded events. Only call when no other thread is recording
+void Clear();
+
+class Scope {
+public:
+    Scope(char const* _name) : name(_name), start(Now()) {}
+    ~Scope() { Record(name, start, Now()); }
+
+    Scope(Scope const&) = delete;
+    void operator=(Scope const&) = delete;
+
+private:
+    char const* name;
+    u64         start;
+};
+
+}
+
+#define _TRACE_CONCAT2(a, b) a##b
+#define _TRACE_CONCAT(a, b)  _TRACE_CONCAT2(a, b)
+
+#define TRACE_SCOPE(name)       Trace::Scope _TRACE_CONCAT(_trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Trace::SetThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+
+#endif
@@ -6,10 +6,12 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -238,6 +240,43 @@ inline T ReadEnum(std::istream& is)
     return static_cast<T>(tmp);
 }
 
+// Read-only stream over a block of memory owned by someone else, so that sections of a
+// file that have already been read can be parsed later without copying them again
+class MemoryStreamBuffer : public std::streambuf {
+public:
+    MemoryStreamBuffer(u8 const* data, size_t size) {
+        char* p = const_cast<char*>(reinterpret_cast<char const*>(data));
+        setg(p, p, p + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        // there's only a get area
+        if(!(which & std::ios_base::in)) return pos_type(off_type(-1));
+
+        char* p = (dir == std::ios_base::beg) ? eback() : ((dir == std::ios_base::end) ? egptr() : gptr());
+        p += off;
+        if(p < eback() || p > egptr()) return pos_type(off_type(-1));
+        setg(eback(), p, egptr());
+        return pos_type(p - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+class MemoryInputStream : public std::istream {
+public:
+    MemoryInputStream(u8 const* data, size_t size)
+        : std::istream(nullptr), buffer(data, size) {
+        rdbuf(&buffer);
+    }
+
+private:
+    MemoryStreamBuffer buffer;
+};
+
 template<class T>
 inline void zero(T* mem) {
     memset(mem, 0, sizeof(T));
@@ -34,9 +34,12 @@ enum FILE_VERSIONS {
     FILE_VERSION_BLANKLINES  = 0x00000107,   // custom blank lines
     FILE_VERSION_QUICKEXP    = 0x00000108,   // quick expressions
     FILE_VERSION_ENUMSIZE    = 0x00000109,   // changeable enum sizes
+    FILE_VERSION_CHUNKED     = 0x0000010A,   // cartridge banks stored as chunks with a table of contents
+    FILE_VERSION_COMPRESSION = 0x0000010B,   // compressed bank chunks and save states
+    FILE_VERSION_WATCHPOINTS = 0x0000010C,   // breakpoints over address ranges and whole banks
 
     // update me every time a new file version is added
-    FILE_VERSION_LAST = FILE_VERSION_ENUMSIZE
+    FILE_VERSION_LAST = FILE_VERSION_WATCHPOINTS
 };
 
 class BaseSystem;
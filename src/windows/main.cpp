@@ -3,6 +3,7 @@
 // 
 // This source code is licensed under the BSD-style license found in the
 // LICENSE file in the root directory of this source tree. 
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -16,6 +17,7 @@
 #include "dirent/dirent.h"
 
 #include "../main_application.h"
+#include "trace.h"
 
 #include "windows/baseproject.h"
 #include "windows/main.h"
@@ -198,6 +200,13 @@ void MainWindow::RenderMenuBar()
             CloseProject();
         }
 
+#if defined(ENABLE_TRACING)
+        ImGui::Separator();
+        if(ImGui::MenuItem("Save Trace")) {
+            SaveTrace();
+        }
+#endif
+
         ImGui::Separator();
         if(ImGui::MenuItem("Exit", "ctrl+x")) {
             command_signal->emit(shared_from_this(), "RequestExit", nullptr);
@@ -801,6 +810,9 @@ void MainWindow::DeleteInstancePopup()
 
 void MainWindow::SaveProjectThread()
 {
+    TRACE_THREAD_NAME("Save Project");
+    TRACE_SCOPE("MainWindow::SaveProjectThread");
+
     // rename the old file if it exists, can just ignore errors
     stringstream ss;
     ss << project_file_path << ".bak";
@@ -819,9 +831,13 @@ void MainWindow::SaveProjectThread()
 
         if(out.good()) {
             // save the project data
-            popups.save_project.errored = !current_project->Save(out, popups.save_project.errmsg);
+            {
+                TRACE_SCOPE("Project::Save");
+                popups.save_project.errored = !current_project->Save(out, popups.save_project.errmsg);
+            }
             if(!popups.save_project.errored) {
                 // current_project is the parent to all windows related to the project
+                TRACE_SCOPE("Project::SaveWorkspace");
                 popups.save_project.errored = !current_project->SaveWorkspace(out, popups.save_project.errmsg);
             }
         } else {
@@ -833,7 +849,10 @@ void MainWindow::SaveProjectThread()
         popups.save_project.errmsg = "Could not open file";
     }
     
-    if(out.good()) out.flush();
+    if(out.good()) {
+        TRACE_SCOPE("Flush");
+        out.flush();
+    }
     if(!popups.save_project.errored) {
         std::this_thread::sleep_for(std::chrono::milliseconds(500));
     }
@@ -842,6 +861,9 @@ void MainWindow::SaveProjectThread()
 
 void MainWindow::LoadProjectThread()
 {
+    TRACE_THREAD_NAME("Load Project");
+    TRACE_SCOPE("MainWindow::LoadProjectThread");
+
     cout << "load thread" << endl;
 
     ifstream is(project_file_path, ios::binary);
@@ -874,10 +896,16 @@ void MainWindow::LoadProjectThread()
 
         if(!popups.load_project.errored) {
             current_project = BaseProject::StartLoadProject(is, popups.load_project.errmsg, version, flags);
-            if(current_project && !current_project->Load(is, popups.load_project.errmsg)) {
+            bool loaded;
+            {
+                TRACE_SCOPE("Project::Load");
+                loaded = !current_project || current_project->Load(is, popups.load_project.errmsg);
+            }
+            if(!loaded) {
                 current_project = nullptr;
             } else {
                 // continue loading the workspace
+                TRACE_SCOPE("Project::LoadWorkspace");
                 if(!current_project->LoadWorkspace(is, popups.load_project.errmsg)) {
                     current_project = nullptr;
                 }
@@ -896,6 +924,21 @@ void MainWindow::LoadProjectThread()
     popups.load_project.loading = false;
 }
 
+#if defined(ENABLE_TRACING)
+void MainWindow::SaveTrace()
+{
+    string file_path = "rds-trace.json";
+    ofstream os(file_path);
+
+    string errmsg;
+    if(!Trace::Export(os, errmsg)) {
+        cout << WindowPrefix() << "could not save trace: " << errmsg << endl;
+    } else {
+        cout << WindowPrefix() << "trace saved to " << file_path << endl;
+    }
+}
+#endif
+
 
 
 }
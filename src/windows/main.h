@@ -80,6 +80,7 @@ public:
 
     // Project
     inline std::shared_ptr<BaseProject> GetCurrentProject() { return current_project; }
+    inline void SetCurrentProject(std::shared_ptr<BaseProject> const& project) { current_project = project; } // headless only
 
 protected:
     void CheckInput() override;
@@ -99,6 +100,10 @@ private:
 
     void CloseProject();
 
+#if defined(ENABLE_TRACING)
+    void SaveTrace();
+#endif
+
     void OpenROMInfosPane();
 
     // Popups
@@ -8,8 +8,10 @@
 #include <cinttypes>
 #include <cmath>
 #include <cstdio>
+#include <fstream>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include <GL/gl3w.h>
@@ -18,7 +20,9 @@
 #include "imgui_internal.h"
 #include "imgui_stdlib.h"
 #include "magic_enum.hpp"
+#include "ImGuiFileDialog.h"
 
+#include "compression.h"
 #include "util.h"
 
 #include "systems/nes/apu_io.h"
@@ -26,6 +30,7 @@
 #include "systems/nes/cpu.h"
 #include "systems/nes/disasm.h"
 #include "systems/nes/expressions.h"
+#include "systems/nes/movie.h"
 #include "systems/nes/ppu.h"
 #include "systems/nes/system.h"
 
@@ -36,7 +41,9 @@
 #include "windows/nes/listing.h"
 #include "windows/nes/project.h"
 #include "windows/nes/quickexpressions.h"
+#include "windows/nes/ramsearch.h"
 #include "windows/nes/regions.h"
+#include "windows/nes/search.h"
 
 using namespace std;
 
@@ -64,6 +71,8 @@ bool BreakpointInfo::Save(ostream& os, string& errmsg) const
     WriteVarInt(os, (int)break_read);
     WriteVarInt(os, (int)break_write);
     WriteVarInt(os, (int)break_execute);
+    WriteVarInt(os, size);
+    WriteVarInt(os, (int)whole_bank);
     if(!os.good()) {
         errmsg = "Error saving BreakpointInfo";
         return false;
@@ -83,6 +92,11 @@ bool BreakpointInfo::Load(istream& is, string& errmsg)
     break_read = (bool)ReadVarInt<int>(is);
     break_write = (bool)ReadVarInt<int>(is);
     break_execute = (bool)ReadVarInt<int>(is);
+    if(GetCurrentProject()->GetSaveFileVersion() >= FILE_VERSION_WATCHPOINTS) {
+        // a size of zero would wrap around and watch the whole address space
+        size = max(1u, ReadVarInt<u32>(is));
+        whole_bank = (bool)ReadVarInt<int>(is);
+    }
     if(!is.good()) {
         errmsg = "Error loading BreakpointInfo";
         return false;
@@ -90,6 +104,15 @@ bool BreakpointInfo::Load(istream& is, string& errmsg)
     return true;
 }
 
+bool BreakpointInfo::Covers(u16 cpu_address, u16 prg_rom_bank) const
+{
+    if(whole_bank) return (cpu_address & 0x8000) && address.prg_rom_bank == prg_rom_bank;
+
+    // the bank only matters in bankable space
+    if(has_bank && (cpu_address & 0x8000) && address.prg_rom_bank != prg_rom_bank) return false;
+    return cpu_address >= address.address && cpu_address < address.address + size;
+}
+
 std::shared_ptr<SystemInstance> SystemInstance::CreateWindow()
 {
     return make_shared<SystemInstance>();
@@ -109,55 +132,36 @@ SystemInstance::SystemInstance()
     // watch for new child windows
     *child_window_added += std::bind(&SystemInstance::ChildWindowAdded, this, placeholders::_1);
     
-    // allocate cpu_quick_breakpoints
-    auto size = 0x10000 / (8 * sizeof(u32)); // one bit for 64KiB memory space
-    cout << WindowPrefix() << "allocated " << dec << size << " bytes for CPU breakpoint cache" << endl;
-    cpu_quick_breakpoints = new u32[size];
-    memset(cpu_quick_breakpoints, 0, size);
-
-    // allocate storage for framebuffers
-    framebuffer = (u32*)new u8[sizeof(u32) * 256 * 256];
-
-    // fill the framebuffer with fully transparent pixels (0), so the bottom 16 rows aren't visible
-    memset(framebuffer, 0, 4 * 256 * 256);
+    // allocate the breakpoint access filter
+    cout << WindowPrefix() << "allocated " << dec << sizeof(Machine::AccessFilter) << " bytes for CPU breakpoint cache" << endl;
+    access_filter.live = new Machine::AccessFilter;
+    access_filter.live->Clear();
+    access_filter.next = new Machine::AccessFilter;
+    access_filter.next->Clear();
 
     if(current_system = GetSystem()) {
-        auto& mv = memory_view;
-
-        ppu = make_shared<PPU>(
-            [this](int high) {
-                cpu->Nmi(high);
-            },
-            [this, &mv](u16 address)->u8 { // capturing the reference means the pointer can change after this initialization
-                return memory_view->PeekPPU(address & 0x3FFF);
-            },
-            [this, &mv](u16 address)->u8 { 
-                return memory_view->ReadPPU(address & 0x3FFF);
-            },
-            [this, &mv](u16 address, u8 value)->void {
-                memory_view->WritePPU(address & 0x3FFF, value);
+        machine = make_shared<Machine>(current_system);
+        machine->SetAccessFilter(access_filter.live, [this](u16 address, Machine::ACCESS access) {
+            switch(access) {
+            case Machine::ACCESS::READ:
+                CheckBreakpoints(address, CheckBreakpointMode::READ);
+                break;
+            case Machine::ACCESS::WRITE:
+                CheckBreakpoints(address, CheckBreakpointMode::WRITE);
+                break;
+            case Machine::ACCESS::EXECUTE:
+                CheckBreakpoints(address, CheckBreakpointMode::EXECUTE);
+                break;
             }
-        );
+        });
 
-        apu_io = make_shared<APU_IO>();
-        oam_dma_callback_connection = apu_io->oam_dma_callback->connect(std::bind(&SystemInstance::WriteOAMDMA, this, placeholders::_1));
+        cartridge_view = dynamic_pointer_cast<Systems::NES::SystemView>(machine->GetMemoryView())->GetCartridgeView();
 
-        memory_view = current_system->CreateMemoryView(ppu->CreateMemoryView(), apu_io->CreateMemoryView());
+        // sampled timing is cheap enough to always keep
+        machine->EnableTiming(true);
+        last_timing = machine->GetTiming();
 
-        cpu = make_shared<CPU>(
-            [this](u16 address, bool opcode_fetch)->u8 {
-                [[unlikely]] if(cpu_quick_breakpoints[address >> 5] & (1 << (address & 0x1F))) {
-                    CheckBreakpoints(address, opcode_fetch ? CheckBreakpointMode::EXECUTE : CheckBreakpointMode::READ);
-                }
-                return memory_view->Read(address);
-            },
-            [this](u16 address, u8 value)->void {
-                [[unlikely]] if(cpu_quick_breakpoints[address >> 5] & (1 << (address & 0x1F))) {
-                    CheckBreakpoints(address, CheckBreakpointMode::WRITE);
-                }
-                memory_view->Write(address, value);
-            }
-        );
+        snapshots = make_unique<MachineSnapshot[]>(3);
 
         // start the emulation thread
         emulation_thread = make_shared<thread>(std::bind(&SystemInstance::EmulationThread, this));
@@ -168,13 +172,15 @@ SystemInstance::SystemInstance()
     // when this window becomes hidden, we should stop the emulation
     // TODO might be wise to exit the thread too, and then when the emulation starts again to recreate the thread
     *window_hidden += [this](shared_ptr<BaseWindow> const&) {
-        if(current_state == State::RUNNING) {
+        if(IsRunning()) {
             current_state = State::PAUSED;
             while(running) ;
         }
         UpdateTitle();
     };
 
+    movie = make_shared<Movie>();
+
     CreateStateVariableTable();
 
     Reset();
@@ -183,28 +189,31 @@ SystemInstance::SystemInstance()
 
 SystemInstance::~SystemInstance()
 {
+    verify.cancel = true;
+    if(verify.thread) verify.thread->join();
+
     exit_thread = true;
     if(emulation_thread) emulation_thread->join();
 
-    delete [] (u8*)framebuffer;
-    delete [] cpu_quick_breakpoints;
+    delete access_filter.live;
+    delete access_filter.next;
 }
 
 void SystemInstance::CreateStateVariableTable()
 {
     auto& st = state_variable_table;
 
-    st["a"]     = [&]() { return (s64)cpu->GetA(); };
-    st["x"]     = [&]() { return (s64)cpu->GetX(); };
-    st["y"]     = [&]() { return (s64)cpu->GetY(); };
-    st["s"]     = [&]() { return (s64)cpu->GetS(); };
-    st["p"]     = [&]() { return (s64)cpu->GetP(); };
-    st["pc"]    = [&]() { return (s64)cpu->GetPC(); };
-    st["istep"] = [&]() { return (s64)cpu->GetIStep(); };
-
-    st["scanline"] = [&]() { return (s64)ppu->GetScanline(); };
-    st["ppucycle"] = [&]() { return (s64)ppu->GetCycle(); };
-    st["frame"]    = [&]() { return (s64)ppu->GetFrame(); };
+    st["a"]     = [this]() { return (s64)GetCPU()->GetA(); };
+    st["x"]     = [this]() { return (s64)GetCPU()->GetX(); };
+    st["y"]     = [this]() { return (s64)GetCPU()->GetY(); };
+    st["s"]     = [this]() { return (s64)GetCPU()->GetS(); };
+    st["p"]     = [this]() { return (s64)GetCPU()->GetP(); };
+    st["pc"]    = [this]() { return (s64)GetCPU()->GetPC(); };
+    st["istep"] = [this]() { return (s64)GetCPU()->GetIStep(); };
+
+    st["scanline"] = [this]() { return (s64)GetPPU()->GetScanline(); };
+    st["ppucycle"] = [this]() { return (s64)GetPPU()->GetCycle(); };
+    st["frame"]    = [this]() { return (s64)GetPPU()->GetFrame(); };
 }
 
 void SystemInstance::RenderInstanceMenu()
@@ -213,7 +222,7 @@ void SystemInstance::RenderInstanceMenu()
         static char const * const window_types[] = {
             "Defines", "Regions", "Labels", "Listing", "Memory", 
             "Screen", "PPUState", "CPUState", "Watch", "Breakpoints", "Memory",
-            "Enums", "Expressions"
+            "Enums", "Expressions", "Search", "RAM Search"
         };
 
         for(int i = 0; i < IM_ARRAYSIZE(window_types); i++) {
@@ -231,6 +240,10 @@ void SystemInstance::RenderInstanceMenu()
             save_states.push_back(new_state);
         }
 
+        if(ImGui::MenuItem("Fork Instance", nullptr, false, (bool)machine)) {
+            ForkInstance();
+        }
+
         ImGui::Separator();
 
         int i = 0;
@@ -276,6 +289,144 @@ void SystemInstance::RenderInstanceMenu()
         ImGui::EndMenu();
     }
 
+    if(ImGui::BeginMenu("Movie")) {
+        auto mode = movie->GetMode();
+        bool idle = (mode == Movie::MODE::IDLE);
+
+        if(ImGui::MenuItem("Start Recording", nullptr, false, machine && idle)) {
+            StartMovie(true);
+        }
+
+        if(ImGui::MenuItem("Play", nullptr, false, machine && idle && movie->GetLength() > 0)) {
+            StartMovie(false);
+        }
+
+        if(ImGui::MenuItem("Stop", nullptr, false, !idle)) {
+            StopMovie();
+        }
+
+        ImGui::Separator();
+
+        if(ImGui::MenuItem("Verify", nullptr, false, machine && idle && movie->GetLength() > 0 && !verify.thread)) {
+            VerifyMovie();
+        }
+
+        ImGui::Separator();
+
+        if(ImGui::MenuItem("Save Movie...", nullptr, false, idle && movie->GetLength() > 0)) {
+            ImGuiFileDialog::Instance()->OpenDialog("SaveMovieFileDialog", "Save Movie", "Movie Files (*.rdsmovie){.rdsmovie}", "./roms/", "",
+                                                   1, nullptr, ImGuiFileDialogFlags_Modal | ImGuiFileDialogFlags_ConfirmOverwrite);
+        }
+
+        if(ImGui::MenuItem("Load Movie...", nullptr, false, idle)) {
+            ImGuiFileDialog::Instance()->OpenDialog("OpenMovieFileDialog", "Load Movie", "Movie Files (*.rdsmovie){.rdsmovie}", "./roms/", "",
+                                                   1, nullptr, ImGuiFileDialogFlags_Modal | ImGuiFileDialogFlags_ReadOnlyFileNameField);
+        }
+
+        ImGui::EndMenu();
+    }
+
+    if(ImGui::BeginMenu("Emulation")) {
+        bool pipelined = machine && machine->IsPipelinedRendering();
+        if(ImGui::MenuItem("Pipelined Rendering", nullptr, pipelined, (bool)machine)) {
+            SetPipelinedRendering(!pipelined);
+        }
+
+        if(ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Draw the screen on a second thread, leaving the emulation thread to run the CPU");
+        }
+
+        ImGui::EndMenu();
+    }
+}
+
+void SystemInstance::SetPipelinedRendering(bool enable)
+{
+    auto last_state = current_state;
+    if(IsRunning()) {
+        current_state = State::PAUSED;
+        while(running) ;
+    }
+
+    machine->SetPipelinedRendering(enable);
+    cout << WindowPrefix() << "pipelined rendering " << (enable ? "enabled" : "disabled") << endl;
+
+    current_state = last_state;
+}
+
+void SystemInstance::StartMovie(bool record)
+{
+    // the movie attaches to the machine, which can't be running while it does
+    auto last_state = current_state;
+    if(IsRunning()) {
+        current_state = State::PAUSED;
+        while(running) ;
+    }
+
+    string errmsg;
+    bool ok = record ? movie->StartRecording(*machine, MOVIE_HASH_INTERVAL, errmsg) : movie->StartPlayback(*machine, errmsg);
+    if(!ok) cout << WindowPrefix() << "couldn't start movie: " << errmsg << endl;
+
+    current_state = last_state;
+}
+
+void SystemInstance::StopMovie()
+{
+    auto last_state = current_state;
+    if(IsRunning()) {
+        current_state = State::PAUSED;
+        while(running) ;
+    }
+
+    movie->Stop();
+
+    current_state = last_state;
+}
+
+bool SystemInstance::LoadMovie(istream& is, string& errmsg)
+{
+    // a movie file that fails to load leaves the current movie as it was
+    auto new_movie = make_shared<Movie>();
+    if(!new_movie->Load(is, errmsg)) return false;
+
+    // a finished playback is still attached to the machine, so detach it while the machine isn't running
+    auto last_state = current_state;
+    if(IsRunning()) {
+        current_state = State::PAUSED;
+        while(running) ;
+    }
+
+    movie->Stop();
+    movie = new_movie;
+
+    current_state = last_state;
+    return true;
+}
+
+void SystemInstance::VerifyMovie()
+{
+    // the machine can't change while it's copied
+    auto last_state = current_state;
+    if(IsRunning()) {
+        current_state = State::PAUSED;
+        while(running) ;
+    }
+
+    auto verify_machine = machine->Fork(true);
+    current_state = last_state;
+
+    // play it back as fast as possible without holding up the UI. the copy of the movie leaves this one
+    // free to be played or recorded in the meantime
+    auto verify_movie = make_shared<Movie>(*movie);
+    verify.done   = false;
+    verify.cancel = false;
+    verify.thread = make_shared<thread>([this, verify_machine, verify_movie]() {
+        verify.success = verify_movie->Verify(*verify_machine, verify.errmsg, &verify.cancel);
+        verify.length  = verify_movie->GetLength();
+        verify.done.store(true, memory_order_release);
+    });
+
+    cout << WindowPrefix() << "verifying movie (" << dec << movie->GetLength() << " frames)" << endl;
 }
 
 void SystemInstance::CreateDefaultWorkspace()
@@ -305,7 +456,7 @@ void SystemInstance::CreateDefaultWorkspace()
     CreateNewWindow("Breakpoints");
 }
 
-void SystemInstance::CreateNewWindow(string const& window_type)
+shared_ptr<BaseWindow> SystemInstance::CreateNewWindow(string const& window_type)
 {
     shared_ptr<BaseWindow> wnd;
     if(window_type == "Listing") {
@@ -326,6 +477,9 @@ void SystemInstance::CreateNewWindow(string const& window_type)
     } else if(window_type == "Expressions") {
         wnd = QuickExpressions::CreateWindow();
         wnd->SetInitialDock(BaseWindow::DOCK_LEFT);
+    } else if(window_type == "Search") {
+        wnd = Search::CreateWindow();
+        wnd->SetInitialDock(BaseWindow::DOCK_BOTTOMLEFT);
     } else if(window_type == "Screen") {
         wnd = Screen::CreateWindow();
         wnd->SetInitialDock(BaseWindow::DOCK_RIGHTTOP);
@@ -344,9 +498,13 @@ void SystemInstance::CreateNewWindow(string const& window_type)
     } else if(window_type == "Memory") {
         wnd = Memory::CreateWindow();
         wnd->SetInitialDock(BaseWindow::DOCK_BOTTOMLEFT);
+    } else if(window_type == "RAM Search") {
+        wnd = RAMSearch::CreateWindow();
+        wnd->SetInitialDock(BaseWindow::DOCK_BOTTOMLEFT);
     }
 
-    AddChildWindow(wnd);
+    if(wnd) AddChildWindow(wnd);
+    return wnd;
 }
 
 void SystemInstance::ChildWindowAdded(std::shared_ptr<BaseWindow> const& window)
@@ -395,14 +553,26 @@ void SystemInstance::Update(double deltaTime)
             }
         }
 
+        // same layout as Visual Studio: F10 over, F11 into, Shift+F11 out, Ctrl+F10 to cursor
+        auto const& io = ImGui::GetIO();
         if(ImGui::IsKeyPressed(ImGuiKey_F10)) {
-            if(current_state == State::PAUSED) {
+            if(io.KeyCtrl) {
+                if(auto listing = GetMostRecentListingWindow()) RunTo(listing->GetCurrentSelection());
+            } else {
+                StepOver();
+            }
+        }
+
+        if(ImGui::IsKeyPressed(ImGuiKey_F11)) {
+            if(io.KeyShift) {
+                StepOut();
+            } else if(current_state == State::PAUSED) {
                 current_state = State::STEP_INSTRUCTION;
             }
         }
 
         if(ImGui::IsKeyPressed(ImGuiKey_Escape) && ImGui::IsKeyPressed(ImGuiKey_LeftCtrl)) {
-            if(current_state == State::RUNNING) {
+            if(IsRunning()) {
                 current_state = State::PAUSED;
             }
         }
@@ -412,7 +582,39 @@ void SystemInstance::Update(double deltaTime)
         cout << "uh oh thread exited" << endl;
     }
 
-    u64 cycle_count = cpu->GetCycleCount();
+    if(verify.thread && verify.done.load(memory_order_acquire)) {
+        verify.thread->join();
+        verify.thread = nullptr;
+
+        if(verify.success) {
+            cout << WindowPrefix() << "movie verified (" << dec << verify.length << " frames)" << endl;
+        } else {
+            cout << WindowPrefix() << "movie verification failed: " << verify.errmsg << endl;
+        }
+    }
+
+    if(machine) {
+        bool new_frame;
+        display_framebuffer = machine->TakeLatestFrame(new_frame);
+        if(new_frame) display_framebuffer_serial++;
+    }
+
+    // take the newest machine snapshot, and ask for the next one. the emulation thread publishes them
+    // while running, otherwise it's idle and the machine can be read from here (registers and memory
+    // can be edited while paused, so this happens every frame)
+    if(snapshots) {
+        bool idle = (current_state == State::PAUSED || current_state == State::CRASHED) && !running;
+        if(idle) PublishSnapshot();
+
+        if(snapshot_ready_state.load(memory_order_relaxed) & SNAPSHOT_READY_NEW) {
+            int ready = snapshot_ready_state.exchange(snapshot_front_index, memory_order_acq_rel);
+            snapshot_front_index = ready & SNAPSHOT_READY_INDEX;
+            display_snapshot = &snapshots[snapshot_front_index];
+        }
+        snapshot_requested = true;
+    }
+
+    u64 cycle_count = machine ? machine->GetCPU()->GetCycleCount() : 0;
     auto current_time = chrono::steady_clock::now();
     u64 delta = cycle_count - last_cycle_count;
     double delta_time = (current_time - last_cycle_time) / 1.0s;
@@ -420,6 +622,24 @@ void SystemInstance::Update(double deltaTime)
         cycles_per_sec = delta / delta_time;
         last_cycle_time = current_time;
         last_cycle_count = cycle_count;
+
+        if(machine) {
+            auto timing = machine->GetTiming();
+            auto period = timing - last_timing;
+            last_timing = timing;
+
+            timing_stats.frames_per_sec   = period.frames / delta_time;
+            timing_stats.percent_realtime = 100.0 * cycles_per_sec / NES_CPU_CLOCK_HZ;
+
+            // only update the breakdown when something ran, so it stays visible while paused
+            if(u64 total = period.SampledTotal()) {
+                timing_stats.cpu         = 100.0 * period.cpu / total;
+                timing_stats.memory      = 100.0 * period.memory / total;
+                timing_stats.breakpoints = 100.0 * period.breakpoints / total;
+                timing_stats.ppu         = 100.0 * period.ppu / total;
+                timing_stats.oam_dma     = 100.0 * period.oam_dma / total;
+            }
+        }
     }
 }
 
@@ -427,7 +647,7 @@ void SystemInstance::RenderMenuBar()
 {
     if(current_state == State::PAUSED && ImGui::Button("Run")) {
         current_state = State::RUNNING;
-    } else if(current_state == State::RUNNING && ImGui::Button("Stop")) {
+    } else if(IsRunning() && ImGui::Button("Stop")) {
         current_state = State::PAUSED;
         if(auto listing = GetMostRecentListingWindow()) listing->GoToCurrentInstruction();
     }
@@ -453,6 +673,12 @@ void SystemInstance::RenderMenuBar()
         }
     }
 
+    ImGui::SameLine();
+    if(ImGui::Button("Over")) StepOver();
+
+    ImGui::SameLine();
+    if(ImGui::Button("Out")) StepOut();
+
     if(last_state != State::PAUSED) {
         ImGui::PopStyleVar();
         ImGui::PopItemFlag();
@@ -465,6 +691,38 @@ void SystemInstance::RenderMenuBar()
 
     ImGui::SameLine();
     ImGui::Text("%f Hz", cycles_per_sec);
+
+    ImGui::SameLine();
+    ImGui::Text("%.1f fps (%.0f%%)", timing_stats.frames_per_sec, timing_stats.percent_realtime);
+    if(ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        ImGui::Text("CPU         %5.1f%%", timing_stats.cpu);
+        ImGui::Text("Memory      %5.1f%%", timing_stats.memory);
+        ImGui::Text("Breakpoints %5.1f%%", timing_stats.breakpoints);
+        ImGui::Text("PPU         %5.1f%%", timing_stats.ppu);
+        ImGui::Text("OAM DMA     %5.1f%%", timing_stats.oam_dma);
+        ImGui::EndTooltip();
+    }
+
+    switch(movie->GetMode()) {
+    case Movie::MODE::RECORDING:
+        ImGui::SameLine();
+        ImGui::Text("REC %" PRIu64, movie->GetFrame());
+        break;
+
+    case Movie::MODE::PLAYING:
+        ImGui::SameLine();
+        ImGui::Text("PLAY %" PRIu64 "/%" PRIu64, movie->GetFrame(), movie->GetLength());
+        break;
+
+    default:
+        break;
+    }
+
+    if(movie->HasDiverged()) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "DESYNC @%" PRIu64, movie->GetDivergedFrame());
+    }
 }
 
 void SystemInstance::CheckInput()
@@ -473,6 +731,32 @@ void SystemInstance::CheckInput()
 
 void SystemInstance::Render()
 {
+    if(ImGuiFileDialog::Instance()->Display("SaveMovieFileDialog")) {
+        if(ImGuiFileDialog::Instance()->IsOk()) {
+            string errmsg;
+            ofstream out(ImGuiFileDialog::Instance()->GetFilePathName(), ios::binary);
+            if(!out.good() || !movie->Save(out, errmsg)) {
+                cout << WindowPrefix() << "couldn't save movie: " << errmsg << endl;
+            }
+        }
+
+        ImGuiFileDialog::Instance()->Close();
+    }
+
+    if(ImGuiFileDialog::Instance()->Display("OpenMovieFileDialog")) {
+        if(ImGuiFileDialog::Instance()->IsOk()) {
+            string errmsg;
+            ifstream in(ImGuiFileDialog::Instance()->GetFilePathName(), ios::binary);
+            if(!in.good() || !LoadMovie(in, errmsg)) {
+                cout << WindowPrefix() << "couldn't load movie: " << errmsg << endl;
+            } else {
+                cout << WindowPrefix() << "loaded movie with " << dec << movie->GetLength() << " frames" << endl;
+            }
+        }
+
+        ImGuiFileDialog::Instance()->Close();
+    }
+
     if(popups.save_state_name.show) {
         if(auto ret = GetMainWindow()->InputNamePopup("Enter save state name", "Name", &popups.edit_buffer, true, true)) {
             if(ret > 0) {
@@ -507,23 +791,42 @@ void SystemInstance::Render()
 void SystemInstance::Reset()
 {
     auto saved_state = current_state;
-    if(current_state == State::RUNNING) {
+    if(IsRunning()) {
         current_state = State::PAUSED;
         while(running) ;
     }
 
-    cpu->Reset();
-    ppu->Reset();
-    cpu_shift = 0;
-    raster_line = framebuffer;
-    raster_y = 0;
-    oam_dma_enabled = false;
+    if(machine) machine->Reset();
 
     current_state = saved_state;
 }
 
+void SystemInstance::ForkInstance()
+{
+    // the machine can't change while it's being copied
+    auto last_state = current_state;
+    if(IsRunning()) {
+        current_state = State::PAUSED;
+        while(running) ;
+    }
+
+    // the new instance starts paused, so its machine is safe to overwrite
+    auto fork = SystemInstance::CreateWindow();
+    fork->machine->CopyState(*machine);
+
+    current_state = last_state;
+
+    fork->SetInitialDock(BaseWindow::DOCK_ROOT);
+    GetCurrentProject()->AddChildWindow(fork);
+    fork->CreateDefaultWorkspace();
+
+    cout << WindowPrefix() << "forked into " << fork->GetInstanceName() << endl;
+}
+
 void SystemInstance::GetCurrentInstructionAddress(GlobalMemoryLocation* out)
 {
+    auto const& cpu = GetCPU();
+
     out->is_chr = false;
     out->address = cpu->GetOpcodePC();
     out->prg_rom_bank = 0;
@@ -541,85 +844,89 @@ void SystemInstance::GetCurrentInstructionAddress(GlobalMemoryLocation* out)
     out->address -= offset;
 }
 
-bool SystemInstance::StepCPU()
+void SystemInstance::StepOver()
 {
-    // TODO DMC DMA has priority over OAM DMA
-    if(oam_dma_enabled && cpu->IsReadCycle()) { // CPU can only be halted on a read cycle
-        // simulate a "halt" cycle
-        if(!dma_halt_cycle_done) {
-            dma_halt_cycle_done = true;
-            return cpu->Step();
-        }
+    if(current_state != State::PAUSED) return;
 
-        // technically we need a random alignment cycle, but we just emulate perfect alignment so our DMA will always 
-        // take 513 cycles, never 514
+    // anything other than a subroutine call is the same as a single step
+    auto const& cpu = GetCPU();
+    if(cpu->GetOpcode() != 0x20) { // JSR
+        current_state = State::STEP_INSTRUCTION;
+        return;
+    }
 
-        // and technically DMA is part of the CPU but alas...it's happening here
-        if(!oam_dma_rw) { // read
-            oam_dma_read_latch = memory_view->Read(oam_dma_source);
-            oam_dma_rw ^= 1;
-        } else {
-            memory_view->Write(0x2004, oam_dma_read_latch);
-            oam_dma_rw ^= 1;
-            oam_dma_source += 1;
-            if((oam_dma_source & 0xFF) == 0) oam_dma_enabled = 0;
-        }
+    step_target.pc = cpu->GetOpcodePC() + 3;
+    step_target.check_bank = false;
+    step_target.s = (u8)cpu->GetS();
+    current_state = State::STEP_OVER;
+}
 
-        cpu->DmaStep();
-        return false;
-    } else {
-        return cpu->Step();
-    }
+void SystemInstance::StepOut()
+{
+    if(current_state != State::PAUSED) return;
+
+    auto const& cpu = GetCPU();
+    step_target.s = (u8)cpu->GetS();
+    step_target.last_opcode = cpu->GetOpcode();
+    current_state = State::STEP_OUT;
 }
 
-void SystemInstance::StepPPU()
+void SystemInstance::RunTo(GlobalMemoryLocation const& where)
 {
-    bool hblank_new, vblank;
-    int color = ppu->Step(hblank_new, vblank);
-    if(vblank) { // on high vblank
-        // reset frame buffer to new buffer, etc
-        raster_line = framebuffer;
-        raster_y = 0;
-    } else if(hblank_new && hblank_new != hblank) { // on rising edge of hblank
-        hblank = hblank_new;
-        // move scanline down
-        raster_line = &framebuffer[raster_y++ * 256];
-        raster_x = 0;
-    } else if(!hblank_new) {
-        hblank = false;
-        // display color
-        raster_line[raster_x++] = (0xFF000000 | color);
-    }
+    if(current_state != State::PAUSED || where.is_chr) return;
+
+    step_target.pc = where.address;
+    step_target.check_bank = (where.address & 0x8000) != 0;
+    step_target.prg_rom_bank = where.prg_rom_bank;
+    current_state = State::RUN_TO;
 }
 
-bool SystemInstance::SingleCycle()
+// called on the emulation thread at every opcode fetch while stepping over/out or running to an address
+bool SystemInstance::StepTargetReached(State mode)
 {
-    bool ret;
+    auto const& cpu = machine->GetCPU();
+
+    switch(mode) {
+    case State::STEP_OVER:
+        // the stack check keeps a recursive call from stopping before the outer one returns
+        return cpu->GetOpcodePC() == step_target.pc && (u8)cpu->GetS() >= step_target.s;
+
+    case State::STEP_OUT: {
+        // done when an RTS or RTI brings the stack above where it was when stepping out started
+        u16 last_opcode = step_target.last_opcode;
+        step_target.last_opcode = cpu->GetOpcode();
+        return (last_opcode == 0x60 || last_opcode == 0x40) && (u8)cpu->GetS() > step_target.s;
+    }
 
-    // PPU clock is /4 master clock and CPU is /12 master clock, so it steps 3x as often
-    switch(cpu_shift) {
-    case 0:
-        ret = StepCPU();
-        StepPPU();
-        StepPPU();
-        break;
-    case 1:
-        StepPPU();
-        ret = StepCPU();
-        StepPPU();
-        StepPPU();
-        break;
-    case 2:
-        StepPPU();
-        ret = StepCPU();
-        StepPPU();
-        StepPPU();
-        StepPPU();
-        break;
+    case State::RUN_TO:
+        if(cpu->GetOpcodePC() != step_target.pc) return false;
+        if(!step_target.check_bank) return true;
+        if(auto system_view = dynamic_pointer_cast<Systems::NES::SystemView>(machine->GetMemoryView())) {
+            return system_view->GetCartridgeView()->GetRomBank(step_target.pc) == step_target.prg_rom_bank;
+        }
+        return true;
+
+    default:
+        return false;
     }
+}
 
-    cpu_shift = (cpu_shift + 1) % 3;
-    return ret;
+// called before every cycle. Whole bank breakpoints have to follow bank switches, and a rebuilt filter is
+// swapped in here, so the Machine never checks a filter that's being written and breakpoints set while
+// paused are in place for the first cycle
+inline void SystemInstance::CheckAccessFilter()
+{
+    [[unlikely]] if(has_whole_bank_breakpoints.load(memory_order_relaxed)
+            && cartridge_view->GetPRGGeneration() != access_filter_prg_generation.load(memory_order_relaxed)) {
+        UpdateAccessFilter();
+    }
+
+    [[unlikely]] if(access_filter.pending.load(memory_order_relaxed)) {
+        lock_guard<mutex> lock(breakpoint_mutex);
+        swap(access_filter.live, access_filter.next);
+        machine->SetAccessFilter(access_filter.live);
+        access_filter.pending = false;
+    }
 }
 
 void SystemInstance::EmulationThread()
@@ -628,11 +935,15 @@ void SystemInstance::EmulationThread()
         switch(current_state) {
         case State::INIT:
         case State::PAUSED:
+            // nothing to do until the main thread changes the state, so don't spin a whole core
+            this_thread::sleep_for(1ms);
             break;
 
         case State::STEP_CYCLE:
             running = true;
-            SingleCycle();
+            CheckAccessFilter();
+            machine->SingleCycle();
+            CallFrameFunctions();
             current_state = State::PAUSED;
             running = false;
             break;
@@ -640,7 +951,12 @@ void SystemInstance::EmulationThread()
         case State::STEP_INSTRUCTION:
             running = true;
             // execute cycles until opcode fetch happens
-            while(current_state == State::STEP_INSTRUCTION && !SingleCycle()) ;
+            while(current_state == State::STEP_INSTRUCTION) {
+                CheckAccessFilter();
+                bool opcode_fetch = machine->SingleCycle();
+                CallFrameFunctions();
+                if(opcode_fetch) break;
+            }
 
             // always go to paused after a step instruction
             current_state = State::PAUSED;
@@ -652,22 +968,42 @@ void SystemInstance::EmulationThread()
             break;
 
         case State::RUNNING:
+        case State::STEP_OVER:
+        case State::STEP_OUT:
+        case State::RUN_TO: {
             running = true;
-            while(!exit_thread && current_state == State::RUNNING) {
-                SingleCycle();
+            auto const mode = current_state;
+            auto const& ppu = machine->GetPPU();
+            while(!exit_thread && current_state == mode) {
+                CheckAccessFilter();
+                bool opcode_fetch = machine->SingleCycle();
+
+                if(ppu->GetFrame() != frame_functions.last_frame) CallFrameFunctions();
+
+                if(opcode_fetch && mode != State::RUNNING && StepTargetReached(mode)) {
+                    current_state = State::PAUSED;
+                    step_instruction_done = true;
+                    break;
+                }
+
+                if(snapshot_requested.load(memory_order_relaxed) && ppu->GetFrame() != snapshot_ppu_frame) {
+                    PublishSnapshot();
+                }
 
-                if(cpu->GetNextUC() < 0) {
+                if(machine->IsCrashed()) {
                     // perform one more cycle just to print out invalid opcode message
-                    cpu->Step();
+                    machine->GetCPU()->Step();
                     current_state = State::CRASHED;
                     break;
                 }
             }
             running = false;
             break;
+        }
 
         case State::CRASHED:
             running = false;
+            this_thread::sleep_for(1ms);
             break;
 
         default:
@@ -679,12 +1015,88 @@ void SystemInstance::EmulationThread()
     thread_exited = true;
 }
 
-void SystemInstance::WriteOAMDMA(u8 page)
+int SystemInstance::AddFrameFunction(frame_function_t const& func)
+{
+    lock_guard<mutex> lock(frame_functions.mutex);
+    int id = frame_functions.next_id++;
+    frame_functions.functions[id] = func;
+    return id;
+}
+
+void SystemInstance::RemoveFrameFunction(int id)
 {
-    oam_dma_enabled = true;
-    oam_dma_source = (page << 8);
-    oam_dma_rw = 0;
-    dma_halt_cycle_done = false;
+    lock_guard<mutex> lock(frame_functions.mutex);
+    frame_functions.functions.erase(id);
+}
+
+void SystemInstance::CallFrameFunctions()
+{
+    int frame = machine->GetPPU()->GetFrame();
+    if(frame == frame_functions.last_frame) return;
+    frame_functions.last_frame = frame;
+
+    lock_guard<mutex> lock(frame_functions.mutex);
+    for(auto& func_pair : frame_functions.functions) func_pair.second(*machine);
+}
+
+// called on the emulation thread while running, or the main thread when the emulation thread is idle
+void SystemInstance::PublishSnapshot()
+{
+    snapshot_requested = false;
+
+    auto& snapshot = snapshots[snapshot_back_index];
+    snapshot.serial = ++snapshot_serial;
+
+    auto const& cpu = machine->GetCPU();
+    snapshot.cpu.pc          = cpu->GetPC();
+    snapshot.cpu.opcode      = cpu->GetOpcode();
+    snapshot.cpu.opcode_pc   = cpu->GetOpcodePC();
+    snapshot.cpu.next_uc     = cpu->GetNextUC();
+    snapshot.cpu.istep       = cpu->GetIStep();
+    snapshot.cpu.a           = cpu->GetA();
+    snapshot.cpu.x           = cpu->GetX();
+    snapshot.cpu.y           = cpu->GetY();
+    snapshot.cpu.p           = cpu->GetP();
+    snapshot.cpu.s           = cpu->GetS();
+    snapshot.cpu.cycle_count = cpu->GetCycleCount();
+
+    auto const& ppu = machine->GetPPU();
+    snapshot.ppu.frame          = ppu->GetFrame();
+    snapshot.ppu.scanline       = ppu->GetScanline();
+    snapshot.ppu.cycle          = ppu->GetCycle();
+    snapshot.ppu.ppucont        = ppu->GetPPUCONT();
+    snapshot.ppu.ppumask        = ppu->GetPPUMASK();
+    snapshot.ppu.ppustat        = ppu->GetPPUSTAT();
+    snapshot.ppu.vram_address   = ppu->GetVramAddress();
+    snapshot.ppu.vram_address_t = ppu->GetVramAddressT();
+    snapshot.ppu.vram_address_v = ppu->GetVramAddressV();
+    snapshot.ppu.scroll_x       = ppu->GetScrollX();
+    snapshot.ppu.scroll_y       = ppu->GetScrollY();
+    ppu->CopyOAM(snapshot.ppu.oam);
+    ppu->CopyPaletteRAM(&snapshot.ppu.palette_ram[0x00], false);
+    ppu->CopyPaletteRAM(&snapshot.ppu.palette_ram[0x10], true);
+    snapshot_ppu_frame = snapshot.ppu.frame;
+
+    snapshot.generations.palette = ppu->GetPaletteGeneration();
+    snapshot.generations.oam     = ppu->GetOAMGeneration();
+
+    if(auto system_view = dynamic_pointer_cast<Systems::NES::SystemView>(machine->GetMemoryView())) {
+        auto const& cartridge_view = system_view->GetCartridgeView();
+        snapshot.nametable_mirroring = cartridge_view->GetNametableMirroring();
+        snapshot.generations.vram = system_view->GetVRAMGeneration();
+        snapshot.generations.chr = cartridge_view->GetCHRGeneration();
+        system_view->CopyVRAM(snapshot.vram);
+
+        // copied in blocks, since this happens every frame
+        system_view->CopyCPUMemory(snapshot.cpu_memory);
+
+        cartridge_view->CopyPatterns(&snapshot.ppu_memory[0x0000], 0x0000, 0x1000);
+        cartridge_view->CopyPatterns(&snapshot.ppu_memory[0x1000], 0x1000, 0x1000);
+        system_view->CopyNametables(&snapshot.ppu_memory[0x2000]);
+    }
+
+    int last_ready = snapshot_ready_state.exchange(snapshot_back_index | SNAPSHOT_READY_NEW, memory_order_acq_rel);
+    snapshot_back_index = last_ready & SNAPSHOT_READY_INDEX;
 }
 
 bool SystemInstance::SetBreakpointCondition(std::shared_ptr<BreakpointInfo> const& breakpoint_info, 
@@ -703,6 +1115,7 @@ bool SystemInstance::SetBreakpointCondition(std::shared_ptr<BreakpointInfo> cons
         if(!deref) return true;
 
         auto deref_func = [&](s64 in, s64* out, string& errmsg)->bool {
+            auto const& memory_view = GetMemoryView();
             if(!memory_view) {
                 errmsg = "Internal error";
                 return false;
@@ -726,6 +1139,8 @@ bool SystemInstance::SetBreakpointCondition(std::shared_ptr<BreakpointInfo> cons
 
 void SystemInstance::CheckBreakpoints(u16 address, CheckBreakpointMode mode)
 {
+    lock_guard<mutex> lock(breakpoint_mutex);
+
     GlobalMemoryLocation where = {
         .address      = address,
         .is_chr       = 0,
@@ -757,18 +1172,70 @@ void SystemInstance::CheckBreakpoints(u16 address, CheckBreakpointMode mode)
         return false;
     };
 
-    // check both bank-specific and non-bank specific addresses
+    // check both bank-specific and non-bank specific addresses. ranges are checked below
     auto bplist = GetBreakpointsAt(where);
     [[likely]] for(auto& bpiter : bplist) {
-        if(check_bp(bpiter)) return;
+        if(!bpiter->IsRange() && check_bp(bpiter)) return;
     }
 
     bplist = GetBreakpointsAt(address);
     [[unlikely]] for(auto& bpiter : bplist) {
-        if(check_bp(bpiter)) return;
+        if(!bpiter->IsRange() && check_bp(bpiter)) return;
+    }
+
+    for(auto& bpiter : range_breakpoints) {
+        if(bpiter->Covers(address, where.prg_rom_bank) && check_bp(bpiter)) return;
     }
 }
 
+void SystemInstance::AddToAccessFilter(Machine::AccessFilter& filter, BreakpointInfo const& bpi)
+{
+    if(bpi.address.is_chr) return;
+
+    auto add = [&](u16 first, u16 last) {
+        if(bpi.break_read)    filter.Add(Machine::ACCESS::READ, first, last);
+        if(bpi.break_write)   filter.Add(Machine::ACCESS::WRITE, first, last);
+        if(bpi.break_execute) filter.Add(Machine::ACCESS::EXECUTE, first, last);
+    };
+
+    // only the 16KiB windows the bank is mapped into right now. CheckAccessFilter rebuilds the filter
+    // when that changes
+    if(bpi.whole_bank) {
+        for(u32 window = 0x8000; window < 0x10000; window += 0x4000) {
+            if(cartridge_view->GetRomBank((u16)window) == bpi.address.prg_rom_bank) add((u16)window, (u16)(window + 0x3FFF));
+        }
+        return;
+    }
+
+    add(bpi.address.address, (u16)min(0xFFFF, (int)bpi.address.address + (int)bpi.size - 1));
+}
+
+void SystemInstance::UpdateAccessFilter()
+{
+    lock_guard<mutex> lock(breakpoint_mutex);
+    BuildAccessFilter();
+}
+
+// breakpoint_mutex must be held
+void SystemInstance::BuildAccessFilter()
+{
+    // taken before the banks are looked at, so a bank switch while building always rebuilds it again
+    access_filter_prg_generation = cartridge_view->GetPRGGeneration();
+
+    // the Machine only ever checks the live filter, so the next one can be written from any thread
+    auto& filter = *access_filter.next;
+    filter.Clear();
+
+    bool whole_bank = false;
+    IterateBreakpoints([this, &filter, &whole_bank](breakpoint_key_t const&, shared_ptr<BreakpointInfo> const& bpi) {
+        AddToAccessFilter(filter, *bpi);
+        whole_bank = whole_bank || bpi->whole_bank;
+    });
+    has_whole_bank_breakpoints = whole_bank;
+
+    access_filter.pending = true;
+}
+
 bool SystemInstance::FixupExpression(shared_ptr<BaseExpression> const& expression, string& errmsg)
 {
     ExploreData ed = {
@@ -807,6 +1274,59 @@ bool SystemInstance::ExploreCallback(shared_ptr<BaseExpressionNode>& node, share
     return true;
 }
 
+bool SaveStateInfo::Save(std::ostream& os, std::string& errmsg) const
+{
+    long long tp = timestamp.time_since_epoch().count();
+    os.write((char*)&tp, sizeof(tp));
+
+    WriteString(os, name);
+
+    // the framebuffer copy and RAM are mostly repeated bytes. a compressed size of 0 means the data is stored as-is
+    string compressed;
+    WriteVarInt(os, data_size);
+    if(CompressBlock(data, data_size, compressed)) {
+        WriteVarInt(os, (int)compressed.size());
+        os.write(compressed.data(), compressed.size());
+    } else {
+        WriteVarInt(os, 0);
+        os.write((char*)data, data_size);
+    }
+
+    errmsg = "Error saving SaveStateInfo";
+    return os.good();
+}
+
+bool SaveStateInfo::Load(std::istream& is, std::string& errmsg)
+{
+    long long tp;
+    is.read((char*)&tp, sizeof(tp));
+    timestamp = clock_t::time_point(clock_t::duration(tp));
+
+    ReadString(is, name);
+
+    data_size = ReadVarInt<int>(is);
+    data = new u8[data_size];
+
+    int compressed_size = 0;
+    if(GetCurrentProject()->GetSaveFileVersion() >= FILE_VERSION_COMPRESSION) {
+        compressed_size = ReadVarInt<int>(is);
+    }
+
+    if(compressed_size) {
+        vector<u8> compressed(compressed_size);
+        is.read((char*)compressed.data(), compressed_size);
+        if(!is.good() || !DecompressBlock(compressed.data(), compressed_size, data, data_size)) {
+            errmsg = "Error decompressing SaveStateInfo";
+            return false;
+        }
+    } else {
+        is.read((char*)data, data_size);
+    }
+
+    errmsg = "Error loading SaveStateInfo";
+    return is.good();
+}
+
 std::shared_ptr<SaveStateInfo> SystemInstance::CreateSaveState()
 {
     stringstream oss;
@@ -819,34 +1339,11 @@ std::shared_ptr<SaveStateInfo> SystemInstance::CreateSaveState()
         while(running) ;
     }
 
-    WriteVarInt(oss, 1); // reserved, must be 1
-
-    // save CPU
-    if(!cpu->Save(oss, errmsg)) return nullptr;
-
-    // save PPU
-    if(!ppu->Save(oss, errmsg)) return nullptr;
-
-    // save APU_IO
-    if(!apu_io->Save(oss, errmsg)) return nullptr;
-
-    // save memory_view (i.e., all VRAM, RAM, cart state, etc)
-    if(!memory_view->Save(oss, errmsg)) return nullptr;
-
-    // save DMA state
-    WriteVarInt(oss, (int)oam_dma_enabled);
-    WriteVarInt(oss, oam_dma_source);
-    WriteVarInt(oss, oam_dma_rw);
-    WriteVarInt(oss, oam_dma_read_latch);
-    WriteVarInt(oss, (int)dma_halt_cycle_done);
-
-    // save a copy of the frame buffer so we can display it when state loads without running
-    oss.write((char*)framebuffer, sizeof(u32) * 256 * 256);
-
-    // and the raster positions
-    WriteVarInt(oss, (int)hblank);
-    WriteVarInt(oss, raster_x);
-    WriteVarInt(oss, raster_y);
+    if(!machine->SaveState(oss, errmsg)) {
+        cout << WindowPrefix() << errmsg << endl;
+        current_state = last_state;
+        return nullptr;
+    }
 
     // create a new SaveStateInfo
     auto new_state = make_shared<SaveStateInfo>();
@@ -885,42 +1382,12 @@ bool SystemInstance::LoadSaveState(std::shared_ptr<SaveStateInfo> const& save_st
         while(running) ;
     }
 
-    int r = ReadVarInt<int>(is); // reserved, must be 1
-    assert(r == 1);
-
-    // load CPU
-    if(!cpu->Load(is, errmsg)) return false;
-
-    // load PPU
-    if(!ppu->Load(is, errmsg)) return false;
-
-    // load APU_IO
-    if(!apu_io->Load(is, errmsg)) return false;
-
-    // load memory_view
-    if(!memory_view->Load(is, errmsg)) return false;
-
-    // load DMA state
-    oam_dma_enabled     = (bool)ReadVarInt<int>(is);
-    oam_dma_source      = ReadVarInt<u16>(is);
-    oam_dma_rw          = ReadVarInt<u8>(is);
-    oam_dma_read_latch  = ReadVarInt<u8>(is);
-    dma_halt_cycle_done = (bool)ReadVarInt<int>(is);
-
-    // load framebuffer copy
-    is.read((char*)framebuffer, sizeof(u32) * 256 * 256);
-
-    // and the raster positions
-    hblank = (bool)ReadVarInt<int>(is);
-    raster_x = ReadVarInt<int>(is);
-    raster_y = ReadVarInt<int>(is);
-
-    // fixup raster_line to point to the correct row
-    // raster_y == 0 means we're in vblank and will set render_line later
-    if(raster_y > 0) raster_line = &framebuffer[(raster_y - 1) * 256];
+    if(!machine->LoadState(is, errmsg)) {
+        cout << WindowPrefix() << errmsg << endl;
+        return false;
+    }
 
-    errmsg = "Error loading state";
-    return is.good();
+    return true;
 }
 
 bool SystemInstance::SaveWindow(std::ostream& os, std::string& errmsg)
@@ -1074,6 +1541,7 @@ void Screen::PreRender()
 
 void Screen::Render()
 {
+    bool new_texture = !valid_texture;
     if(!valid_texture) {
         GLuint gl_texture;
         glGenTextures(1, &gl_texture);
@@ -1087,7 +1555,12 @@ void Screen::Render()
         valid_texture = true;
     }
 
-    if(auto framebuffer = GetMySystemInstance()->GetFramebuffer()) {
+    // only upload when there's a new frame, so nothing is copied while paused
+    auto system_instance = GetMySystemInstance();
+    u64 serial = system_instance->GetFramebufferSerial();
+    auto framebuffer = system_instance->GetFramebuffer();
+    if(framebuffer && (new_texture || serial != uploaded_serial)) {
+        uploaded_serial = serial;
         GLuint gl_texture = (GLuint)(intptr_t)framebuffer_texture;
         glBindTexture(GL_TEXTURE_2D, gl_texture);
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 256, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer);
@@ -1134,19 +1607,21 @@ void CPUState::Render()
     auto cpu = si->GetCPU();
     if(!cpu) return;
 
-    auto memory_view = si->GetMemoryView();
-    if(!memory_view) return;
+    // registers are displayed from the snapshot, but edits go straight to the CPU
+    auto snapshot = si->GetSnapshot();
+    if(!snapshot) return;
+    auto const& regs = snapshot->cpu;
 
-    u64 next_uc = cpu->GetNextUC();
+    u64 next_uc = regs.next_uc;
     if(next_uc == (u64)-1) {
-        ImGui::Text("$%04X: Invalid opcode $%02X", cpu->GetOpcodePC()-1, cpu->GetOpcode());
+        ImGui::Text("$%04X: Invalid opcode $%02X", regs.opcode_pc-1, regs.opcode);
     } else {
-        string inst = disassembler->GetInstruction(cpu->GetOpcode());
-        auto pc = cpu->GetOpcodePC();
-        u8 operands[] = { memory_view->Read(pc+1), memory_view->Read(pc+2) };
-        string operand = disassembler->FormatOperand(cpu->GetOpcode(), operands);
+        string inst = disassembler->GetInstruction(regs.opcode);
+        auto pc = regs.opcode_pc;
+        u8 operands[] = { snapshot->cpu_memory[(u16)(pc+1)], snapshot->cpu_memory[(u16)(pc+2)] };
+        string operand = disassembler->FormatOperand(regs.opcode, operands);
         if(ImGui::IsKeyDown(ImGuiKey_LeftCtrl)) {
-            ImGui::Text("$%04X: %s %s (istep %d, uc=0x%X)", pc, inst.c_str(), operand.c_str(), cpu->GetIStep(), next_uc);
+            ImGui::Text("$%04X: %s %s (istep %d, uc=0x%X)", pc, inst.c_str(), operand.c_str(), regs.istep, next_uc);
         } else {
             ImGui::Text("$%04X: %s %s", pc, inst.c_str(), operand.c_str());
         }
@@ -1154,7 +1629,7 @@ void CPUState::Render()
 
     ImGui::Separator();
 
-    auto s = cpu->GetS();
+    auto s = regs.s;
 
     auto size = ImGui::GetWindowSize();
     size.x *= 0.5;
@@ -1173,7 +1648,7 @@ void CPUState::Render()
             }
 
             // update buffer only when the input field isn't active
-            if(!ImGui::IsItemActive()) snprintf(pc_buf, sizeof(pc_buf), "$%04X", cpu->GetPC());
+            if(!ImGui::IsItemActive()) snprintf(pc_buf, sizeof(pc_buf), "$%04X", regs.pc);
         }
 
         {
@@ -1203,7 +1678,7 @@ void CPUState::Render()
             }
 
             // update buffer only when the input field isn't active
-            if(!ImGui::IsItemActive()) snprintf(a_buf, sizeof(a_buf), "$%02X", cpu->GetA());
+            if(!ImGui::IsItemActive()) snprintf(a_buf, sizeof(a_buf), "$%02X", regs.a);
         }
 
         {
@@ -1218,7 +1693,7 @@ void CPUState::Render()
             }
 
             // update buffer only when the input field isn't active
-            if(!ImGui::IsItemActive()) snprintf(x_buf, sizeof(x_buf), "$%02X", cpu->GetX());
+            if(!ImGui::IsItemActive()) snprintf(x_buf, sizeof(x_buf), "$%02X", regs.x);
         }
 
         {
@@ -1233,7 +1708,7 @@ void CPUState::Render()
             }
 
             // update buffer only when the input field isn't active
-            if(!ImGui::IsItemActive()) snprintf(y_buf, sizeof(y_buf), "$%02X", cpu->GetY());
+            if(!ImGui::IsItemActive()) snprintf(y_buf, sizeof(y_buf), "$%02X", regs.y);
         }
 
         // force this group to have a width equal to half the window width
@@ -1244,7 +1719,7 @@ void CPUState::Render()
     ImGui::SameLine();
     ImGui::BeginGroup(); 
     {
-        auto p = cpu->GetP();
+        auto p = regs.p;
         {
             ImGui::Text(" P:");
             char buf[4];
@@ -1311,7 +1786,7 @@ void CPUState::Render()
             ImGui::Text("$%04X", cs);
 
             ImGui::TableNextColumn();
-            auto v = (u16)memory_view->Peek(cs - 1) | ((u16)memory_view->Peek(cs) << 8);
+            auto v = (u16)snapshot->cpu_memory[cs - 1] | ((u16)snapshot->cpu_memory[cs] << 8);
             ImGui::Text("$%04X", v);
         }
 
@@ -1325,7 +1800,7 @@ std::shared_ptr<PPUState> PPUState::CreateWindow()
 }
 
 PPUState::PPUState()
-    : BaseWindow()
+    : BaseWindow(), pattern_tiles(0x2000 / TILE_PATTERN_BYTES)
 {
     SetTitle("PPU");
 
@@ -1405,12 +1880,18 @@ void PPUState::Update(double deltaTime)
         valid_texture = true;
     }
 
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) return;
+
+    // all of the views draw from the decoded pattern tables
+    pattern_tiles.Update(snapshot->ppu_memory, snapshot->generations.chr);
+
     if(display_mode == 1) {
-        UpdateNametableTexture();
+        UpdateNametableTexture(*snapshot);
     } else if(display_mode == 3) {
-        UpdateSpriteTexture();
+        UpdateSpriteTexture(*snapshot);
     } else if(display_mode == 4) {
-        UpdatePatternTextures();
+        UpdatePatternTextures(*snapshot);
     }
 }
 
@@ -1422,40 +1903,36 @@ void PPUState::PreRender()
 
 void PPUState::Render()
 {
-    auto si = GetMySystemInstance();
-    auto ppu = si->GetPPU();
-    if(!ppu) return;
-
-    auto memory_view = si->GetMemoryView();
-    if(!memory_view) return;
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) return;
 
     ImGui::Combo("View", &display_mode, "Registers\0Nametables\0Palettes\0Sprites\0Pattern Tables\0\0");
     ImGui::Separator();
 
     switch(display_mode) {
     case 0:
-        RenderRegisters(ppu);
+        RenderRegisters(*snapshot);
         break;
 
     case 1:
-        RenderNametables(ppu);
+        RenderNametables(*snapshot);
         break;
 
     case 2:
-        RenderPalettes(ppu);
+        RenderPalettes(*snapshot);
         break;
 
     case 3:
-        RenderSprites(ppu);
+        RenderSprites(*snapshot);
         break;
 
     case 4:
-        RenderPatternTables(ppu);
+        RenderPatternTables(*snapshot);
         break;
     }
 }
 
-void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
+void PPUState::RenderRegisters(MachineSnapshot const& snapshot)
 {
     bool open;
     u8 v;
@@ -1480,36 +1957,36 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
         ImGui::TableNextColumn();
         ImGui::Text("Frame Index");
         ImGui::TableNextColumn();
-        ImGui::Text("%d", ppu->GetFrame());
+        ImGui::Text("%d", snapshot.ppu.frame);
 
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         ImGui::Text("Scanline");
         ImGui::TableNextColumn();
-        ImGui::Text("%d", ppu->GetScanline());
+        ImGui::Text("%d", snapshot.ppu.scanline);
 
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         ImGui::Text("Cycle");
         ImGui::TableNextColumn();
-        ImGui::Text("%d", ppu->GetCycle());
+        ImGui::Text("%d", snapshot.ppu.cycle);
 
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         ImGui::Text("Scroll X");
         ImGui::TableNextColumn();
-        ImGui::Text("%d", ppu->GetScrollX());
+        ImGui::Text("%d", snapshot.ppu.scroll_x);
 
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         ImGui::Text("Scroll Y");
         ImGui::TableNextColumn();
-        ImGui::Text("%d", ppu->GetScrollY());
+        ImGui::Text("%d", snapshot.ppu.scroll_y);
 
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         open = ImGui::TreeNodeEx("VRAM bus address", ImGuiTreeNodeFlags_SpanFullWidth);
-        addr = ppu->GetVramAddress();
+        addr = snapshot.ppu.vram_address;
         ImGui::TableNextColumn();
         ImGui::TextDisabled("$%04X", addr);
         ImGui::TableNextColumn();
@@ -1518,7 +1995,7 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
             ImGui::TableNextRow();
             ImGui::TableNextColumn();
             ImGui::Text("Intermediate VRAM address");
-            addr = ppu->GetVramAddressT();
+            addr = snapshot.ppu.vram_address_t;
             ImGui::TableNextColumn();
             ImGui::Text("$%04X", addr);
             ImGui::TableNextColumn();
@@ -1527,7 +2004,7 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
             ImGui::TableNextRow();
             ImGui::TableNextColumn();
             ImGui::Text("Final VRAM address");
-            addr = ppu->GetVramAddressV();
+            addr = snapshot.ppu.vram_address_v;
             ImGui::TableNextColumn();
             ImGui::Text("$%04X", addr);
             ImGui::TableNextColumn();
@@ -1539,7 +2016,7 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         open = ImGui::TreeNodeEx("[PPUCONT] $2000", ImGuiTreeNodeFlags_SpanFullWidth);
-        v = ppu->GetPPUCONT();
+        v = snapshot.ppu.ppucont;
         ImGui::TableNextColumn();
         ImGui::TextDisabled("$%02X", v);
 
@@ -1605,7 +2082,7 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         open = ImGui::TreeNodeEx("[PPUMASK] $2001", ImGuiTreeNodeFlags_SpanFullWidth);
-        v = ppu->GetPPUMASK();
+        v = snapshot.ppu.ppumask;
         ImGui::TableNextColumn();
         ImGui::TextDisabled("$%02X", v);
         if(open) {
@@ -1687,7 +2164,7 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
         ImGui::TableNextRow();
         ImGui::TableNextColumn();
         open = ImGui::TreeNodeEx("[PPUSTAT] $2002", ImGuiTreeNodeFlags_SpanFullWidth);
-        v = ppu->GetPPUSTAT();
+        v = snapshot.ppu.ppustat;
         ImGui::TableNextColumn();
         ImGui::TextDisabled("$%02X", v);
         if(open) {
@@ -1728,7 +2205,7 @@ void PPUState::RenderRegisters(std::shared_ptr<PPU> const& ppu)
     ImGui::PopStyleVar(2);
 }
 
-void PPUState::RenderNametables(std::shared_ptr<PPU> const& ppu)
+void PPUState::RenderNametables(MachineSnapshot const& snapshot)
 {
     ImGuiFlagButton(&show_scroll_window, "S", "Show Scroll Window");
     ImGui::Separator();
@@ -1739,13 +2216,10 @@ void PPUState::RenderNametables(std::shared_ptr<PPU> const& ppu)
     ImGui::Image(nametable_texture, ImVec2(sz, sz));//480/512 * sz));
 }
 
-void PPUState::RenderPalettes(std::shared_ptr<PPU> const& ppu)
+void PPUState::RenderPalettes(MachineSnapshot const& snapshot)
 {
-    u8 bg_palette[0x10];
-    ppu->CopyPaletteRAM(bg_palette, false);
-
-    u8 obj_palette[0x10];
-    ppu->CopyPaletteRAM(obj_palette, true);
+    u8 const* bg_palette  = &snapshot.ppu.palette_ram[0x00];
+    u8 const* obj_palette = &snapshot.ppu.palette_ram[0x10];
 
     /////////////////////////////////////////////////////////////////////////////////////////////
     auto size = ImGui::GetWindowSize();
@@ -1811,7 +2285,7 @@ void PPUState::RenderPalettes(std::shared_ptr<PPU> const& ppu)
     ImGui::EndChild();
 }
 
-void PPUState::RenderSprites(std::shared_ptr<PPU> const& ppu)
+void PPUState::RenderSprites(MachineSnapshot const& snapshot)
 {
     ImVec2 size = ImGui::GetWindowSize();
     float sz = size.x < size.y ? size.x : size.y;
@@ -1847,7 +2321,7 @@ void PPUState::RenderSprites(std::shared_ptr<PPU> const& ppu)
     }
 }
 
-void PPUState::RenderPatternTables(std::shared_ptr<PPU> const& ppu)
+void PPUState::RenderPatternTables(MachineSnapshot const& snapshot)
 {
     char buf[12];
     snprintf(buf, sizeof(buf), "Palette %d", palette_index);
@@ -1914,167 +2388,205 @@ void PPUState::RenderPatternTables(std::shared_ptr<PPU> const& ppu)
     }
 }
 
-void PPUState::UpdateNametableTexture()
+void PPUState::UpdateNametableTexture(MachineSnapshot const& snapshot)
 {
-    int cx = 0;
-    int cy = 0;
-    int sz = 5;
+    auto& drawn = nametable_drawn;
+    auto const& generations = snapshot.generations;
+    int bg_tile_base = (snapshot.ppu.ppucont & 0x10) << 4;
+    int scroll_x = snapshot.ppu.scroll_x;
+    int scroll_y = snapshot.ppu.scroll_y;
+
+    // new colors or layout redraw everything. otherwise only the tiles whose name, attribute or pattern
+    // changed are redrawn, and when nothing changed there's nothing to upload either
+    bool redraw_all = !drawn.valid
+        || generations.palette != drawn.palette_generation
+        || bg_tile_base != drawn.tile_base
+        || snapshot.nametable_mirroring != drawn.mirroring;
+    bool vram_changed = generations.vram != drawn.vram_generation;
+    bool chr_changed = generations.chr != drawn.chr_generation;
+    bool scroll_changed = show_scroll_window != drawn.show_scroll_window
+        || (show_scroll_window && (scroll_x != drawn.scroll_x || scroll_y != drawn.scroll_y));
+
+    if(!redraw_all && !vram_changed && !chr_changed && !scroll_changed) return;
+
+    // 4 palettes of 4 colors, where color 0 is always the BG color
+    u32 colors[0x10];
+    for(int i = 0; i < 0x10; i++) {
+        int color = snapshot.ppu.palette_ram[(i & 0x03) ? i : 0] & 0x3F;
+        colors[i] = 0xFF000000 | Systems::NES::rgb_palette_map[color];
+    }
+
+    // the vram offset of each screen based on mirroring. the top left screen is fixed
+    struct { int vram_offset, fx, fy; } screens[4] = {
+        { 0x000,   0,   0 },
+    };
+    int num_screens = 1;
+
+    switch(snapshot.nametable_mirroring) {
+    case Systems::NES::MIRRORING_VERTICAL:
+        screens[num_screens++] = { 0x400, 256,   0 };
+        screens[num_screens++] = { 0x000,   0, 240 };
+        screens[num_screens++] = { 0x400, 256, 240 };
+        break;
+
+    case Systems::NES::MIRRORING_HORIZONTAL:
+        screens[num_screens++] = { 0x000, 256,   0 };
+        screens[num_screens++] = { 0x400,   0, 240 };
+        screens[num_screens++] = { 0x400, 256, 240 };
+        break;
+
+    default:
+        break;
+    }
+
+    for(int i = 0; i < num_screens; i++) {
+        auto const& screen = screens[i];
+        u8 const* nametable = &snapshot.vram[screen.vram_offset];
+        u8 const* last_nametable = &drawn.vram[screen.vram_offset];
 
-    auto render_screen = [](u32* fb, u8* nametable, u8* bg_patterns, u8* palette_ram, int fx, int fy) {
-        u8* attrtable = &nametable[0x3C0];
         for(int ty = 0; ty < 30; ty++) {
             for(int tx = 0; tx < 32; tx++) {
-                u8 tile = *nametable++;
-
-                u8 attr = attrtable[8 * (ty / 4) + tx / 4];
+                int tile_index = (screen.fy / 8 + ty) * 64 + (screen.fx / 8 + tx);
+                int name_offset = ty * 32 + tx;
+                int attr_offset = 0x3C0 + 8 * (ty / 4) + tx / 4;
+                int tile = bg_tile_base + nametable[name_offset];
+                u32 serial = pattern_tiles.GetTileSerial(tile);
+
+                bool dirty = redraw_all || drawn.dirty_tiles[tile_index] || serial != drawn.tile_serials[tile_index]
+                    || (vram_changed && (nametable[name_offset] != last_nametable[name_offset]
+                                         || nametable[attr_offset] != last_nametable[attr_offset]));
+                if(!dirty) continue;
+
+                u8 attr = nametable[attr_offset];
                 if((ty & 0x02)) attr >>= 4;
                 if((tx & 0x02)) attr >>= 2;
-                attr &= 0x03;
+                u32 const* palette = &colors[(attr & 0x03) << 2];
 
                 // render 8x8
+                u8 const* pixels = pattern_tiles.GetTile(tile);
                 for(int y = 0; y < 8; y++) {
-                    u8 row0 = bg_patterns[(u16)(tile << 4) + y + 0x00];
-                    u8 row1 = bg_patterns[(u16)(tile << 4) + y + 0x08];
-
-                    int cy = fy + ty * 8 + y;
-                    for(int x = 0; x < 8; x++) {
-                        int b0 = (row0 & 0x80) >> 7; row0 <<= 1;
-                        int b1 = (row1 & 0x80) >> 7; row1 <<= 1;
-                        int pal = (attr << 2) | (b1 << 1) | b0;
-
-                        // use BG color for color 0
-                        if(b0 == 0 && b1 == 0) pal = 0;
-
-                        int color = palette_ram[pal & 0x0F] & 0x3F;
-                        int cx = fx + tx * 8 + x;
-                        fb[cy * 512 + cx] = 0xFF000000 | Systems::NES::rgb_palette_map[color];
-                    }
+                    u32* row = &nametable_framebuffer[(screen.fy + ty * 8 + y) * 512 + screen.fx + tx * 8];
+                    for(int x = 0; x < 8; x++) row[x] = palette[*pixels++];
                 }
+
+                drawn.tile_serials[tile_index] = serial;
             }
         }
-    };
-
-    auto si = GetMySystemInstance();
-    auto ppu = si->GetPPU();
-
-    if(auto system_view = dynamic_pointer_cast<Systems::NES::SystemView>(si->GetMemoryView())) {
-        u8 vram[0x800];
-        system_view->CopyVRAM(vram);
-
-        u8 bg_patterns[0x1000];
-        auto cartridge_view = system_view->GetCartridgeView();
-        u16 bg_pattern_address = (u16)(ppu->GetPPUCONT() & 0x10) << 8;
-        cartridge_view->CopyPatterns(bg_patterns, bg_pattern_address, 0x1000);
-
-        u8 palette_ram[0x10];
-        ppu->CopyPaletteRAM(palette_ram, false);
-
-        // top left screen is fixed
-        render_screen(nametable_framebuffer, &vram[0x000], bg_patterns, palette_ram, 0, 0);
-
-        // render the others based on mirroring
-        switch(cartridge_view->GetNametableMirroring()) {
-        case Systems::NES::MIRRORING_VERTICAL:
-            render_screen(nametable_framebuffer, &vram[0x400], bg_patterns, palette_ram, 256,   0);
-            render_screen(nametable_framebuffer, &vram[0x000], bg_patterns, palette_ram,   0, 240);
-            render_screen(nametable_framebuffer, &vram[0x400], bg_patterns, palette_ram, 256, 240);
-            break;
-
-        case Systems::NES::MIRRORING_HORIZONTAL:
-            render_screen(nametable_framebuffer, &vram[0x000], bg_patterns, palette_ram, 256,   0);
-            render_screen(nametable_framebuffer, &vram[0x400], bg_patterns, palette_ram,   0, 240);
-            render_screen(nametable_framebuffer, &vram[0x400], bg_patterns, palette_ram, 256, 240);
-            break;
+    }
 
-        default:
-            break;
+    drawn.valid              = true;
+    drawn.vram_generation    = generations.vram;
+    drawn.chr_generation     = generations.chr;
+    drawn.palette_generation = generations.palette;
+    drawn.tile_base          = bg_tile_base;
+    drawn.mirroring          = snapshot.nametable_mirroring;
+    drawn.show_scroll_window = show_scroll_window;
+    drawn.scroll_x           = scroll_x;
+    drawn.scroll_y           = scroll_y;
+    memcpy(drawn.vram, snapshot.vram, sizeof(drawn.vram));
+    drawn.dirty_tiles.reset();
+
+    if(show_scroll_window) {
+        int ey = (scroll_y + 239) % 240;
+        for(int i = 0; i < 256; i++) {
+            int x = (scroll_x + i) & 511;
+            nametable_framebuffer[scroll_y * 512 + x] = 0xFF000000;
+            nametable_framebuffer[ey * 512 + x] = 0xFF000000;
         }
 
-        if(show_scroll_window) {
-            int scroll_x = ppu->GetScrollX();
-            int scroll_y = ppu->GetScrollY();
-            int ey = (scroll_y + 239) % 240;
-            for(int i = 0; i < 256; i++) {
-                int x = (scroll_x + i) & 511;
-                nametable_framebuffer[scroll_y * 512 + x] = 0xFF000000;
-                nametable_framebuffer[ey * 512 + x] = 0xFF000000;
-            }
+        int ex = (scroll_x + 256) & 511;
+        for(int i = 0; i < 256; i++) {
+            int y = (scroll_y + i) % 240;
+            nametable_framebuffer[y * 512 + scroll_x] = 0xFF000000;
+            nametable_framebuffer[y * 512 + ex] = 0xFF000000;
+        }
 
-            int ex = (scroll_x + 256) & 511;
-            for(int i = 0; i < 256; i++) {
-                int y = (scroll_y + i) % 240;
-                nametable_framebuffer[y * 512 + scroll_x] = 0xFF000000;
-                nametable_framebuffer[y * 512 + ex] = 0xFF000000;
-            }
+        // the tiles under the lines have to be redrawn when the window moves
+        for(int i = 0; i < 64; i++) {
+            drawn.dirty_tiles[(scroll_y / 8) * 64 + i] = true;
+            drawn.dirty_tiles[(ey / 8) * 64 + i] = true;
         }
 
-        // update the opengl texture
-        GLuint gl_texture = (GLuint)(intptr_t)nametable_texture;
-        glBindTexture(GL_TEXTURE_2D, gl_texture);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 512, GL_RGBA, GL_UNSIGNED_BYTE, nametable_framebuffer);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        for(int i = 0; i < 60; i++) {
+            drawn.dirty_tiles[i * 64 + scroll_x / 8] = true;
+            drawn.dirty_tiles[i * 64 + ex / 8] = true;
+        }
     }
+
+    // update the opengl texture
+    GLuint gl_texture = (GLuint)(intptr_t)nametable_texture;
+    glBindTexture(GL_TEXTURE_2D, gl_texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 512, 512, GL_RGBA, GL_UNSIGNED_BYTE, nametable_framebuffer);
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void PPUState::UpdateSpriteTexture()
+void PPUState::UpdateSpriteTexture(MachineSnapshot const& snapshot)
 {
-    auto si = GetMySystemInstance();
-    auto ppu = si->GetPPU();
-    auto system_view = si->GetMemoryViewAs<Systems::NES::SystemView>();
-
-    // fetch the sprite pattern data in one go
-    u8 sprite_patterns[0x1000];
-    auto cartridge_view = system_view->GetCartridgeView();
-    u16 sprite_pattern_address = (u16)(ppu->GetPPUCONT() & 0x08) << 9;
-    cartridge_view->CopyPatterns(sprite_patterns, sprite_pattern_address, 0x1000);
+    auto& drawn = sprites_drawn;
+    auto const& generations = snapshot.generations;
 
-    // grab the PPU OAM
-    ppu->CopyOAM(oam_copy);
+    // sprite pattern table
+    int sprite_tile_base = (snapshot.ppu.ppucont & 0x08) << 5;
 
-    // we'll need sprite palettes
-    u8 palette_ram[0x10];
-    ppu->CopyPaletteRAM(palette_ram, true);
+    // new colors redraw every sprite, otherwise only the sprites whose OAM entry or pattern changed
+    bool redraw_all = !drawn.valid
+        || generations.palette != drawn.palette_generation
+        || sprite_tile_base != drawn.tile_base;
 
-    // render 8x8 sprites
-    u8* oam_ptr = oam_copy;
-    for(int sprite_y = 0; sprite_y < 8; sprite_y++) {
-        int sy = sprite_y * 9; // +1 for the dividing line
-        for(int sprite_x = 0; sprite_x < 8; sprite_x++) {
-            int sx = sprite_x * 9;
-
-            // fetch sprite components
-            u8 y    = *oam_ptr++;
-            u8 tile = *oam_ptr++;
-            u8 attr = *oam_ptr++;
-            u8 x    = *oam_ptr++;
-
-            // parse attr
-            u8   pal    = attr & 0x03;
-            bool flip_x = attr & 0x40;
-            bool flip_y = attr & 0x80;
-
-            // render one 8x8
-            for(int i = 0; i < 8; i++) {
-                int y = sy + i;
+    if(!redraw_all && generations.oam == drawn.oam_generation && generations.chr == drawn.chr_generation) return;
 
-                int use_i = flip_y ? (7 - i) : i; // vertical flip
-                u8 byte0 = sprite_patterns[(tile << 4) + use_i];
-                u8 byte1 = sprite_patterns[(tile << 4) + use_i + 8];
+    // sprite palettes
+    u32 colors[0x10];
+    for(int i = 0; i < 0x10; i++) {
+        colors[i] = 0xFF000000 | Systems::NES::rgb_palette_map[snapshot.ppu.palette_ram[0x10 + i]];
+    }
 
-                for(int j = 0; j < 8; j++) {
-                    int x = sx + j;
-                    int use_j = flip_x ? (7 - j) : j; // horizontal flip
-                    u8 bit0  = (byte0 >> (7 - use_j)) & 0x01;
-                    u8 bit1  = (byte1 >> (7 - use_j)) & 0x01;
-                    u8 index = (pal << 2) | (bit1 << 1) | bit0;
-                    u8 color = palette_ram[index];
-
-                    sprites_framebuffer[y * 128 + x] = 0xFF000000 | Systems::NES::rgb_palette_map[color];
-                }
+    // render 8x8 sprites
+    bool changed = false;
+    for(int si = 0; si < 64; si++) {
+        int sx = (si % 8) * 9; // +1 for the dividing line
+        int sy = (si / 8) * 9;
+
+        // fetch sprite components. oam_copy still holds the OAM as last drawn
+        u8 const* oam_ptr = &snapshot.ppu.oam[si << 2];
+        u8 tile = oam_ptr[1];
+        u8 attr = oam_ptr[2];
+        u32 serial = pattern_tiles.GetTileSerial(sprite_tile_base + tile);
+
+        if(!redraw_all && serial == drawn.tile_serials[si] && memcmp(oam_ptr, &oam_copy[si << 2], 4) == 0) continue;
+        changed = true;
+
+        // parse attr
+        u32 const* palette = &colors[(attr & 0x03) << 2];
+        bool flip_x = attr & 0x40;
+        bool flip_y = attr & 0x80;
+
+        // render one 8x8
+        u8 const* pixels = pattern_tiles.GetTile(sprite_tile_base + tile);
+        for(int i = 0; i < 8; i++) {
+            int use_i = flip_y ? (7 - i) : i; // vertical flip
+            u32* row = &sprites_framebuffer[(sy + i) * 128 + sx];
+            for(int j = 0; j < 8; j++) {
+                int use_j = flip_x ? (7 - j) : j; // horizontal flip
+                row[j] = palette[pixels[use_i * 8 + use_j]];
             }
         }
+
+        drawn.tile_serials[si] = serial;
     }
 
+    // keep the OAM for the tooltips in RenderSprites
+    memcpy(oam_copy, snapshot.ppu.oam, sizeof(oam_copy));
+
+    drawn.valid              = true;
+    drawn.oam_generation     = generations.oam;
+    drawn.chr_generation     = generations.chr;
+    drawn.palette_generation = generations.palette;
+    drawn.tile_base          = sprite_tile_base;
+
+    // OAM writes that don't change anything (like DMA of the same sprites every frame) don't need an upload
+    if(!changed) return;
+
     // update the opengl texture
     GLuint gl_texture = (GLuint)(intptr_t)sprites_texture;
     glBindTexture(GL_TEXTURE_2D, gl_texture);
@@ -2082,51 +2594,54 @@ void PPUState::UpdateSpriteTexture()
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void PPUState::UpdatePatternTextures()
+void PPUState::UpdatePatternTextures(MachineSnapshot const& snapshot)
 {
-    auto si = GetMySystemInstance();
-    auto ppu = si->GetPPU();
-    auto system_view = si->GetMemoryViewAs<Systems::NES::SystemView>();
-    auto cartridge_view = system_view->GetCartridgeView();
+    auto& drawn = patterns_drawn;
+    auto const& generations = snapshot.generations;
 
     // we'll need both palettes
-    ppu->CopyPaletteRAM(&palette_copy[0x00], false);
-    ppu->CopyPaletteRAM(&palette_copy[0x10], true);
+    memcpy(palette_copy, snapshot.ppu.palette_ram, sizeof(palette_copy));
+
+    // new colors redraw every tile, otherwise only the tiles whose pattern changed
+    bool redraw_all = !drawn.valid
+        || generations.palette != drawn.palette_generation
+        || palette_index != drawn.palette_index;
+
+    if(!redraw_all && generations.chr == drawn.chr_generation) return;
+
+    u32 colors[4];
+    for(int i = 0; i < 4; i++) {
+        colors[i] = 0xFF000000 | Systems::NES::rgb_palette_map[palette_copy[(palette_index << 2) | i]];
+    }
 
     // loop over both pattern tables
     for(int pt = 0; pt < 2; pt++) {
-        // fetch the pattern data in one go
-        u8 patterns[0x1000];
-        cartridge_view->CopyPatterns(patterns, pt << 12, 0x1000);
+        bool changed = false;
 
         // render 16x16 tiles
-        u8* pattern_ptr = patterns;
         for(int tile_y = 0; tile_y < 16; tile_y++) {
-            int ty = tile_y * 8; // +1 for the dividing line
+            int ty = tile_y * 8;
             for(int tile_x = 0; tile_x < 16; tile_x++) {
                 int tx = tile_x * 8;
 
+                int tile = (pt << 8) + tile_y * 16 + tile_x;
+                u32 serial = pattern_tiles.GetTileSerial(tile);
+                if(!redraw_all && serial == drawn.tile_serials[tile]) continue;
+                changed = true;
+
                 // render one 8x8 tile
+                u8 const* pixels = pattern_tiles.GetTile(tile);
                 for(int i = 0; i < 8; i++) {
-                    int y = ty + i;
-
-                    u8 byte0 = *(pattern_ptr + 0);
-                    u8 byte1 = *(pattern_ptr + 8);
-                    pattern_ptr++;
-
-                    for(int j = 0; j < 8; j++) {
-                        int x = tx + j;
-                        u8 bit0  = (byte0 >> (7 - j)) & 0x01;
-                        u8 bit1  = (byte1 >> (7 - j)) & 0x01;
-                        u8 index = (palette_index << 2) | (bit1 << 1) | bit0;
-                        u8 color = palette_copy[index];
-
-                        pattern_framebuffer[pt][y * 128 + x] = 0xFF000000 | Systems::NES::rgb_palette_map[color];
-                    }
+                    u32* row = &pattern_framebuffer[pt][(ty + i) * 128 + tx];
+                    for(int j = 0; j < 8; j++) row[j] = colors[*pixels++];
                 }
+
+                drawn.tile_serials[tile] = serial;
             }
         }
 
+        if(!changed) continue;
+
         // update the opengl texture
         GLuint gl_texture = (GLuint)(intptr_t)pattern_texture[pt];
         glBindTexture(GL_TEXTURE_2D, gl_texture);
@@ -2134,6 +2649,11 @@ void PPUState::UpdatePatternTextures()
     }
 
     glBindTexture(GL_TEXTURE_2D, 0);
+
+    drawn.valid              = true;
+    drawn.chr_generation     = generations.chr;
+    drawn.palette_generation = generations.palette;
+    drawn.palette_index      = palette_index;
 }
 
 
@@ -2560,8 +3080,8 @@ bool Watch::ExploreCallback(shared_ptr<BaseExpressionNode>& node, shared_ptr<Bas
 
 bool Watch::DereferenceByte(s64 in, s64* out, string& errmsg)
 {
-    auto memory_view = GetMySystemInstance()->GetMemoryView();
-    if(!memory_view) {
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) {
         errmsg = "Internal error";
         return false;
     }
@@ -2569,32 +3089,32 @@ bool Watch::DereferenceByte(s64 in, s64* out, string& errmsg)
     // TODO would be cool to support banks within the address itself
     // shouldn't be too difficult. Overload Peek() to take a GlobalMemoryLocation
     // and build the memory location here
-    *out = memory_view->Peek(in);
+    *out = snapshot->cpu_memory[(u16)in];
     return true;
 }
 
 bool Watch::DereferenceWord(s64 in, s64* out, string& errmsg)
 {
-    auto memory_view = GetMySystemInstance()->GetMemoryView();
-    if(!memory_view) {
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) {
         errmsg = "Internal error";
         return false;
     }
 
-    *out = (u16)memory_view->Peek(in) | ((u16)memory_view->Peek(in + 1) << 8);
+    *out = (u16)snapshot->cpu_memory[(u16)in] | ((u16)snapshot->cpu_memory[(u16)(in + 1)] << 8);
     return true;
 }
 
 bool Watch::DereferenceLong(s64 in, s64* out, string& errmsg)
 {
-    auto memory_view = GetMySystemInstance()->GetMemoryView();
-    if(!memory_view) {
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) {
         errmsg = "Internal error";
         return false;
     }
 
-    *out = (u32)memory_view->Peek(in) | ((u32)memory_view->Peek(in + 1) << 8)
-           | ((u32)memory_view->Peek(in + 2) << 16)| ((u32)memory_view->Peek(in + 3) << 24);
+    *out = (u32)snapshot->cpu_memory[(u16)in] | ((u32)snapshot->cpu_memory[(u16)(in + 1)] << 8)
+           | ((u32)snapshot->cpu_memory[(u16)(in + 2)] << 16)| ((u32)snapshot->cpu_memory[(u16)(in + 3)] << 24);
     return true;
 }
 
@@ -2755,16 +3275,25 @@ void Breakpoints::Render()
 
             ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(2, 0));
             if(!bpi->address.is_chr) {
-                ImGui::SameLine(); ImGuiFlagButton(&bpi->break_read   , "R", "Break on read");
-                ImGui::SameLine(); ImGuiFlagButton(&bpi->break_write  , "W", "Break on write");
-                ImGui::SameLine(); ImGuiFlagButton(&bpi->break_execute, "X", "Break on execute");
+                bool changed = false;
+                ImGui::SameLine(); changed |= ImGuiFlagButton(&bpi->break_read   , "R", "Break on read");
+                ImGui::SameLine(); changed |= ImGuiFlagButton(&bpi->break_write  , "W", "Break on write");
+                ImGui::SameLine(); changed |= ImGuiFlagButton(&bpi->break_execute, "X", "Break on execute");
+                if(changed) GetMySystemInstance()->UpdateAccessFilter();
             }
             ImGui::PopStyleVar(1);
 
             // format address
             ImGui::TableNextColumn();
             stringstream ss;
-            bpi->address.FormatAddress(ss, true, bpi->has_bank);
+            if(bpi->whole_bank) {
+                ss << "PRG-ROM bank $" << hex << uppercase << setfill('0') << setw(2) << bpi->address.prg_rom_bank;
+            } else {
+                bpi->address.FormatAddress(ss, true, bpi->has_bank);
+                if(bpi->size > 1) {
+                    ss << "..$" << hex << uppercase << setfill('0') << setw(4) << (bpi->address.address + bpi->size - 1);
+                }
+            }
             ImGui::Text(ss.str().c_str());
 
             // format condition
@@ -2808,7 +3337,7 @@ void Breakpoints::Render()
 
         if(editing == EditMode::ADDRESS) {
             ImGui::PushItemWidth(-FLT_MIN);
-            if(ImGui::InputText("##edit_address", &edit_string, ImGuiInputTextFlags_EnterReturnsTrue)) {
+            if(ImGui::InputTextWithHint("##edit_address", "address, first..last or bank N", &edit_string, ImGuiInputTextFlags_EnterReturnsTrue)) {
                 do_set_breakpoint = true;
             }
 
@@ -2875,73 +3404,127 @@ void Breakpoints::Render()
 
 // Try to set the current edit_string as the breakpoint info's address
 // If you want to specify the bank, type in $bbAAAA
+bool Breakpoints::EvaluateAddress(string const& address_string, s64* result, string& errmsg, int& errloc)
+{
+    // try parsing the expression first
+    auto expr = make_shared<Systems::NES::Expression>();
+    if(!expr->Set(address_string, errmsg, errloc, false)) return false;
+    errloc = -1;
+
+    // before we go to System::FixupExpression, we need to convert some Names to SystemInstanceStates
+    if(!GetMySystemInstance()->FixupExpression(expr, errmsg)) return false;
+
+    // expression was valid from a grammar point of view, now apply semantics
+    // allow labels, defines, no derefs, no modes
+    FixupFlags fixup_flags = FIXUP_DEFINES | FIXUP_LABELS | FIXUP_ENUMS | FIXUP_LONG_LABELS;
+    if(!GetSystem()->FixupExpression(expr, errmsg, fixup_flags)) return false;
+
+    // Expression contained valid elements, evaluate the function to determine where the breakpoint should be
+    if(!expr->Evaluate(result, errmsg)) return false;
+
+    if(*result < 0) {
+        errmsg = "Invalid address";
+        return false;
+    }
+
+    return true;
+}
+
 void Breakpoints::SetBreakpoint()
 {
     if(!wait_dialog) {
         string errmsg;
-        int errloc;
+        int errloc = -1;
+        s64 result;
+
+        // besides a single address, "first..last" breaks on a range of addresses and "bank N" on
+        // every address in a PRG-ROM bank
+        size_t range_pos = edit_string.find("..");
+
+        if(strlower(edit_string).rfind("bank ", 0) == 0) {
+            if(EvaluateAddress(edit_string.substr(5), &result, errmsg, errloc)) {
+                if(result >= GetSystem()->GetCartridge()->header.num_prg_rom_banks) {
+                    errmsg = "Invalid PRG-ROM bank";
+                } else {
+                    editing_breakpoint_info->address = {
+                        .address = 0x8000,
+                        .is_chr = false,
+                        .prg_rom_bank = (u16)result,
+                    };
+
+                    editing_breakpoint_info->has_bank = true;
+                    editing_breakpoint_info->whole_bank = true;
+                    editing_breakpoint_info->enabled = true;
+
+                    GetMySystemInstance()->SetBreakpoint(editing_breakpoint_info->address, editing_breakpoint_info);
+                    editing_breakpoint_info = nullptr;
+                }
+            }
+        } else if(range_pos != string::npos) {
+            s64 last;
+            if(EvaluateAddress(edit_string.substr(0, range_pos), &result, errmsg, errloc)
+               && EvaluateAddress(edit_string.substr(range_pos + 2), &last, errmsg, errloc)) {
+                // like 16-bit addresses, ranges break in all banks
+                if(result >= 0x10000 || last >= 0x10000 || last < result) {
+                    errmsg = "Invalid range (must be 16-bit addresses, first..last)";
+                } else {
+                    editing_breakpoint_info->address = {
+                        .address = (u16)result,
+                        .is_chr = false,
+                        .prg_rom_bank = 0,
+                    };
+
+                    editing_breakpoint_info->has_bank = false;
+                    editing_breakpoint_info->size = (u32)(last - result + 1);
+                    editing_breakpoint_info->enabled = true;
+
+                    GetMySystemInstance()->SetBreakpoint((u16)result, editing_breakpoint_info);
+                    editing_breakpoint_info = nullptr;
+                }
+            }
+        } else if(EvaluateAddress(edit_string, &result, errmsg, errloc)) {
+            // result contains the address of our breakpoint!
+            if(result < 0x10000) { // long labels have 0x01xxxxxx or 0x02..
+                                   // so a 16-bit address will break in all banks
+                editing_breakpoint_info->address = {
+                    .address = (u16)(result & 0xFFFF),
+                    .is_chr = false,
+                    .prg_rom_bank = 0,
+                };
 
-        // try parsing the expression first
-        auto expr = make_shared<Systems::NES::Expression>();
-        if(expr->Set(edit_string, errmsg, errloc, false)) {
-            errloc = -1;
+                editing_breakpoint_info->has_bank = false;
+                editing_breakpoint_info->enabled = true;
 
-            // before we go to System::FixupExpression, we need to convert some Names to SystemInstanceStates
-            if(GetMySystemInstance()->FixupExpression(expr, errmsg)) {
-                // expression was valid from a grammar point of view, now apply semantics
-                // allow labels, defines, no derefs, no modes
-                FixupFlags fixup_flags = FIXUP_DEFINES | FIXUP_LABELS | FIXUP_ENUMS | FIXUP_LONG_LABELS;
-                if(GetSystem()->FixupExpression(expr, errmsg, fixup_flags)) {
-                    // Expression contained valid elements, evaluate the function to determine where the breakpoint should be
-                    s64 result;
-                    if(expr->Evaluate(&result, errmsg)) {
-                        // result contains the address of our breakpoint!
-                        if(result < 0) {
-                            errmsg = "Invalid address";
-                        } else if(result < 0x10000) { // long labels have 0x01xxxxxx or 0x02..
-                                                      // so a 16-bit address will break in all banks
-                            editing_breakpoint_info->address = {
-                                .address = (u16)(result & 0xFFFF),
-                                .is_chr = false,
-                                .prg_rom_bank = 0,
-                            };
-
-                            editing_breakpoint_info->has_bank = false;
-                            editing_breakpoint_info->enabled = true;
-
-                            // set the u16 style breakpoint
-                            GetMySystemInstance()->SetBreakpoint((u16)(result & 0xFFFF), editing_breakpoint_info);
-                            editing_breakpoint_info = nullptr;
-                        } else { // user specified a bank via a label or manually
-                            // use the bank byte to build a GlobalMemoryLocation and make sure it's valid
-                            auto system = GetSystem();
-                            system->GetLocationFromLongAddress(result, editing_breakpoint_info->address);
-
-                            editing_breakpoint_info->has_bank = true;
-                            editing_breakpoint_info->enabled = true;
-
-                            if(!GetSystem()->GetMemoryObject(editing_breakpoint_info->address)) {
-                                stringstream ss;
-                                ss << "Invalid address (no memory exists at $" << hex << uppercase << setw(4) 
-                                   << setfill('0') << result << ")";
-                                errmsg = ss.str();
-                            } else {
-                                // valid target
-                                GetMySystemInstance()->SetBreakpoint(editing_breakpoint_info->address, editing_breakpoint_info);
-                                editing_breakpoint_info = nullptr;
-                            }
-                        }
+                // set the u16 style breakpoint
+                GetMySystemInstance()->SetBreakpoint((u16)(result & 0xFFFF), editing_breakpoint_info);
+                editing_breakpoint_info = nullptr;
+            } else { // user specified a bank via a label or manually
+                // use the bank byte to build a GlobalMemoryLocation and make sure it's valid
+                auto system = GetSystem();
+                system->GetLocationFromLongAddress(result, editing_breakpoint_info->address);
 
-                        if(!editing_breakpoint_info) {
-                            // success, done editing
-                            do_set_breakpoint = false;
-                            editing = EditMode::NONE;
-                        }
-                    }
+                editing_breakpoint_info->has_bank = true;
+                editing_breakpoint_info->enabled = true;
+
+                if(!GetSystem()->GetMemoryObject(editing_breakpoint_info->address)) {
+                    stringstream ss;
+                    ss << "Invalid address (no memory exists at $" << hex << uppercase << setw(4) 
+                       << setfill('0') << result << ")";
+                    errmsg = ss.str();
+                } else {
+                    // valid target
+                    GetMySystemInstance()->SetBreakpoint(editing_breakpoint_info->address, editing_breakpoint_info);
+                    editing_breakpoint_info = nullptr;
                 }
             }
         }
 
+        if(!editing_breakpoint_info) {
+            // success, done editing
+            do_set_breakpoint = false;
+            editing = EditMode::NONE;
+        }
+
         // if we didn't finish editing there was an error...
         if(editing != EditMode::NONE) {
             stringstream ss;
@@ -3029,12 +3612,9 @@ void Memory::Update(double deltaTime)
 
 void Memory::Render()
 {
-    auto si = GetMySystemInstance();
-    auto system_view = si->GetMemoryViewAs<Systems::NES::SystemView>();
-    if(!system_view) return;
-
-    auto ppu_view = system_view->GetPPUView();
-    if(!ppu_view) return;
+    // CPU and PPU memory come from the snapshot, so rendering doesn't race the emulator
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) return;
 
     auto cartridge = GetSystem()->GetCartridge();
     if(!cartridge) return;
@@ -3134,9 +3714,10 @@ void Memory::Render()
                         if(i == 0) {
                             address.address = (u16)(row << 4) + memory_shift;
                         }
-                        data[i] = system_view->Peek(address.address + i);
                         if(address.address + i >= 0x10000) {
                             empty_after = (i < empty_after) ? i : empty_after;
+                        } else {
+                            data[i] = snapshot->cpu_memory[address.address + i];
                         }
                         break;
 
@@ -3145,9 +3726,10 @@ void Memory::Render()
                             address.address = (u16)(row << 4) + memory_shift;
                             address.is_chr = true;
                         }
-                        data[i] = ppu_view->PeekPPU(address.address + i);
                         if(address.address + i >= 0x4000) {
                             empty_after = (i < empty_after) ? i : empty_after;
+                        } else {
+                            data[i] = snapshot->ppu_memory[address.address + i];
                         }
                         break;
 
@@ -3320,13 +3902,13 @@ void Memory::RenderAddressBar()
 
                 // create the word dereference 
                 auto deref_func = [&](s64 in, s64* out, string& errmsg)->bool {
-                    auto memory_view = GetMySystemInstance()->GetMemoryView();
-                    if(!memory_view) {
+                    auto snapshot = GetMySystemInstance()->GetSnapshot();
+                    if(!snapshot) {
                         errmsg = "Internal error";
                         return false;
                     }
 
-                    *out = (u16)memory_view->Peek(in) | ((u16)memory_view->Peek(in + 1) << 8);
+                    *out = (u16)snapshot->cpu_memory[(u16)in] | ((u16)snapshot->cpu_memory[(u16)(in + 1)] << 8);
                     return true;
                 };
 
@@ -3377,12 +3959,8 @@ void Memory::RenderAddressBar()
 
 void Memory::RenderTileDisplay(GlobalMemoryLocation const& start_address)
 {
-    auto si = GetMySystemInstance();
-    auto system_view = si->GetMemoryViewAs<Systems::NES::SystemView>();
-    if(!system_view) return;
-
-    auto ppu_view = system_view->GetPPUView();
-    if(!ppu_view) return;
+    auto snapshot = GetMySystemInstance()->GetSnapshot();
+    if(!snapshot) return;
 
     auto cartridge = GetSystem()->GetCartridge();
     if(!cartridge) return;
@@ -3400,6 +3978,9 @@ void Memory::RenderTileDisplay(GlobalMemoryLocation const& start_address)
         valid_texture = true;
     }
 
+    // 2-bit colors as shades of grey
+    static u32 const colors[4] = { 0xFF000000, 0xFF404040, 0xFF808080, 0xFFC0C0C0 };
+
     GlobalMemoryLocation address = start_address;
     bool next_invalid = false;
     for(int tile_y = 0; tile_y < 32; tile_y++) {
@@ -3407,19 +3988,29 @@ void Memory::RenderTileDisplay(GlobalMemoryLocation const& start_address)
 
             // read 16 bytes at `address`
             u8 tile_data[16];
+            u8 decoded[TILE_PIXELS];
+            u8 const* pixels = nullptr;
             int tdi = 0;
+
+            // whole tiles in CHR-ROM are already decoded
+            if(memory_mode == 3 && !next_invalid && (address.address & (TILE_PATTERN_BYTES - 1)) == 0) {
+                pixels = cartridge->GetCharacterRomTiles(address.chr_rom_bank).GetTile(address.address / TILE_PATTERN_BYTES);
+                address.address += TILE_PATTERN_BYTES - 1;
+                tdi = TILE_PATTERN_BYTES - 1;
+            }
+
             for(; tdi < 16 && !next_invalid; tdi++) {
                 switch(memory_mode) {
                 case 0: // CPU
-                    tile_data[tdi] = system_view->Peek(address.address);
+                    tile_data[tdi] = snapshot->cpu_memory[address.address];
                     address.address += 1;
                     if(address.address == 0) next_invalid = true;
                     break;
 
                 case 1: // PPU
-                    tile_data[tdi] = ppu_view->PeekPPU(address.address);
+                    tile_data[tdi] = snapshot->ppu_memory[address.address];
                     address.address += 1;
-                    if(address.address == 0) next_invalid = true;
+                    if(address.address == 0x4000) next_invalid = true;
                     break;
 
                 case 2: // PRG-ROM
@@ -3450,23 +4041,16 @@ void Memory::RenderTileDisplay(GlobalMemoryLocation const& start_address)
 
             // if we didn't get enough data for a tile, clear out the image
             bool valid = (tdi == 16);
+            if(valid && !pixels) {
+                Systems::NES::TileCache::Decode(tile_data, decoded);
+                pixels = decoded;
+            }
 
-            // render 8x8 tile in tile_data
+            // render 8x8 tile
             for(int i = 0; i < 8; i++) {
-                int y = tile_y * 8 + i;
-                int byte0 = tile_data[i];
-                int byte1 = tile_data[i+8];
+                u32* row = &tile_display_framebuffer[(tile_y * 8 + i) * 256 + tile_x * 8];
                 for(int j = 0; j < 8; j++) {
-                    int x = tile_x * 8 + j;
-
-                    if(valid) {
-                        int bit0 = (byte0 >> (7-j)) & 0x01;
-                        int bit1 = (byte1 >> (7-j)) & 0x01;
-                        int color = (bit1 << 1) | bit0;
-                        tile_display_framebuffer[y * 256 + x] = 0xFF000000 | (0x404040 * color);
-                    } else {
-                        tile_display_framebuffer[y * 256 + x] = 0xFF000000;
-                    }
+                    row[j] = valid ? colors[*pixels++] : 0xFF000000;
                 }
             }
         }
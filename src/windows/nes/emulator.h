@@ -5,17 +5,26 @@
 // LICENSE file in the root directory of this source tree. 
 #pragma once
 
+#include <atomic>
+#include <bitset>
 #include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <stack>
 #include <thread>
 #include <unordered_map>
 #include <variant>
 
 #include "signals.h"
+#include "systems/nes/machine.h"
 #include "systems/nes/memory.h"
+#include "systems/nes/tile_cache.h"
 #include "windows/basewindow.h"
 
+// state hash frequency for movies recorded in the UI, once a second
+#define MOVIE_HASH_INTERVAL 60
+
 // GetMySystemInstance only available in some windows
 #define GetMySystemInstance() this->GetParentWindowAs<Windows::NES::SystemInstance>()
 
@@ -27,8 +36,10 @@ class BaseExpressionNode;
 
 namespace Systems::NES {
     class APU_IO;
+    class CartridgeView;
     class CPU;
     class GlobalMemoryLocation;
+    class Movie;
     class PPU;
     class MemoryView;
     class System;
@@ -50,6 +61,14 @@ struct BreakpointInfo {
     bool break_write = false;
     bool break_execute = false;
 
+    // a breakpoint can watch more than one address: size addresses starting at address, or with
+    // whole_bank every address in PRG-ROM bank address.prg_rom_bank, wherever it's mapped
+    u32  size = 1;
+    bool whole_bank = false;
+
+    bool IsRange() const { return whole_bank || size > 1; }
+    bool Covers(u16 cpu_address, u16 prg_rom_bank) const;
+
     bool Save(std::ostream&, std::string&) const;
     bool Load(std::istream&, std::string&);
 
@@ -74,33 +93,57 @@ struct SaveStateInfo {
     int data_size;
     u8* data;
 
-    bool Save(std::ostream& os, std::string& errmsg) const {
-        long long tp = timestamp.time_since_epoch().count();
-        os.write((char*)&tp, sizeof(tp));
-
-        WriteString(os, name);
-
-        WriteVarInt(os, data_size);
-        os.write((char*)data, data_size);
+    // save states are kept uncompressed in memory so they load quickly, and are only
+    // compressed when written to the project file
+    bool Save(std::ostream& os, std::string& errmsg) const;
+    bool Load(std::istream& is, std::string& errmsg);
+};
 
-        errmsg = "Error saving SaveStateInfo";
-        return os.good();
-    }
+// A consistent copy of the machine state, taken on the emulation thread between cycles so the debugger
+// windows can read it without racing the emulator or going through MemoryView for every byte
+struct MachineSnapshot {
+    u64 serial;
 
-    bool Load(std::istream& is, std::string& errmsg) {
-        long long tp;
-        is.read((char*)&tp, sizeof(tp));
-        timestamp = clock_t::time_point(clock_t::duration(tp));
+    struct {
+        u16 pc;
+        u16 opcode;
+        u16 opcode_pc;
+        s64 next_uc;   // -1 when the opcode is invalid
+        int istep;
+        u8  a, x, y, p;
+        u16 s;
+        u64 cycle_count;
+    } cpu;
 
-        ReadString(is, name);
+    struct {
+        int frame;
+        int scanline;
+        int cycle;
+        u8  ppucont;
+        u8  ppumask;
+        u8  ppustat;
+        u16 vram_address;
+        u16 vram_address_t;
+        u16 vram_address_v;
+        u16 scroll_x;
+        u16 scroll_y;
+        u8  oam[256];
+        u8  palette_ram[0x20];
+    } ppu;
+
+    // write counters from the PPU and memory views. when one is unchanged, so is what it covers
+    struct {
+        u32 vram;
+        u32 chr;     // pattern tables, including CHR bank switches
+        u32 palette;
+        u32 oam;
+    } generations;
 
-        data_size = ReadVarInt<int>(is);
-        data = new u8[data_size];
-        is.read((char*)data, data_size);
+    Systems::NES::MIRRORING nametable_mirroring;
+    u8 vram[0x800];
 
-        errmsg = "Error loading SaveStateInfo";
-        return is.good();
-    }
+    u8 cpu_memory[0x10000]; // the CPU address space, as Peek() sees it
+    u8 ppu_memory[0x4000];  // pattern tables and nametables, as PeekPPU() sees them
 };
 
 // Windows::NES::SystemInstance is home to everything you need about an instance of a NES system.  
@@ -111,7 +154,9 @@ public:
     using APU_IO               = Systems::NES::APU_IO;
     using CPU                  = Systems::NES::CPU;
     using GlobalMemoryLocation = Systems::NES::GlobalMemoryLocation;
+    using Machine              = Systems::NES::Machine;
     using MemoryView           = Systems::NES::MemoryView;
+    using Movie                = Systems::NES::Movie;
     using PPU                  = Systems::NES::PPU;
     using System               = Systems::NES::System;
 
@@ -124,6 +169,9 @@ public:
         RUNNING,
         STEP_CYCLE,
         STEP_INSTRUCTION,
+        STEP_OVER,
+        STEP_OUT,
+        RUN_TO,
         CRASHED
     };
 
@@ -138,7 +186,7 @@ public:
 
     // create a default workspace
     void CreateDefaultWorkspace();
-    void CreateNewWindow(std::string const&);
+    std::shared_ptr<BaseWindow> CreateNewWindow(std::string const&);
     
     // main menu bar from the parent window
     void RenderInstanceMenu();
@@ -148,40 +196,64 @@ public:
     }
 
 
-    std::shared_ptr<APU_IO>     const& GetAPUIO()      { return apu_io; }
-    std::shared_ptr<CPU>        const& GetCPU()        { return cpu; }
-    std::shared_ptr<PPU>        const& GetPPU()        { return ppu; }
-    u32                         const* GetFramebuffer() const { return framebuffer; }
-    std::shared_ptr<MemoryView> const& GetMemoryView() { return memory_view; }
+    std::shared_ptr<Machine>    const& GetMachine()    { return machine; }
+    std::shared_ptr<APU_IO>     const& GetAPUIO()      { static std::shared_ptr<APU_IO> const null; return machine ? machine->GetAPUIO() : null; }
+    std::shared_ptr<CPU>        const& GetCPU()        { static std::shared_ptr<CPU> const null; return machine ? machine->GetCPU() : null; }
+    std::shared_ptr<PPU>        const& GetPPU()        { static std::shared_ptr<PPU> const null; return machine ? machine->GetPPU() : null; }
+    u32                         const* GetFramebuffer() const { return display_framebuffer; }
+    u64                                GetFramebufferSerial() const { return display_framebuffer_serial; }
+    MachineSnapshot             const* GetSnapshot()   const { return display_snapshot; }
+    std::shared_ptr<MemoryView> const& GetMemoryView() { static std::shared_ptr<MemoryView> const null; return machine ? machine->GetMemoryView() : null; }
     std::shared_ptr<System>     const& GetSystem()     { return current_system; }
 
     template<class T>
-    std::shared_ptr<T> GetMemoryViewAs() { return dynamic_pointer_cast<T>(memory_view); }
+    std::shared_ptr<T> GetMemoryViewAs() { return dynamic_pointer_cast<T>(GetMemoryView()); }
 
     void GetCurrentInstructionAddress(GlobalMemoryLocation*);
 
+    // run until the current subroutine call returns, the current subroutine returns, or the given
+    // address executes. These run at full speed on the emulation thread and stop early at breakpoints
+    void StepOver();
+    void StepOut();
+    void RunTo(GlobalMemoryLocation const&);
+
+    // functions called on the emulation thread once per emulated frame, for windows that can't miss one
+    // the way they can miss snapshots. Anything they share with the main thread needs its own lock, and
+    // RemoveFrameFunction doesn't return while the function is running
+    typedef std::function<void(Machine&)> frame_function_t;
+    int  AddFrameFunction(frame_function_t const&);
+    void RemoveFrameFunction(int id);
+
     inline void SetBreakpoint(breakpoint_key_t const& key, std::shared_ptr<BreakpointInfo> const& breakpoint_info) {
+        std::lock_guard<std::mutex> lock(breakpoint_mutex);
         breakpoints[key].push_back(breakpoint_info);
-        // set cpu_quick_breakpoints bit
-        cpu_quick_breakpoints[breakpoint_info->address.address >> 5] |= (1 << (breakpoint_info->address.address & 0x1F));
+        if(breakpoint_info->IsRange()) range_breakpoints.push_back(breakpoint_info);
+        BuildAccessFilter();
     }
 
     inline void ClearBreakpoint(breakpoint_key_t const& key, std::shared_ptr<BreakpointInfo> const& breakpoint_info) {
-        if(!breakpoints.contains(key)) return;
+        {
+            std::lock_guard<std::mutex> lock(breakpoint_mutex);
+            if(!breakpoints.contains(key)) return;
 
-        auto breakpoint_list = breakpoints[key];
-        auto it = std::find(breakpoint_list.begin(), breakpoint_list.end(), breakpoint_info);
-        if(it == breakpoint_list.end()) return;
+            auto& breakpoint_list = breakpoints[key];
+            auto it = std::find(breakpoint_list.begin(), breakpoint_list.end(), breakpoint_info);
+            if(it == breakpoint_list.end()) return;
 
-        breakpoint_list.erase(it);
-        if(breakpoint_list.size() != 0) return;
+            breakpoint_list.erase(it);
+            if(breakpoint_list.size() == 0) breakpoints.erase(key);
 
-        breakpoints.erase(key);
+            auto range_it = std::find(range_breakpoints.begin(), range_breakpoints.end(), breakpoint_info);
+            if(range_it != range_breakpoints.end()) range_breakpoints.erase(range_it);
+        }
 
-        // unset cpu_quick_breakpoints bit when there are no bp at this address
-        cpu_quick_breakpoints[breakpoint_info->address.address >> 5] &= ~(1 << (breakpoint_info->address.address & 0x1F));
+        // other breakpoints can cover the same addresses, so the filter is rebuilt from the ones left
+        UpdateAccessFilter();
     }
 
+    // rebuild the access filter, i.e., after changing which accesses a breakpoint breaks on
+    void UpdateAccessFilter();
+
     inline breakpoint_list_t const& GetBreakpointsAt(breakpoint_key_t const& where) {
         static SystemInstance::breakpoint_list_t empty_list;
         if(breakpoints.contains(where)) return breakpoints[where];
@@ -225,11 +297,24 @@ private:
 
     void UpdateTitle();
     void Reset();
-    bool SingleCycle();
-    bool StepCPU();
-    void StepPPU();
+    void ForkInstance();
+    void StartMovie(bool record);
+    void StopMovie();
+    bool LoadMovie(std::istream&, std::string& errmsg);
+    void VerifyMovie();
+    void SetPipelinedRendering(bool);
     void EmulationThread();
-    void WriteOAMDMA(u8);
+    bool StepTargetReached(State);
+    void CallFrameFunctions();
+    void CheckAccessFilter();
+
+    // true while the emulation thread runs for an unknown amount of time and has to be paused
+    // before touching the machine
+    bool IsRunning() const {
+        return current_state == State::RUNNING || current_state == State::STEP_OVER
+            || current_state == State::STEP_OUT || current_state == State::RUN_TO;
+    }
+    void PublishSnapshot();
 
     static int  next_system_id;
     int         system_id;
@@ -244,40 +329,104 @@ private:
     std::shared_ptr<std::thread> emulation_thread;
     bool                         exit_thread = false;
     bool                         thread_exited = false;
-    std::shared_ptr<CPU>         cpu;
-    std::shared_ptr<PPU>         ppu;
-    std::shared_ptr<APU_IO>      apu_io;
 
-    std::shared_ptr<MemoryView> memory_view;
+    // the emulated hardware. SystemInstance only drives it and adds the debugger on top
+    std::shared_ptr<Machine>     machine;
+
+    // declared after machine so it's destroyed (and detached) first
+    std::shared_ptr<Movie>       movie;
+
+    // movie verification plays a copy of the movie on a headless fork of the machine, on its own thread.
+    // Update reports the result once done is set
+    struct {
+        std::shared_ptr<std::thread> thread;
+        std::atomic<bool>            done   = false;
+        std::atomic<bool>            cancel = false;
+        bool                         success;
+        u64                          length;
+        std::string                  errmsg;
+    } verify;
+
+    // the frame being displayed, taken from the machine once per Update. the serial changes with
+    // every new frame, so windows only need to upload it when it does
+    u32 const*  display_framebuffer = nullptr;
+    u64         display_framebuffer_serial = 0;
+
+    // machine snapshots for the debugger windows, handed from the emulation thread with the same triple
+    // buffering as the framebuffer. Update asks for a new one every frame, and the emulation thread
+    // publishes it at the next PPU frame. When the emulation thread is idle, Update publishes it itself
+    static int const SNAPSHOT_READY_INDEX = 0x03;
+    static int const SNAPSHOT_READY_NEW   = 0x04;
+
+    std::unique_ptr<MachineSnapshot[]> snapshots;
+    int                    snapshot_back_index  = 0;
+    std::atomic<int>       snapshot_ready_state = 1;
+    int                    snapshot_front_index = 2;
+    std::atomic<bool>      snapshot_requested   = true;
+    u64                    snapshot_serial      = 0;
+    int                    snapshot_ppu_frame   = -1;
+    MachineSnapshot const* display_snapshot     = nullptr;
 
     bool        step_instruction_done = false;
-    int         cpu_shift = 0;
+
+    // last_frame is the PPU frame the functions were last called for, and only used by the emulation thread
+    struct {
+        std::mutex                                mutex;
+        std::unordered_map<int, frame_function_t> functions;
+        int                                       next_id    = 0;
+        int                                       last_frame = -1;
+    } frame_functions;
+
+    // where STEP_OVER, STEP_OUT and RUN_TO stop, set by the main thread before changing the state.
+    // the stack pointer check lets recursive calls to the same subroutine run through
+    struct {
+        u16  pc;
+        bool check_bank;
+        u16  prg_rom_bank;
+        u8   s;
+        u16  last_opcode;
+    } step_target;
 
     u64 last_cycle_count = 0;
     std::chrono::time_point<std::chrono::steady_clock> last_cycle_time;
     double cycles_per_sec;
 
-    // Framebuffers are 0xAABBGGRR format (MSB = alpha)
-    u32*                         framebuffer;
+    // emulation speed and where the time goes, as percentages of the sampled time
+    Machine::Timing last_timing;
+    struct {
+        double frames_per_sec   = 0.0;
+        double percent_realtime = 0.0;
+        double cpu              = 0.0;
+        double memory           = 0.0;
+        double breakpoints      = 0.0;
+        double ppu              = 0.0;
+        double oam_dma          = 0.0;
+    } timing_stats;
+
+    // breakpoints. range_breakpoints also holds the ones that cover more than one address, since they
+    // can't be found by address. The main thread changes them and the emulation thread checks them, so
+    // both hold breakpoint_mutex
+    std::unordered_map<breakpoint_key_t, breakpoint_list_t> breakpoints;
+    breakpoint_list_t        range_breakpoints;
+    std::mutex               breakpoint_mutex;
 
-    // rasterizer position
-    bool                         hblank;
-    u32*                         raster_line;
-    int                          raster_y;
-    int                          raster_x;
+    // tells the Machine which accesses to check. The Machine reads the live filter without a lock, so
+    // changes are built into next (holding breakpoint_mutex) and the emulation thread swaps them between
+    // cycles in CheckAccessFilter
+    struct {
+        Machine::AccessFilter* live;
+        Machine::AccessFilter* next;
+        std::atomic<bool>      pending = false;
+    } access_filter;
 
-    // OAM DMA
-    bool                         oam_dma_enabled = false;
-    u16                          oam_dma_source;
-    u8                           oam_dma_rw;
-    u8                           oam_dma_read_latch;
-    bool                         dma_halt_cycle_done;
+    // whole bank breakpoints are only in the filter where the bank is mapped, so the emulation thread
+    // rebuilds it when the cartridge's PRG generation moves past the one it was built with
+    std::shared_ptr<Systems::NES::CartridgeView> cartridge_view;
+    std::atomic<bool>        has_whole_bank_breakpoints   = false;
+    std::atomic<u32>         access_filter_prg_generation = 0;
 
-    signal_connection            oam_dma_callback_connection;
-
-    // breakpoints
-    std::unordered_map<breakpoint_key_t, breakpoint_list_t> breakpoints;
-    u32* cpu_quick_breakpoints;
+    void AddToAccessFilter(Machine::AccessFilter&, BreakpointInfo const&);
+    void BuildAccessFilter();
 
     // save states
     std::shared_ptr<SaveStateInfo> CreateSaveState();
@@ -327,6 +476,7 @@ protected:
 private:
     void* framebuffer_texture;
     bool  valid_texture = false;
+    u64   uploaded_serial = 0;
 };
  
 class CPUState : public BaseWindow {
@@ -375,11 +525,11 @@ protected:
     bool LoadWindow(std::istream&, std::string&) override;
 
 private:
-    void RenderRegisters(std::shared_ptr<PPU> const&);
-    void RenderNametables(std::shared_ptr<PPU> const&);
-    void RenderPalettes(std::shared_ptr<PPU> const&);
-    void RenderSprites(std::shared_ptr<PPU> const&);
-    void RenderPatternTables(std::shared_ptr<PPU> const&);
+    void RenderRegisters(MachineSnapshot const&);
+    void RenderNametables(MachineSnapshot const&);
+    void RenderPalettes(MachineSnapshot const&);
+    void RenderSprites(MachineSnapshot const&);
+    void RenderPatternTables(MachineSnapshot const&);
 
     int   display_mode = 0;
     bool  show_scroll_window = true;
@@ -387,20 +537,57 @@ private:
 
     bool  valid_texture = false;
 
-    void  UpdateNametableTexture();
+    void  UpdateNametableTexture(MachineSnapshot const&);
     u32*  nametable_framebuffer;
     void* nametable_texture;
 
-    void  UpdateSpriteTexture();
+    void  UpdateSpriteTexture(MachineSnapshot const&);
     u32*  sprites_framebuffer;
     void* sprites_texture;
     u8    oam_copy[256]; // copy of OAM updated in UpdateSpriteTexture
 
-    void  UpdatePatternTextures();
+    void  UpdatePatternTextures(MachineSnapshot const&);
     u32*  pattern_framebuffer[2];
     void* pattern_texture[2];
     u8    palette_copy[0x20];
     u8    palette_index = 0;
+
+    // both pattern tables as the PPU currently sees them, shared by all three views
+    Systems::NES::TileCache pattern_tiles;
+
+    // what each texture was last drawn from, so only the tiles that changed are redrawn and nothing
+    // is uploaded when nothing changed
+    struct {
+        bool valid = false;
+        u32  vram_generation;
+        u32  chr_generation;
+        u32  palette_generation;
+        int  tile_base;
+        Systems::NES::MIRRORING mirroring;
+        bool show_scroll_window;
+        int  scroll_x;
+        int  scroll_y;
+        u8   vram[0x800];
+        u32  tile_serials[64 * 60];       // pattern tile serial each 8x8 tile was drawn with
+        std::bitset<64 * 60> dirty_tiles; // 8x8 tiles of nametable_framebuffer under the scroll window
+    } nametable_drawn;
+
+    struct {
+        bool valid = false;
+        u32  oam_generation;
+        u32  chr_generation;
+        u32  palette_generation;
+        int  tile_base;
+        u32  tile_serials[64];
+    } sprites_drawn;
+
+    struct {
+        bool valid = false;
+        u32  chr_generation;
+        u32  palette_generation;
+        u8   palette_index;
+        u32  tile_serials[512];
+    } patterns_drawn;
 };
 
 class Watch : public BaseWindow {
@@ -492,6 +679,7 @@ private:
 
     void SetBreakpoint();
     void SetCondition();
+    bool EvaluateAddress(std::string const&, s64*, std::string&, int&);
 
     std::shared_ptr<BreakpointInfo> editing_breakpoint_info;
     std::string edit_string;
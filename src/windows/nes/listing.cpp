@@ -20,6 +20,7 @@
 #include "systems/nes/cartridge.h"
 #include "systems/nes/comment.h"
 #include "systems/nes/expressions.h"
+#include "systems/nes/journal.h"
 #include "systems/nes/label.h"
 #include "systems/nes/system.h"
 
@@ -268,6 +269,8 @@ void Listing::CheckInput()
 
     bool no_mods = !(io.KeyCtrl || io.KeyShift || io.KeyAlt || io.KeySuper);
     bool shift_only = !(io.KeyCtrl || io.KeyAlt || io.KeySuper) && io.KeyShift;
+    bool ctrl_only = !(io.KeyShift || io.KeyAlt || io.KeySuper) && io.KeyCtrl;
+    bool ctrl_shift = !(io.KeyAlt || io.KeySuper) && io.KeyCtrl && io.KeyShift;
 
     if(no_mods) {
         // handle back mouse button
@@ -396,6 +399,15 @@ void Listing::CheckInput()
             GetSystem()->AddBlankLine(current_selection);
         }
     }
+
+    if(ctrl_only) {
+        if(ImGui::IsKeyPressed(ImGuiKey_Z)) current_system->GetJournal()->Undo();
+        if(ImGui::IsKeyPressed(ImGuiKey_Y)) current_system->GetJournal()->Redo();
+    }
+
+    if(ctrl_shift) {
+        if(ImGui::IsKeyPressed(ImGuiKey_Z)) current_system->GetJournal()->Redo();
+    }
 }
 
 void Listing::CreateDestinationLabel()
@@ -436,6 +448,9 @@ void Listing::CreateDestinationLabel()
        && memory_object->type != MemoryObject::TYPE_WORD) return;
 
     auto apply_label = [this, memory_region, memory_object](GlobalMemoryLocation const& label_address) {
+        // the label and the expression using it are undone together
+        current_system->GetJournal()->BeginTransaction("Create pointer");
+
         // get the target location and create a label if none exists
         int offset = 0;
 
@@ -461,6 +476,8 @@ void Listing::CreateDestinationLabel()
         
         // set the expression for memory object at current_selection. it'll show up immediately
         memory_region->SetOperandExpression(current_selection, expr);
+
+        current_system->GetJournal()->EndTransaction();
     };
 
     // use the word data as a pointer to memory
@@ -41,6 +41,7 @@ public:
     void GoToAddress(u32, bool save);
     void GoToCurrentInstruction();
     void Refocus(); // re focus on the current selection
+    GlobalMemoryLocation const& GetCurrentSelection() const { return current_selection; }
     void Follow();
     void GoBack(); // go back in the location history
     void GoForward(); // go forward in the location history
@@ -332,25 +332,10 @@ void ListingItemPrimary::Render(shared_ptr<Windows::NES::SystemInstance> const&
         ImGui::TableNextColumn(); // spacing
 
         ImGui::TableNextColumn(); // Raw bytes display
-        if(line == 0) { // TODO this will need improvement one day
-            int objsize = memory_object->GetSize();
-            stringstream ss;
-            ss << hex << setfill('0') << uppercase;
-            for(int i = 0; i < objsize; i++) {
-                if(memory_object->backed) {
-                    int bval = (int)memory_object->data_ptr[i];
-                    ss << setw(2) << bval;
-                } else {
-                    ss << "??";
-                }
-                if(i != (objsize - 1)) ss << " ";
-            }
-
-            ImGui::Text("%s", ss.str().c_str());
-        }
+        if(line == 0) ImGui::Text("%s", memory_object->GetCachedRawBytes(disassembler).c_str());
 
         ImGui::TableNextColumn();
-        if(line == 0) ImGui::Text("%s", memory_object->FormatInstructionField(disassembler).c_str());
+        if(line == 0) ImGui::Text("%s", memory_object->GetCachedInstructionField(disassembler).c_str());
 
         ImGui::TableNextColumn();
         if(line == 0) {
@@ -366,7 +351,7 @@ void ListingItemPrimary::Render(shared_ptr<Windows::NES::SystemInstance> const&
                 //     $04, $05, $06
                 //     $07
                 //
-                string operand = memory_object->FormatOperandField(line, disassembler);
+                auto const& operand = memory_object->GetCachedOperandField(disassembler);
                 ImGui::Text("%s", operand.c_str());
                 if(ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(0)) { // edit on double click
                     EditOperandExpression(system, where);
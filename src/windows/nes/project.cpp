@@ -195,6 +195,14 @@ bool Project::Load(std::istream& is, std::string& errmsg)
 
 void Project::Update(double deltaTime) 
 {
+    // finish loading the cartridge banks that weren't needed when the project was opened,
+    // a few banks each frame
+    if(auto system = GetSystem<System>()) {
+        auto& cartridge = system->GetCartridge();
+        if(cartridge && cartridge->HasDeferredBanks()) {
+            cartridge->LoadNextDeferredBanks(max(1u, thread::hardware_concurrency()));
+        }
+    }
 }
 
 void Project::Render() 
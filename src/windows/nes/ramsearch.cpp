@@ -0,0 +1,243 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "imgui.h"
+#include "imgui_internal.h"
+#include "imgui_stdlib.h"
+
+#include "util.h"
+
+#include "systems/nes/ram_search.h"
+
+#include "windows/nes/emulator.h"
+#include "windows/nes/listing.h"
+#include "windows/nes/project.h"
+#include "windows/nes/ramsearch.h"
+
+using namespace std;
+
+namespace Windows::NES {
+
+REGISTER_WINDOW(RAMSearch);
+
+shared_ptr<RAMSearch> RAMSearch::CreateWindow()
+{
+    return make_shared<RAMSearch>();
+}
+
+RAMSearch::RAMSearch()
+    : BaseWindow()
+{
+    SetTitle("RAM Search");
+    SetNoScrollbar(true);
+}
+
+RAMSearch::~RAMSearch()
+{
+    // the system instance can be closed first
+    if(auto system_instance = frame_function_instance.lock()) system_instance->RemoveFrameFunction(frame_function_id);
+}
+
+void RAMSearch::Update(double deltaTime)
+{
+    if(!started) NewSearch();
+}
+
+void RAMSearch::NewSearch()
+{
+    auto system_instance = GetMySystemInstance();
+    if(!system_instance) return;
+
+    auto snapshot = system_instance->GetSnapshot();
+    if(!snapshot) return;
+
+    {
+        lock_guard<mutex> lock(searcher_mutex);
+        searcher.Reset(snapshot->cpu_memory);
+        searcher.GetCandidates(candidate_list);
+    }
+
+    selected_row = -1;
+
+    // snapshots can skip frames, so every frame is added on the emulation thread as it completes
+    if(!started) {
+        frame_function_instance = system_instance;
+        frame_function_id = system_instance->AddFrameFunction([this](Systems::NES::Machine& machine) {
+            lock_guard<mutex> lock(searcher_mutex);
+            searcher.AddFrame(machine);
+        });
+        started = true;
+    }
+}
+
+void RAMSearch::ApplyFilter()
+{
+    static RAMSearcher::PREDICATE const predicates[] = {
+        RAMSearcher::PREDICATE::EQUAL_TO, RAMSearcher::PREDICATE::NOT_EQUAL_TO,
+        RAMSearcher::PREDICATE::GREATER_THAN, RAMSearcher::PREDICATE::LESS_THAN,
+        RAMSearcher::PREDICATE::CHANGED, RAMSearcher::PREDICATE::UNCHANGED,
+        RAMSearcher::PREDICATE::INCREASED, RAMSearcher::PREDICATE::DECREASED,
+        RAMSearcher::PREDICATE::INCREASED_BY, RAMSearcher::PREDICATE::DECREASED_BY
+    };
+
+    lock_guard<mutex> lock(searcher_mutex);
+
+    int frames = searcher.GetNumFrames();
+    int count = searcher.Apply(predicates[predicate], value, every_frame);
+    cout << "[RAMSearch::ApplyFilter] " << dec << count << " candidate(s) left after " << frames << " frame(s)" << endl;
+
+    searcher.GetCandidates(candidate_list);
+    selected_row = -1;
+}
+
+void RAMSearch::AddWatch(u16 address)
+{
+    auto system_instance = GetMySystemInstance();
+
+    auto watch = system_instance->FindMostRecentChildWindow<Watch>();
+    if(!watch) watch = dynamic_pointer_cast<Watch>(system_instance->CreateNewWindow("Watch"));
+    if(!watch) return;
+
+    stringstream ss;
+    ss << "*$" << hex << uppercase << setfill('0') << setw(4) << address;
+    watch->CreateWatch(ss.str());
+}
+
+void RAMSearch::AddWriteBreakpoint(u16 address)
+{
+    // a 16-bit address breaks in all banks, same as typing the address into Breakpoints
+    auto bpi = make_shared<BreakpointInfo>();
+    bpi->address = {
+        .address = address,
+        .is_chr = false,
+        .prg_rom_bank = 0,
+    };
+    bpi->has_bank = false;
+    bpi->enabled = true;
+    bpi->break_write = true;
+    GetMySystemInstance()->SetBreakpoint(address, bpi);
+}
+
+void RAMSearch::Render()
+{
+    static char const * const predicate_names[] = {
+        "Equal to", "Not equal to", "Greater than", "Less than",
+        "Changed", "Unchanged", "Increased", "Decreased", "Increased by", "Decreased by"
+    };
+
+    // the predicates that don't use the value
+    bool needs_value = (predicate < 4) || (predicate > 7);
+
+    if(ImGui::Button("New Search")) NewSearch();
+
+    ImGui::SameLine();
+    ImGui::PushItemWidth(120);
+    ImGui::Combo("##predicate", &predicate, predicate_names, IM_ARRAYSIZE(predicate_names));
+    ImGui::PopItemWidth();
+
+    if(needs_value) {
+        ImGui::SameLine();
+        ImGui::PushItemWidth(100);
+        if(ImGui::InputInt("##value", &value)) value = max(0, min(255, value));
+        ImGui::PopItemWidth();
+    }
+
+    ImGui::SameLine();
+    ImGui::Checkbox("Every frame", &every_frame);
+    if(ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Require the predicate to hold from each frame to the next since the last filter,\nnot just from the last filter to now");
+    }
+
+    ImGui::SameLine();
+    if(ImGui::Button("Filter") && started) ApplyFilter();
+
+    int num_candidates, num_frames;
+    {
+        lock_guard<mutex> lock(searcher_mutex);
+        num_candidates = searcher.GetNumCandidates();
+        num_frames = searcher.GetNumFrames();
+    }
+    ImGui::Text("%d candidate(s), %d frame(s) since the last filter", num_candidates, num_frames);
+
+    ImGui::Separator();
+
+    ImGui::PushStyleVar(ImGuiStyleVar_CellPadding, ImVec2(0, 0));
+    ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
+
+    static ImGuiTableFlags flags = ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_BordersOuterH
+            | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_NoBordersInBody
+            | ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_ScrollY;
+
+    if(ImGui::BeginTable("RAMSearchTable", 3, flags)) {
+        ImGui::TableSetupColumn("Address" , ImGuiTableColumnFlags_WidthFixed  , 80.0f, 0);
+        ImGui::TableSetupColumn("Previous", ImGuiTableColumnFlags_WidthStretch, 0.0f , 1);
+        ImGui::TableSetupColumn("Current" , ImGuiTableColumnFlags_WidthStretch, 0.0f , 2);
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin(candidate_list.size());
+
+        while(clipper.Step()) {
+            for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                int index = candidate_list[row];
+                u16 address = RAMSearcher::GetAddress(index);
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+
+                // Create the hidden selectable item. double click adds a watch, right click for more
+                {
+                    ImGuiSelectableFlags selectable_flags = ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap | ImGuiSelectableFlags_AllowDoubleClick;
+                    char buf[32];
+                    sprintf(buf, "##rs_selectable_row%d", row);
+                    if(ImGui::Selectable(buf, selected_row == row, selectable_flags)) {
+                        selected_row = row;
+                        if(ImGui::IsMouseDoubleClicked(0)) AddWatch(address);
+                    }
+
+                    if(ImGui::IsItemHovered() && ImGui::IsMouseClicked(1)) {
+                        context_row = row;
+                        ImGui::OpenPopup("ram_search_context_menu");
+                    }
+
+                    ImGui::SameLine();
+                }
+
+                ImGui::Text("$%04X", address);
+
+                u8 previous, current;
+                {
+                    lock_guard<mutex> lock(searcher_mutex);
+                    previous = searcher.GetPreviousValue(index);
+                    current = searcher.GetCurrentValue(index);
+                }
+
+                ImGui::TableNextColumn();
+                ImGui::Text("$%02X (%d)", previous, previous);
+
+                ImGui::TableNextColumn();
+                ImGui::Text("$%02X (%d)", current, current);
+            }
+        }
+
+        if(context_row >= 0 && context_row < (int)candidate_list.size() && ImGui::BeginPopupContextItem("ram_search_context_menu")) {
+            u16 address = RAMSearcher::GetAddress(candidate_list[context_row]);
+            if(ImGui::MenuItem("Add Watch")) AddWatch(address);
+            if(ImGui::MenuItem("Break on Write")) AddWriteBreakpoint(address);
+            ImGui::EndPopup();
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::PopStyleVar(2);
+}
+
+} //namespace Windows::NES
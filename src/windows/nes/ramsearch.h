@@ -0,0 +1,64 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "signals.h"
+#include "windows/basewindow.h"
+
+#include "systems/nes/ram_search.h"
+
+namespace Windows::NES {
+
+class SystemInstance;
+
+// RAM search (cheat finder). Every emulated frame is added to a RAMSearcher from the emulation thread,
+// and each filter narrows down the addresses that could hold the value being looked for
+class RAMSearch : public BaseWindow {
+public:
+    using RAMSearcher = Systems::NES::RAMSearcher;
+
+    RAMSearch();
+    virtual ~RAMSearch();
+
+    virtual char const * const GetWindowClass() { return RAMSearch::GetWindowClassStatic(); }
+    static char const * const GetWindowClassStatic() { return "Windows::NES::RAMSearch"; }
+    static std::shared_ptr<RAMSearch> CreateWindow();
+
+    // signals
+
+protected:
+    void Update(double deltaTime) override;
+    void Render() override;
+
+private:
+    void NewSearch();
+    void ApplyFilter();
+    void AddWatch(u16);
+    void AddWriteBreakpoint(u16);
+
+    // the searcher is shared with the emulation thread's frame function
+    RAMSearcher      searcher;
+    std::mutex       searcher_mutex;
+    bool             started = false;
+
+    std::weak_ptr<SystemInstance> frame_function_instance;
+    int              frame_function_id = -1;
+
+    int              predicate   = 0;
+    int              value       = 0;
+    bool             every_frame = false;
+
+    std::vector<int> candidate_list;
+    int              selected_row = -1;
+    int              context_row  = -1;
+};
+
+} //namespace Windows::NES
@@ -0,0 +1,173 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "imgui.h"
+#include "imgui_internal.h"
+#include "imgui_stdlib.h"
+
+#include "util.h"
+
+#include "systems/nes/memory.h"
+#include "systems/nes/search.h"
+#include "systems/nes/system.h"
+
+#include "windows/nes/emulator.h"
+#include "windows/nes/listing.h"
+#include "windows/nes/project.h"
+#include "windows/nes/search.h"
+
+using namespace std;
+
+namespace Windows::NES {
+
+REGISTER_WINDOW(Search);
+
+shared_ptr<Search> Search::CreateWindow()
+{
+    return make_shared<Search>();
+}
+
+Search::Search()
+    : BaseWindow()
+{
+    SetTitle("Search");
+    SetNoScrollbar(true);
+
+    if(auto system = GetSystem()) {
+        // grab a weak_ptr so we don't have to continually use dynamic_pointer_cast
+        current_system = system;
+        searcher = make_shared<Searcher>(system);
+    }
+}
+
+Search::~Search()
+{
+}
+
+void Search::Update(double deltaTime)
+{
+    if(!searcher) return;
+
+    // pull in any results found since the last frame
+    searcher->GetResults(results, results.size());
+}
+
+void Search::StartSearch()
+{
+    static Searcher::SEARCH_TYPE const search_types[] = {
+        Searcher::SEARCH_TYPE::BYTES, Searcher::SEARCH_TYPE::INSTRUCTIONS, Searcher::SEARCH_TYPE::TEXT
+    };
+
+    results.clear();
+    selected_row = -1;
+    errmsg = "";
+
+    if(!searcher->Start(search_types[search_type], query, errmsg)) {
+        cout << "[Search::StartSearch] " << errmsg << endl;
+    }
+}
+
+void Search::Render()
+{
+    auto system = current_system.lock();
+    if(!system || !searcher) return;
+
+    static char const * const search_type_names[] = { "Bytes", "Instructions", "Text" };
+    static char const * const search_type_hints[] = { "A9 ?? 8D 00 20", "LDA #imm; STA $2000", "label, comment or operand" };
+
+    ImGui::PushItemWidth(120);
+    ImGui::Combo("##search_type", &search_type, search_type_names, IM_ARRAYSIZE(search_type_names));
+    ImGui::PopItemWidth();
+
+    ImGui::SameLine();
+    ImGui::PushItemWidth(-120);
+    bool do_search = ImGui::InputTextWithHint("##query", search_type_hints[search_type], &query, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::PopItemWidth();
+
+    ImGui::SameLine();
+    if(searcher->IsRunning()) {
+        if(ImGui::Button("Stop")) searcher->Stop();
+    } else {
+        if(ImGui::Button("Search")) do_search = true;
+    }
+
+    if(do_search) StartSearch();
+
+    if(errmsg.size()) {
+        ImGui::PushStyleColor(ImGuiCol_Text, (ImU32)ImColor(255, 0, 0, 255));
+        ImGui::Text("%s", errmsg.c_str());
+        ImGui::PopStyleColor(1);
+    } else if(searcher->IsRunning()) {
+        ImGui::ProgressBar(searcher->GetProgress(), ImVec2(-1, 0));
+    } else {
+        ImGui::Text("%d result(s)", (int)results.size());
+    }
+
+    ImGui::Separator();
+
+    ImGui::PushStyleVar(ImGuiStyleVar_CellPadding, ImVec2(0, 0));
+    ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
+
+    static ImGuiTableFlags flags = ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_BordersOuterH
+            | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_NoBordersInBody
+            | ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_ScrollY;
+
+    if(ImGui::BeginTable("SearchResultsTable", 2, flags)) {
+        ImGui::TableSetupColumn("Location", ImGuiTableColumnFlags_WidthFixed  , 80.0f, 0);
+        ImGui::TableSetupColumn("Match"   , ImGuiTableColumnFlags_WidthStretch, 0.0f , 1);
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin(results.size());
+
+        while(clipper.Step()) {
+            for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                auto const& result = results[row];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+
+                // Create the hidden selectable item
+                {
+                    ImGuiSelectableFlags selectable_flags = ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap;
+                    char buf[32];
+                    sprintf(buf, "##sr_selectable_row%d", row);
+                    if(ImGui::Selectable(buf, selected_row == row, selectable_flags)) {
+                        selected_row = row;
+                        if(auto listing = GetMyListing()) {
+                            listing->GoToAddress(result.where, true);
+                        }
+                    }
+                    ImGui::SameLine();
+                }
+
+                stringstream ss;
+                ss << "$" << hex << uppercase << setfill('0');
+
+                GlobalMemoryLocation const& loc = result.where;
+                if(system->CanBank(loc)) {
+                    ss << setw(2) << (loc.is_chr ? loc.chr_rom_bank : loc.prg_rom_bank) << ":";
+                }
+                ss << setw(4) << loc.address;
+                ImGui::Text("%s", ss.str().c_str());
+
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", result.context.c_str());
+            }
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::PopStyleVar(2);
+}
+
+} //namespace Windows::NES
+
@@ -0,0 +1,57 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "signals.h"
+#include "windows/basewindow.h"
+
+#include "systems/nes/search.h"
+
+namespace Systems::NES {
+    class System;
+}
+
+namespace Windows::NES {
+
+class Search : public BaseWindow {
+public:
+    using GlobalMemoryLocation = Systems::NES::GlobalMemoryLocation;
+    using Searcher             = Systems::NES::Searcher;
+    using System               = Systems::NES::System;
+
+    Search();
+    virtual ~Search();
+
+    virtual char const * const GetWindowClass() { return Search::GetWindowClassStatic(); }
+    static char const * const GetWindowClassStatic() { return "Windows::NES::Search"; }
+    static std::shared_ptr<Search> CreateWindow();
+
+    // signals
+
+protected:
+    void Update(double deltaTime) override;
+    void Render() override;
+
+private:
+    void StartSearch();
+
+    std::weak_ptr<System>     current_system;
+    std::shared_ptr<Searcher> searcher;
+
+    int         search_type = 0;
+    std::string query;
+    std::string errmsg;
+    int         selected_row = -1;
+
+    std::vector<Searcher::Result> results;
+};
+
+} //namespace Windows::NES
+
@@ -14,6 +14,7 @@
 #include "imgui_internal.h"
 
 #include "signals.h"
+#include "trace.h"
 #include "systems/system.h"
 #include "windows/baseproject.h"
 #include "windows/main.h"
@@ -207,6 +208,9 @@ void ProjectCreatorWindow::CreateNewProjectProgress(shared_ptr<BaseProject> syst
 
 void ProjectCreatorWindow::CreateProjectThreadMain()
 {
+    TRACE_THREAD_NAME("Create Project");
+    TRACE_SCOPE("ProjectCreatorWindow::CreateProjectThreadMain");
+
     cout << "[ProjectCreatorWindow] CreateProjectThreadMain start" << endl;
 
     if(current_project->CreateNewProjectFromFile(file_path_name)) {
@@ -0,0 +1,90 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#include <algorithm>
+
+#include "worker_pool.h"
+
+using namespace std;
+
+WorkerPool& WorkerPool::Get()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::WorkerPool()
+{
+    int num_workers = (int)max(1u, thread::hardware_concurrency()) - 1;
+    for(int i = 0; i < num_workers; i++) threads.emplace_back(&WorkerPool::WorkerThread, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        exit_threads = true;
+    }
+    work_ready.notify_all();
+
+    for(auto& t : threads) t.join();
+}
+
+void WorkerPool::Run(int count, job_func_t const& func)
+{
+    if(count <= 0) return;
+
+    auto job = make_shared<Job>(func, count);
+    if(count > 1 && threads.size()) {
+        lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+        work_ready.notify_all();
+    }
+
+    RunJob(*job);
+
+    // workers may still be in the middle of the last few calls
+    unique_lock<std::mutex> lock(mutex);
+    job_finished.wait(lock, [&job]() { return job->finished.load() == job->count; });
+
+    // every call has been handed out, but the job may not have been taken off the queue yet
+    auto it = find(jobs.begin(), jobs.end(), job);
+    if(it != jobs.end()) jobs.erase(it);
+}
+
+void WorkerPool::RunJob(Job& job)
+{
+    int completed = 0;
+    for(int i = job.next++; i < job.count; i = job.next++) {
+        job.func(i);
+        completed++;
+    }
+
+    // whoever completes the last call wakes the thread that's waiting in Run
+    if(completed && job.finished.fetch_add(completed) + completed == job.count) {
+        lock_guard<std::mutex> lock(mutex);
+        job_finished.notify_all();
+    }
+}
+
+void WorkerPool::WorkerThread()
+{
+    unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        work_ready.wait(lock, [this]() { return exit_threads || jobs.size(); });
+        if(exit_threads) return;
+
+        // a job stays at the front of the queue until all of its calls have been handed out
+        auto job = jobs.front();
+        if(job->next.load() >= job->count) {
+            jobs.pop_front();
+            continue;
+        }
+
+        lock.unlock();
+        RunJob(*job);
+        lock.lock();
+    }
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2023, Charles Mason <chuck+github@borboggle.com>
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// WorkerPool is the application's set of worker threads for splitting up work like encoding and decoding
+// project banks. There's one worker for every hardware thread but one, since the thread asking for the
+// work does its share too. The workers are started the first time the pool is used and run until exit.
+//
+// Any thread can call Run, and calls from different threads share the workers.
+class WorkerPool {
+public:
+    typedef std::function<void(int)> job_func_t;
+
+    static WorkerPool& Get();
+    ~WorkerPool();
+
+    int GetNumThreads() const { return (int)threads.size() + 1; }
+
+    // call func(i) for every i in [0, count) and return once every call has completed
+    void Run(int count, job_func_t const& func);
+
+private:
+    struct Job {
+        job_func_t const& func;
+        int               count;
+        std::atomic<int>  next     = 0;
+        std::atomic<int>  finished = 0;
+
+        Job(job_func_t const& _func, int _count) : func(_func), count(_count) {}
+    };
+
+    WorkerPool();
+    void WorkerThread();
+    void RunJob(Job&);
+
+    std::vector<std::thread>         threads;
+    std::mutex                       mutex;
+    std::condition_variable          work_ready;
+    std::condition_variable          job_finished;
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool                             exit_threads = false;
+};
+
+// Call func(i) for every i in [0, count) spread over the WorkerPool. The calling thread does its share of
+// the work and returns once every call has completed
+template<class Func>
+inline void ParallelFor(int count, Func const& func)
+{
+    WorkerPool::Get().Run(count, WorkerPool::job_func_t(func));
+}